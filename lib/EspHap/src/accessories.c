@@ -291,6 +291,7 @@ homekit_characteristic_t* homekit_characteristic_clone(homekit_characteristic_t*
     clone->setter = ch->setter;
     clone->getter_ex = ch->getter_ex;
     clone->setter_ex = ch->setter_ex;
+    clone->data_reader = ch->data_reader;
     clone->context = ch->context;
 
     return clone;
@@ -394,6 +395,53 @@ void homekit_characteristic_ex_old_setter(homekit_characteristic_t *ch, homekit_
     ch->setter(value);
 }
 
+// aid.iid lookup table of the database given to homekit_accessories_init,
+// open addressing with room for twice the characteristics count
+static homekit_accessory_t **index_accessories = NULL;
+static homekit_characteristic_t **index_table = NULL;
+static uint32_t index_mask = 0;
+
+static uint32_t homekit_characteristic_index_hash(uint32_t aid, uint32_t iid) {
+    return (aid * 2654435761UL) ^ (iid * 2246822519UL);
+}
+
+static void homekit_characteristic_index_build(homekit_accessory_t **accessories) {
+    free(index_table);
+    index_table = NULL;
+    index_accessories = NULL;
+
+    uint32_t count = 0;
+    for (homekit_accessory_t **accessory_it = accessories; *accessory_it; accessory_it++) {
+        for (homekit_service_t **service_it = (*accessory_it)->services; *service_it; service_it++) {
+            for (homekit_characteristic_t **ch_it = (*service_it)->characteristics; *ch_it; ch_it++) {
+                count++;
+            }
+        }
+    }
+
+    uint32_t size = 4;
+    while (size < count * 2)
+        size *= 2;
+
+    index_table = calloc(size, sizeof(homekit_characteristic_t*));
+    if (!index_table)
+        return; // lookups walk the database
+
+    index_mask = size - 1;
+    index_accessories = accessories;
+    for (homekit_accessory_t **accessory_it = accessories; *accessory_it; accessory_it++) {
+        homekit_accessory_t *accessory = *accessory_it;
+        for (homekit_service_t **service_it = accessory->services; *service_it; service_it++) {
+            for (homekit_characteristic_t **ch_it = (*service_it)->characteristics; *ch_it; ch_it++) {
+                uint32_t i = homekit_characteristic_index_hash(accessory->id, (*ch_it)->id) & index_mask;
+                while (index_table[i])
+                    i = (i + 1) & index_mask;
+                index_table[i] = *ch_it;
+            }
+        }
+    }
+}
+
 void homekit_accessories_init(homekit_accessory_t **accessories) {
     //设置aid 和 iid (自增1)
 	uint32_t aid = 1;
@@ -437,6 +485,8 @@ void homekit_accessories_init(homekit_accessory_t **accessories) {
             }
         }
     }
+
+    homekit_characteristic_index_build(accessories);
 }
 
 homekit_accessory_t *homekit_accessory_by_id(homekit_accessory_t **accessories, uint32_t aid) {
@@ -473,6 +523,17 @@ homekit_characteristic_t *homekit_service_characteristic_by_type(homekit_service
 }
 
 homekit_characteristic_t *homekit_characteristic_by_aid_and_iid(homekit_accessory_t **accessories, uint32_t aid, uint32_t iid) {
+    if (accessories == index_accessories) {
+        uint32_t i = homekit_characteristic_index_hash(aid, iid) & index_mask;
+        while (index_table[i]) {
+            homekit_characteristic_t *ch = index_table[i];
+            if (ch->id == iid && ch->service->accessory->id == aid)
+                return ch;
+            i = (i + 1) & index_mask;
+        }
+        return NULL;
+    }
+
     for (homekit_accessory_t **accessory_it = accessories; *accessory_it; accessory_it++) {
         homekit_accessory_t *accessory = *accessory_it;
 
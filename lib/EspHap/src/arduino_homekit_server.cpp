@@ -5,6 +5,7 @@
 #include <WiFiClient.h>
 #include <ESP8266mDNS.h>
 #include <LEAmDNS.h>
+#include <LittleFS.h>
 
 #include <wolfssl/wolfcrypt/settings.h>
 #include <homekit/homekit.h>
@@ -23,8 +24,7 @@
 #include "port.h"
 #include "http_parser.h"
 #include "query_params.h"
-#include "cJSON.h"
-#include "cQueue.h"
+#include "json_reader.h"
 #include "crypto.h"
 #include "watchdog.h"
 #include "arduino_homekit_server.h"
@@ -33,7 +33,24 @@
 #define HOMEKIT_MAX_CLIENTS      8
 #define HOMEKIT_MDNS_SERVICE     "hap"//"_hap"
 #define HOMEKIT_MDNS_PROTO       "tcp"//"_tcp"
-#define HOMEKIT_EVENT_QUEUE_SIZE 4 //original is 20
+// Token bucket of EVENT messages per client, held back events are coalesced
+#ifndef HOMEKIT_EVENT_RATE_PER_SEC
+#define HOMEKIT_EVENT_RATE_PER_SEC 2
+#endif
+#ifndef HOMEKIT_EVENT_BURST
+#define HOMEKIT_EVENT_BURST 4
+#endif
+// Static part of /accessories rendered once into flash at init, ids, events
+// and value of each characteristic are spliced in at the marker. The marker
+// can not be part of the JSON itself, json_string escapes control characters.
+#define HOMEKIT_ACCESSORIES_CACHE_PATH   "/hapacc.cache"
+#define HOMEKIT_ACCESSORIES_CACHE_MAGIC  0x31434148 // "HAC1"
+#define HOMEKIT_ACCESSORIES_CACHE_SPLICE 0x01
+
+// Doubling backoff while the tcp send buffer can not take an EVENT
+#define HOMEKIT_EVENT_BACKOFF_MIN_MS 250
+#define HOMEKIT_EVENT_BACKOFF_MAX_MS 8000
+
 #define HOMEKIT_SOCKET_TIMEOUT   500 //milliseconds
 
 //#define TCP_DEFAULT_KEEPALIVE_IDLE_SEC          7200 // 2 hours
@@ -49,9 +66,19 @@
 
 // WiFiClient can not write big buff once.
 // TCP_SND_BUF = (2 * TCP_MSS) = 1072. See lwipopts.h
-// max(encrypted_chunk) = 512 + 8(chunk_info) + 18(chacha_info). See client_send_encrypted
+// max(encrypted_chunk) = 512 + 8(chunk_info) + 18(chacha_info). See client_tx_append
 #define HOMEKIT_JSONBUFFER_SIZE  512
 
+#define HOMEKIT_FRAME_SIZE      1024
+#define HOMEKIT_FRAME_AAD_SIZE  2
+#define HOMEKIT_FRAME_TAG_SIZE  16
+
+// Room for two full frames, a chunked response goes out in half the writes.
+// One frame fits TCP_SND_BUF, bigger writes wait for acks inside WiFiClient.
+#ifndef HOMEKIT_TX_BUFFER_SIZE
+#define HOMEKIT_TX_BUFFER_SIZE  (2 * (HOMEKIT_FRAME_AAD_SIZE + HOMEKIT_FRAME_SIZE + HOMEKIT_FRAME_TAG_SIZE))
+#endif
+
 #ifdef HOMEKIT_DEBUG
 #define TLV_DEBUG(values) //tlv_debug(values)
 #else
@@ -71,9 +98,11 @@ WiFiEventHandler arduino_homekit_gotiphandler;
       (server)->config->on_event(event);
 
 void client_context_free(client_context_t *c);
+void client_events_clear(client_context_t *client);
 void pairing_context_free(pairing_context_t *context);
 void homekit_server_close_client(homekit_server_t *server, client_context_t *context);
 bool arduino_homekit_preinit(homekit_server_t *server);
+bool preinit_start(homekit_server_t *server);
 
 homekit_server_t* server_new() {
 	homekit_server_t *server = (homekit_server_t*) malloc(sizeof(homekit_server_t));
@@ -88,9 +117,70 @@ homekit_server_t* server_new() {
 	server->paired = false;
 	server->pairing_context = NULL;
 	server->clients = NULL;
+	server->event_characteristics = NULL;
+	server->event_slots_count = 0;
+	server->event_fragments = NULL;
+	server->tx_buffer = (byte*) malloc(HOMEKIT_TX_BUFFER_SIZE);
+	server->tx_size = 0;
+	server->tx_frame = 0;
+	server->tx_client = NULL;
+	server->accessory_key_expanded_valid = false;
+	server->ephemeral_keys_count = 0;
+#ifdef HOMEKIT_PAIR_RESUME
+	memset(server->resume_sessions, 0, sizeof(server->resume_sessions));
+	server->resume_clock = 0;
+#endif
 	return server;
 }
 
+// Numbers characteristics that can notify, clients keep one event slot per number
+void server_event_slots_init(homekit_server_t *server) {
+	uint16_t count = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		uint16_t slot = 0;
+		for (homekit_accessory_t **accessory_it = server->config->accessories; *accessory_it; accessory_it++) {
+			for (homekit_service_t **service_it = (*accessory_it)->services; *service_it; service_it++) {
+				for (homekit_characteristic_t **ch_it = (*service_it)->characteristics; *ch_it; ch_it++) {
+					homekit_characteristic_t *ch = *ch_it;
+					if (!(ch->permissions & homekit_permissions_notify)) {
+						ch->event_slot = HOMEKIT_EVENT_SLOT_NONE;
+						continue;
+					}
+					if (slot >= HOMEKIT_EVENT_SLOT_NONE) {
+						ERROR("No event slot for %d.%d", (*accessory_it)->id, ch->id);
+						ch->event_slot = HOMEKIT_EVENT_SLOT_NONE;
+						continue;
+					}
+					if (pass) {
+						ch->event_slot = slot;
+						server->event_characteristics[slot] = ch;
+					}
+					slot++;
+				}
+			}
+		}
+		count = slot;
+
+		if (!pass && count) {
+			server->event_characteristics = (homekit_characteristic_t**) malloc(
+					count * sizeof(homekit_characteristic_t*));
+			if (!server->event_characteristics) {
+				ERROR("Error malloc event characteristics, count=%d", count);
+				return;
+			}
+		}
+	}
+	server->event_slots_count = count;
+
+	if (count) {
+		server->event_fragments = (characteristic_fragment_t*) calloc(count,
+				sizeof(characteristic_fragment_t));
+		if (!server->event_fragments) {
+			ERROR("Error malloc event fragments, count=%d", count);
+		}
+	}
+}
+
 void server_free(homekit_server_t *server) {
 	if (server->pairing_context)
 		pairing_context_free(server->pairing_context);
@@ -114,6 +204,18 @@ void server_free(homekit_server_t *server) {
 	if (server == running_server) {
 		running_server = NULL;
 	}
+	if (server->event_fragments) {
+		free(server->event_fragments);
+	}
+	while (server->ephemeral_keys_count) {
+		crypto_curve25519_done(&server->ephemeral_keys[--server->ephemeral_keys_count]);
+	}
+
+	free(server->tx_buffer);
+
+	if (server->event_characteristics) {
+		free(server->event_characteristics);
+	}
 	free(server);
 }
 
@@ -180,10 +282,13 @@ client_context_t* client_context_new(WiFiClient *wifiClient) {
 	c->count_writes = 0;
 	c->disconnect = false;
 
-	//c->event_queue = xQueueCreate(20, sizeof(characteristic_event_t*));
-	c->event_queue = (Queue_t*) malloc(sizeof(Queue_t));
-	q_init(c->event_queue, sizeof(characteristic_event_t*),
-	HOMEKIT_EVENT_QUEUE_SIZE, LIFO, true);
+	c->event_slots = NULL; // allocated once the server is known
+	c->events_head = HOMEKIT_EVENT_SLOT_NONE;
+	c->events_tail = HOMEKIT_EVENT_SLOT_NONE;
+	c->event_tokens = HOMEKIT_EVENT_BURST * 1000;
+	c->event_tokens_time = millis();
+	c->event_backoff = 0;
+	c->event_backoff_until = 0;
 
 	c->verify_context = NULL;
 
@@ -201,11 +306,9 @@ void client_context_free(client_context_t *c) {
 	if (c->verify_context)
 		pair_verify_context_free(c->verify_context);
 
-	if (c->event_queue) {
-		//c->event_queue->clear();
-		q_clean(c->event_queue);
-		q_kill(c->event_queue);
-		free(c->event_queue);
+	if (c->event_slots) {
+		client_events_clear(c);
+		free(c->event_slots);
 	}
 
 	if (c->endpoint_params)
@@ -224,10 +327,13 @@ void client_context_free(client_context_t *c) {
 }
 
 pairing_context_t *saved_preinit_pairing_context = nullptr;
+pairing_context_t *pending_preinit_pairing_context = nullptr; // SRP setup not done yet
+bool preinit_state_saved = false; // SRP salt and verifier of the fixed setup code are stored
 
 pairing_context_t* pairing_context_new() {
 	pairing_context_t *context = (pairing_context_t*) malloc(sizeof(pairing_context_t));
 	context->srp = crypto_srp_new();
+	context->srp_setup = NULL;
 	context->client = NULL;
 	context->public_key = NULL;
 	context->public_key_size = 0;
@@ -241,6 +347,12 @@ void pairing_context_free(pairing_context_t *context) {
 			saved_preinit_pairing_context = nullptr;
 		}
 	}
+	if (context == pending_preinit_pairing_context) {
+		pending_preinit_pairing_context = nullptr;
+	}
+	if (context->srp_setup) {
+		crypto_srp_setup_free(context->srp_setup);
+	}
 	if (context->srp) {
 		crypto_srp_free(context->srp);
 	}
@@ -257,13 +369,27 @@ void pairing_context_free(pairing_context_t *context) {
 void client_notify_characteristic(homekit_characteristic_t *ch, homekit_value_t value,
 		void *client);
 
+typedef struct {
+	const homekit_characteristic_t *ch;
+	size_t offset;
+} characteristic_data_source_t;
+
+size_t characteristic_data_read(uint8_t *buffer, size_t size, void *context) {
+	characteristic_data_source_t *source = (characteristic_data_source_t*) context;
+	size_t read = source->ch->data_reader(source->ch, source->offset, buffer, size);
+	source->offset += read;
+	return read;
+}
+
 void write_characteristic_json(json_stream *json, client_context_t *client,
 		const homekit_characteristic_t *ch, characteristic_format_t format,
 		const homekit_value_t *value) {
-	json_string(json, "aid");
-	json_uint32(json, ch->service->accessory->id);
-	json_string(json, "iid");
-	json_uint32(json, ch->id);
+	if (!(format & characteristic_format_static)) {
+		json_string(json, "aid");
+		json_uint32(json, ch->service->accessory->id);
+		json_string(json, "iid");
+		json_uint32(json, ch->id);
+	}
 
 	if (format & characteristic_format_type) {
 		json_string(json, "type");
@@ -417,7 +543,18 @@ void write_characteristic_json(json_stream *json, client_context_t *client,
 		}
 	}
 
-	if (ch->permissions & homekit_permissions_paired_read) {
+	if (format & characteristic_format_static) {
+		return;
+	}
+
+	if ((ch->permissions & homekit_permissions_paired_read) && !value && ch->data_reader) {
+		// reading may move the reader on (Eve history), so /accessories leaves it out
+		if (format & characteristic_format_data) {
+			json_string(json, "value");
+			characteristic_data_source_t source = { ch, 0 };
+			json_base64(json, characteristic_data_read, &source);
+		}
+	} else if (ch->permissions & homekit_permissions_paired_read) {
 		homekit_value_t v = value ? *value : ch->getter_ex ? ch->getter_ex(ch) : ch->value;
 
 		if (v.is_null) {
@@ -519,14 +656,16 @@ void write_characteristic_json(json_stream *json, client_context_t *client,
 	}
 }
 
-void write(client_context_t *context, byte *data, int data_size) {
+// false when the client could not be written, it is then marked for
+// disconnect and closed by the server loop once its handlers returned
+bool write(client_context_t *context, byte *data, int data_size) {
 	if ((!context) || (!context->socket) || (!context->socket->connected())) {
 		CLIENT_ERROR(context, "The socket is null! (or is closed)");
-		return;
+		return false;
 	}
 	if (context->error_write) {
 		CLIENT_ERROR(context, "Abort write data since error_write.");
-		return;
+		return false;
 	}
 	int write_size = context->socket->write(data, data_size);
 	CLIENT_DEBUG(context, "Sending data of size %d", data_size);
@@ -539,150 +678,363 @@ void write(client_context_t *context, byte *data, int data_size) {
 		// But We has limited the data_size to 538, and TCP_SND_BUF = 1072. (See the comments on HOMEKIT_JSONBUFFER_SIZE)
 		// So we believe here is disconnected.
 		context->disconnect = true;
-		homekit_server_close_client(context->server, context);
 		// We consider the socket is 'closed' when error in writing (eg. the remote client is disconnected, NO tcp ack receive).
 		// Closing the socket causes memory-leak if some data has not been sent (the write_buffer did not free)
 		// To fix this memory-leak, add tcp_abandon(_pcb, 0); in ClientContext.h of ESP8266WiFi-library.
+		return false;
 	}
-
+	return true;
 }
 
-int client_send_encrypted_(client_context_t *context,
-		byte *payload, size_t size) {
-	CLIENT_DEBUG(context, "Send encrypted of size %d", size);
-	// max(size) = HOMEKIT_JSONBUFFER_SIZE + chunk_info(8) = 512 + 8 = 520
-	if (!context || !context->encrypted)
-		return -1;
+/*
+ HAP doc:
+ Each HTTP message is split into frames no larger than 1024 bytes.
+ Each frame has the following format:
+ <2:AAD for little endian length of encrypted data (n) in bytes>
+ <n:encrypted data according to AEAD algorithm, up to 1024 bytes>
+ <16:authTag according to AEAD algorithm>
+ Note by Wang Bin. 2020-03-07
+
+ Frames are laid out in the server transmit buffer and encrypted in place,
+ all frames in the buffer go out in one socket write.
+ */
+
+// Encrypts the open frame in place behind its length
+bool client_tx_seal(client_context_t *context) {
+	homekit_server_t *server = context->server;
+	if (server->tx_size == server->tx_frame) {
+		// no open frame
+		return true;
+	}
+	size_t frame_size = server->tx_size - server->tx_frame - HOMEKIT_FRAME_AAD_SIZE;
+	if (!frame_size) {
+		server->tx_size = server->tx_frame;
+		return true;
+	}
 
-	/*
-	 HAP doc:
-	 Each HTTP message is split into frames no larger than 1024 bytes.
-	 Each frame has the following format:
-	 <2:AAD for little endian length of encrypted data (n) in bytes>
-	 <n:encrypted data according to AEAD algorithm, up to 1024 bytes>
-	 <16:authTag according to AEAD algorithm>
-	 Note by Wang Bin. 2020-03-07
-	 */
+	byte *frame = server->tx_buffer + server->tx_frame;
+	frame[0] = frame_size % 256;
+	frame[1] = frame_size / 256;
 
 	byte nonce[12];
 	memset(nonce, 0, sizeof(nonce));
+	byte i = 4;
+	int x = context->count_reads++;
+	while (x) {
+		nonce[i++] = x % 256;
+		x /= 256;
+	}
 
-	byte encrypted[1024 + 18];
-	int payload_offset = 0;
+	size_t available = frame_size + HOMEKIT_FRAME_TAG_SIZE;
+	int r = crypto_chacha20poly1305_encrypt(context->read_key, nonce, frame, HOMEKIT_FRAME_AAD_SIZE,
+			frame + HOMEKIT_FRAME_AAD_SIZE, frame_size, frame + HOMEKIT_FRAME_AAD_SIZE, &available);
+	if (r) {
+		CLIENT_ERROR(context, "Failed to chacha encrypt payload (code %d)", r);
+		server->tx_size = server->tx_frame = 0;
+		return false;
+	}
 
-	while (payload_offset < size) {
-		size_t chunk_size = size - payload_offset;
-		if (chunk_size > 1024)
-			chunk_size = 1024;
+	server->tx_size += HOMEKIT_FRAME_TAG_SIZE;
+	server->tx_frame = server->tx_size;
+	return true;
+}
 
-		byte aead[2] = { chunk_size % 256, chunk_size / 256 };
+// Writes all sealed frames, a failure marks the client for disconnect
+bool client_tx_write(client_context_t *context) {
+	homekit_server_t *server = context->server;
+	size_t size = server->tx_size;
+	server->tx_size = server->tx_frame = 0;
+	if (!size) {
+		return true;
+	}
+	return write(context, server->tx_buffer, size);
+}
 
-		memcpy(encrypted, aead, 2);
+// One buffer for all clients. Frames left by another client are sealed with
+// its own keys and sent to it before the buffer changes hands, a frame ends
+// anywhere in a message so the rest simply follows in the next one.
+// When they cannot be sent that client is disconnected.
+void client_tx_claim(client_context_t *context) {
+	homekit_server_t *server = context->server;
+	if (server->tx_client == context) {
+		return;
+	}
 
-		byte i = 4;
-		int x = context->count_reads++;
-		while (x) {
-			nonce[i++] = x % 256;
-			x /= 256;
-		}
+	client_context_t *owner = server->tx_client;
+	if (owner && server->tx_size && !(client_tx_seal(owner) && client_tx_write(owner))) {
+		CLIENT_ERROR(owner, "Failed to send frames before handing the transmit buffer over");
+		owner->disconnect = true;
+	}
+	server->tx_client = context;
+}
 
-		size_t available = sizeof(encrypted) - 2;
-		int r = crypto_chacha20poly1305_encrypt(context->read_key, nonce, aead, 2,
-				payload + payload_offset, chunk_size, encrypted + 2, &available);
-		if (r) {
-			ERROR("Failed to chacha encrypt payload (code %d)", r);
-			return -1;
+// Plain text of an encrypted session, frames are sealed and written as they fill
+bool client_tx_append(client_context_t *context, const byte *data, size_t size) {
+	homekit_server_t *server = context->server;
+	client_tx_claim(context);
+	while (size) {
+		if (server->tx_size == server->tx_frame) {
+			if (server->tx_size + HOMEKIT_FRAME_AAD_SIZE + 1 + HOMEKIT_FRAME_TAG_SIZE
+					> HOMEKIT_TX_BUFFER_SIZE) {
+				if (!client_tx_write(context)) {
+					return false;
+				}
+			}
+			server->tx_size += HOMEKIT_FRAME_AAD_SIZE; // length is filled in when sealed
 		}
 
-		payload_offset += chunk_size;
+		size_t space = HOMEKIT_FRAME_SIZE
+				- (server->tx_size - server->tx_frame - HOMEKIT_FRAME_AAD_SIZE);
+		size_t buffer_space = HOMEKIT_TX_BUFFER_SIZE - HOMEKIT_FRAME_TAG_SIZE - server->tx_size;
+		if (space > buffer_space) {
+			space = buffer_space;
+		}
+		if (!space) {
+			if (!client_tx_seal(context)) {
+				return false;
+			}
+			continue;
+		}
 
-		write(context, encrypted, available + 2);
+		if (space > size) {
+			space = size;
+		}
+		memcpy(server->tx_buffer + server->tx_size, data, space);
+		server->tx_size += space;
+		data += space;
+		size -= space;
 	}
+	return true;
+}
 
-	return 0;
+bool client_tx_flush(client_context_t *context) {
+	client_tx_claim(context);
+	return client_tx_seal(context) && client_tx_write(context);
 }
 
-int client_decrypt_(client_context_t *context,
-		byte *payload, size_t payload_size, byte *decrypted, size_t *decrypted_size) {
+// Decrypts one frame in place, the plain text is left behind the length.
+// Returns the plain text size, which is 0 for an empty frame, -2 while the
+// frame is incomplete, -1 on error
+int client_decrypt_frame_(client_context_t *context, byte *frame, size_t size) {
 	if (!context || !context->encrypted)
 		return -1;
 
-	const size_t block_size = 1024 + 16 + 2;
-	size_t required_decrypted_size = payload_size / block_size * 1024;
-	if (payload_size % block_size > 0)
-		required_decrypted_size += payload_size % block_size - 16 - 2;
+	if (size < HOMEKIT_FRAME_AAD_SIZE)
+		return -2;
 
-	if (*decrypted_size < required_decrypted_size) {
-		*decrypted_size = required_decrypted_size;
+	size_t frame_size = frame[0] + frame[1] * 256;
+	if (frame_size > HOMEKIT_FRAME_SIZE) {
+		CLIENT_ERROR(context, "Frame too large, size=%d", frame_size);
+		return -1;
+	}
+	if (frame_size + HOMEKIT_FRAME_AAD_SIZE + HOMEKIT_FRAME_TAG_SIZE > size) {
+		// Unfinished frame
 		return -2;
 	}
 
-	*decrypted_size = required_decrypted_size;
-
 	byte nonce[12];
 	memset(nonce, 0, sizeof(nonce));
+	byte i = 4;
+	int x = context->count_writes++;
+	while (x) {
+		nonce[i++] = x % 256;
+		x /= 256;
+	}
 
-	int payload_offset = 0;
-	int decrypted_offset = 0;
+	size_t decrypted_len = frame_size;
+	int r = crypto_chacha20poly1305_decrypt(context->write_key, nonce, frame, HOMEKIT_FRAME_AAD_SIZE,
+			frame + HOMEKIT_FRAME_AAD_SIZE, frame_size + HOMEKIT_FRAME_TAG_SIZE,
+			frame + HOMEKIT_FRAME_AAD_SIZE, &decrypted_len);
+	if (r) {
+		ERROR("Failed to chacha decrypt payload (code %d)", r);
+		return -1;
+	}
 
-	while (payload_offset < payload_size) {
-		size_t chunk_size = payload[payload_offset] + payload[payload_offset + 1] * 256;
-		if (chunk_size + 18 > payload_size - payload_offset) {
-			// Unfinished chunk
-			break;
-		}
+	return decrypted_len;
+}
 
-		byte i = 4;
-		int x = context->count_writes++;
-		while (x) {
-			nonce[i++] = x % 256;
-			x /= 256;
-		}
+bool client_wants_notification(client_context_t *client, homekit_characteristic_t *ch,
+		homekit_value_t *value) {
+	if (client->current_characteristic == ch && client->current_value
+			&& homekit_value_equal(client->current_value, value)) {
+		// This value is set by this client, no need to send notification
+		CLIENT_DEBUG(client, "This value is set by this client, no need to send notification");
+		return false;
+	}
+	return true;
+}
 
-		size_t decrypted_len = *decrypted_size - decrypted_offset;
-		int r = crypto_chacha20poly1305_decrypt(context->write_key, nonce, payload + payload_offset,
-				2, payload + payload_offset + 2, chunk_size + 16, decrypted, &decrypted_len);
-		if (r) {
-			ERROR("Failed to chacha decrypt payload (code %d)", r);
-			return -1;
-		}
+void client_event_slots_init(client_context_t *client) {
+	homekit_server_t *server = client->server;
+	if (!server->event_slots_count) {
+		return;
+	}
+	client->event_slots = (client_event_slot_t*) calloc(server->event_slots_count,
+			sizeof(client_event_slot_t));
+	if (!client->event_slots) {
+		CLIENT_ERROR(client, "Error malloc event slots, count=%d", server->event_slots_count);
+	}
+}
 
-		decrypted_offset += decrypted_len;
-		payload_offset += chunk_size + 18;
+// Keeps only the latest value per characteristic, a change already pending
+// is overwritten in place and keeps its position in the dirty list
+void client_event_set(client_context_t *client, homekit_characteristic_t *ch,
+		homekit_value_t *value) {
+	if (!client->event_slots || ch->event_slot == HOMEKIT_EVENT_SLOT_NONE) {
+		ERROR("Client has no event slot for %d.%d. Skipping notification",
+				ch->service->accessory->id, ch->id);
+		return;
 	}
 
-	return payload_offset;
+	const uint8_t index = ch->event_slot;
+	client_event_slot_t *slot = &client->event_slots[index];
+	if (slot->dirty) {
+		homekit_value_destruct(&slot->value);
+	} else {
+		slot->dirty = true;
+		slot->next = HOMEKIT_EVENT_SLOT_NONE;
+		if (client->events_tail == HOMEKIT_EVENT_SLOT_NONE) {
+			client->events_head = index;
+		} else {
+			client->event_slots[client->events_tail].next = index;
+		}
+		client->events_tail = index;
+	}
+	homekit_value_copy(&slot->value, value);
+}
+
+void client_events_clear(client_context_t *client) {
+	uint8_t index = client->events_head;
+	while (index != HOMEKIT_EVENT_SLOT_NONE) {
+		client_event_slot_t *slot = &client->event_slots[index];
+		homekit_value_destruct(&slot->value);
+		slot->dirty = false;
+		index = slot->next;
+	}
+	client->events_head = HOMEKIT_EVENT_SLOT_NONE;
+	client->events_tail = HOMEKIT_EVENT_SLOT_NONE;
 }
 
 void client_notify_characteristic(homekit_characteristic_t *ch, homekit_value_t value,
 		void *context) {
 	client_context_t *client = (client_context_t*) context;
 
-	if (client->current_characteristic == ch && client->current_value
-			&& homekit_value_equal(client->current_value, &value)) {
-		// This value is set by this client, no need to send notification
-		CLIENT_DEBUG(client, "This value is set by this client, no need to send notification");
+	if (!client_wants_notification(client, ch, &value)) {
 		return;
 	}
 	CLIENT_INFO(client, "Got characteristic %d.%d change event",
 			ch->service->accessory->id, ch->id);
 	//DEBUG("Got characteristic %d.%d change event", ch->service->accessory->id, ch->id);
 
-	if (!client->event_queue) {
-		ERROR("Client has no event queue. Skipping notification");
+	client_event_set(client, ch, &value);
+}
+
+void client_notify_characteristics(client_context_t *client,
+		const homekit_characteristic_change_t *changes, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		homekit_characteristic_t *ch = changes[i].characteristic;
+		homekit_value_t value = changes[i].value;
+		if (homekit_characteristic_has_notify_callback(ch, client_notify_characteristic, client)
+				&& client_wants_notification(client, ch, &value)) {
+			client_event_set(client, ch, &value);
+		}
+	}
+}
+
+void homekit_characteristics_notify(const homekit_characteristic_change_t *changes, size_t count) {
+	// other listeners still get one call per characteristic
+	for (size_t i = 0; i < count; i++) {
+		homekit_characteristic_t *ch = changes[i].characteristic;
+		homekit_characteristic_change_callback_t *callback = ch->callback;
+		while (callback) {
+			if (callback->function != client_notify_characteristic) {
+				callback->function(ch, changes[i].value, callback->context);
+			}
+			callback = callback->next;
+		}
+	}
+
+	if (!running_server) {
 		return;
 	}
 
-	characteristic_event_t *event = (characteristic_event_t*) malloc(
-			sizeof(characteristic_event_t));
-	event->characteristic = ch;
-	homekit_value_copy(&event->value, &value);
+	client_context_t *context = running_server->clients;
+	while (context) {
+		client_notify_characteristics(context, changes, count);
+		context = context->next;
+	}
+}
 
-	DEBUG("Sending event to client %d", client->socket);
+bool characteristic_fragment_value_equal(homekit_value_t *a, homekit_value_t *b) {
+	if (a->format == homekit_format_uint64 && b->format == homekit_format_uint64
+			&& !a->is_null && !b->is_null) {
+		return a->uint64_value == b->uint64_value;
+	}
+	return homekit_value_equal(a, b);
+}
 
-	//xQueueSendToBack(client->event_queue, &event, 10);*/
-	//q_push第二个参数要传指针地址
-	q_push(client->event_queue, &event);
+void characteristic_fragment_append(byte *data, size_t size, void *arg) {
+	characteristic_fragment_t *fragment = (characteristic_fragment_t*) arg;
+	if (fragment->size + size > sizeof(fragment->json)) {
+		fragment->size = sizeof(fragment->json) + 1; // dropped below
+		return;
+	}
+	memcpy(fragment->json + fragment->size, data, size);
+	fragment->size += size;
+}
+
+// Ids and value of a notifying characteristic are rendered once per change
+// and reused for every client, NULL when the value has to be written live
+characteristic_fragment_t *characteristic_fragment(homekit_server_t *server,
+		homekit_characteristic_t *ch, homekit_value_t *value) {
+	if (!server->event_fragments || ch->event_slot == HOMEKIT_EVENT_SLOT_NONE) {
+		return NULL;
+	}
+	switch (value->format) {
+	case homekit_format_bool:
+	case homekit_format_uint8:
+	case homekit_format_uint16:
+	case homekit_format_uint32:
+	case homekit_format_uint64:
+	case homekit_format_int:
+	case homekit_format_float:
+		break;
+	default:
+		return NULL;
+	}
+
+	characteristic_fragment_t *fragment = &server->event_fragments[ch->event_slot];
+	if (fragment->size && characteristic_fragment_value_equal(&fragment->value, value)) {
+		return fragment;
+	}
+
+	fragment->size = 0;
+	fragment->value = *value;
+	json_stream *json = json_new(sizeof(fragment->json), characteristic_fragment_append, fragment);
+	json_object_start(json);
+	write_characteristic_json(json, NULL, ch, (characteristic_format_t) 0, value);
+	json_flush(json);
+	json_free(json);
+
+	if (fragment->size > sizeof(fragment->json)) {
+		fragment->size = 0;
+	}
+	return fragment->size ? fragment : NULL;
+}
+
+void json_characteristic_fragment(json_stream *json, characteristic_fragment_t *fragment) {
+	json_object_start_raw(json, (const uint8_t*) fragment->json + 1, fragment->size - 1);
+}
+
+void write_characteristic_value_json(json_stream *json, client_context_t *client,
+		homekit_characteristic_t *ch, homekit_value_t *value) {
+	characteristic_fragment_t *fragment = characteristic_fragment(client->server, ch, value);
+	if (fragment) {
+		json_characteristic_fragment(json, fragment);
+	} else {
+		json_object_start(json);
+		write_characteristic_json(json, client, ch, (characteristic_format_t) 0, value);
+	}
 }
 
 void client_send(client_context_t *context, byte *data, size_t data_size) {
@@ -691,10 +1043,8 @@ void client_send(client_context_t *context, byte *data, size_t data_size) {
 			data_size, context->encrypted ? "true" : "false");
 
 	if (context->encrypted) {
-		int r = client_send_encrypted_(context, data, data_size);
-		if (r) {
-			CLIENT_ERROR(context, "Failed to encrypt response (code %d)", r);
-			return;
+		if (client_tx_append(context, data, data_size)) {
+			client_tx_flush(context);
 		}
 	} else {
 		write(context, data, data_size);
@@ -709,20 +1059,41 @@ void client_send_P(client_context_t *context, PGM_P pgm) {
 void client_send_chunk(byte *data, size_t size, void *arg) {
 	client_context_t *context = (client_context_t*) arg;
 
-	size_t payload_size = size + 8;
-	byte *payload = (byte*) malloc(payload_size);
-	if (!payload) {
-		ERROR("Error malloc payload!! payload_size->%d", payload_size);
+	char header[12];
+	int offset = snprintf(header, sizeof(header), "%x\r\n", size);
+	CLIENT_DEBUG(context, "client_send_chunk, size=%d, offset=%d", size, offset);
+
+	if (!context->encrypted) {
+		if (write(context, (byte*) header, offset) && (!size || write(context, data, size))) {
+			write(context, (byte*) "\r\n", 2);
+		}
 		return;
 	}
 
-	int offset = snprintf((char*) payload, payload_size, "%x\r\n", size);
-	memcpy(payload + offset, data, size);
-	payload[offset + size] = '\r';
-	payload[offset + size + 1] = '\n';
-	CLIENT_DEBUG(context, "client_send_chunk, size=%d, offset=%d", size, offset);
-	client_send(context, payload, offset + size + 2);
-	free(payload);
+	// Chunks share frames until the last chunk ends the response
+	if (client_tx_append(context, (byte*) header, offset)
+			&& client_tx_append(context, data, size)
+			&& client_tx_append(context, (const byte*) "\r\n", 2)
+			&& !size) {
+		client_tx_flush(context);
+	}
+}
+
+typedef struct {
+	client_context_t *context;
+	size_t size;
+	bool send;
+	bool failed;
+} client_event_writer_t;
+
+// json flush callback of EVENT bodies, counts the length or sends
+void client_event_write(byte *data, size_t size, void *arg) {
+	client_event_writer_t *writer = (client_event_writer_t*) arg;
+	if (!writer->send) {
+		writer->size += size;
+	} else if (!writer->failed) {
+		writer->failed = !client_tx_append(writer->context, data, size);
+	}
 }
 
 void send_204_response(client_context_t *context) {
@@ -735,38 +1106,55 @@ void send_404_response(client_context_t *context) {
 	client_send_P(context, response);
 }
 
-void send_client_events(client_context_t *context, client_event_t *events) {
-	CLIENT_DEBUG(context, "Sending EVENT");DEBUG_HEAP();
-
-	static const char PROGMEM http_headers[] = "EVENT/1.0 200 OK\r\n"
-			"Content-Type: application/hap+json\r\n"
-			"Transfer-Encoding: chunked\r\n\r\n";
-	client_send_P(context, http_headers);
-
-	// ~35 bytes per event JSON
-	// 256 should be enough for ~7 characteristic updates
-	json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, client_send_chunk, context);
+void write_client_events_json(json_stream *json, client_context_t *context) {
 	json_object_start(json);
 	json_string(json, "characteristics");
 	json_array_start(json);
 
-	client_event_t *e = events;
-	while (e) {
-		json_object_start(json);
-		write_characteristic_json(json, context, e->characteristic, (characteristic_format_t) 0,
-				&e->value);
+	uint8_t index = context->events_head;
+	while (index != HOMEKIT_EVENT_SLOT_NONE) {
+		client_event_slot_t *slot = &context->event_slots[index];
+		write_characteristic_value_json(json, context,
+				context->server->event_characteristics[index], &slot->value);
 		json_object_end(json);
 
-		e = e->next;
+		index = slot->next;
 	}
 
 	json_array_end(json);
 	json_object_end(json);
-
 	json_flush(json);
+}
+
+void send_client_events(client_context_t *context) {
+	CLIENT_DEBUG(context, "Sending EVENT");DEBUG_HEAP();
+
+	static const char PROGMEM http_headers_pgm[] = "EVENT/1.0 200 OK\r\n"
+			"Content-Type: application/hap+json\r\n"
+			"Content-Length: %d\r\n\r\n";
+
+	// The body is rendered twice from the slots, first for Content-Length and
+	// then straight into the transmit frames behind the headers
+	client_event_writer_t writer = { context, 0, false, false };
+	json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, client_event_write, &writer);
+	write_client_events_json(json, context);
+
+	XPGM_BUFFCPY_STRING(char, http_headers, http_headers_pgm);
+
+	char headers[sizeof(http_headers) + 8];
+	int headers_len = snprintf(headers, sizeof(headers), http_headers, writer.size);
+
+	if (client_tx_append(context, (byte*) headers, headers_len)) {
+		writer.send = true;
+		json_reset(json);
+		write_client_events_json(json, context);
+		if (!writer.failed) {
+			client_tx_flush(context);
+		}
+	}
 	json_free(json);
 
-	client_send_chunk(NULL, 0, context);
+	client_events_clear(context);
 }
 
 void send_tlv_response(client_context_t *context, tlv_values_t *values);
@@ -955,6 +1343,13 @@ void homekit_server_on_identify(client_context_t *context) {
 	}
 }
 
+int accessory_sign(homekit_server_t *server, const byte *message, size_t message_size,
+		byte *signature, size_t *signature_size) {
+	return crypto_ed25519_sign_expanded(&server->accessory_key,
+			server->accessory_key_expanded_valid ? server->accessory_key_expanded : NULL,
+			message, message_size, signature, signature_size);
+}
+
 void homekit_server_on_pair_setup(client_context_t *context, const byte *data, size_t size) {
 	DEBUG("Pair Setup");DEBUG_HEAP();
 	DEBUG_TIME_BEGIN();
@@ -1253,6 +1648,8 @@ void homekit_server_on_pair_setup(client_context_t *context, const byte *data, s
 		free(device_id);
 
 		tlv_free(decrypted_message);
+		homekit_storage_forget_srp_state();
+		preinit_state_saved = false;
 
 		HOMEKIT_NOTIFY_EVENT(context->server, HOMEKIT_EVENT_PAIRING_ADDED);
 
@@ -1300,12 +1697,12 @@ void homekit_server_on_pair_setup(client_context_t *context, const byte *data, s
 
 		CLIENT_DEBUG(context, "Generating accessory signature");DEBUG_HEAP();
 		size_t accessory_signature_size = 0;
-		crypto_ed25519_sign(&context->server->accessory_key, accessory_info, accessory_info_size,
-		NULL, &accessory_signature_size);
+		accessory_sign(context->server, accessory_info, accessory_info_size, NULL,
+				&accessory_signature_size);
 
 		byte *accessory_signature = (byte*) malloc(accessory_signature_size);
-		r = crypto_ed25519_sign(&context->server->accessory_key, accessory_info,
-				accessory_info_size, accessory_signature, &accessory_signature_size);
+		r = accessory_sign(context->server, accessory_info, accessory_info_size,
+				accessory_signature, &accessory_signature_size);
 
 		if (r) {
 			CLIENT_ERROR(context, "Failed to generate accessory signature (code %d)", r);
@@ -1402,6 +1799,180 @@ void homekit_server_on_pair_setup(client_context_t *context, const byte *data, s
 #endif
 }
 
+#ifdef HOMEKIT_PAIR_RESUME
+resume_session_t *resume_session_find(homekit_server_t *server, const byte *id) {
+	for (int i = 0; i < HOMEKIT_RESUME_SESSIONS; i++) {
+		resume_session_t *session = &server->resume_sessions[i];
+		if (session->last_used && !memcmp(session->id, id, sizeof(session->id))) {
+			return session;
+		}
+	}
+	return NULL;
+}
+
+void resume_session_store(homekit_server_t *server, const byte *id, const byte *secret,
+		int pairing_id, byte permissions) {
+	resume_session_t *session = resume_session_find(server, id);
+	if (!session) {
+		session = &server->resume_sessions[0];
+		for (int i = 1; i < HOMEKIT_RESUME_SESSIONS; i++) {
+			if (server->resume_sessions[i].last_used < session->last_used) {
+				session = &server->resume_sessions[i];
+			}
+		}
+	}
+	memcpy(session->id, id, sizeof(session->id));
+	memcpy(session->secret, secret, sizeof(session->secret));
+	session->pairing_id = pairing_id;
+	session->permissions = permissions;
+	session->last_used = ++server->resume_clock;
+}
+
+// Sessions of a removed or changed pairing must not be resumed
+void resume_sessions_forget(homekit_server_t *server, int pairing_id) {
+	for (int i = 0; i < HOMEKIT_RESUME_SESSIONS; i++) {
+		resume_session_t *session = &server->resume_sessions[i];
+		if (session->pairing_id == pairing_id) {
+			memset(session, 0, sizeof(*session));
+		}
+	}
+}
+#endif
+
+int client_derive_session_keys(client_context_t *context, const byte *secret, size_t secret_size) {
+	const byte salt[] = "Control-Salt";
+	size_t read_key_size = sizeof(context->read_key);
+	const byte read_info[] = "Control-Read-Encryption-Key";
+	int r = crypto_hkdf(secret, secret_size, salt, sizeof(salt) - 1, read_info,
+			sizeof(read_info) - 1, context->read_key, &read_key_size);
+	if (r) {
+		CLIENT_ERROR(context, "Failed to derive read encryption key (code %d)", r);
+		return r;
+	}
+
+	size_t write_key_size = sizeof(context->write_key);
+	const byte write_info[] = "Control-Write-Encryption-Key";
+	r = crypto_hkdf(secret, secret_size, salt, sizeof(salt) - 1, write_info,
+			sizeof(write_info) - 1, context->write_key, &write_key_size);
+	if (r) {
+		CLIENT_ERROR(context, "Failed to derive write encryption key (code %d)", r);
+	}
+	return r;
+}
+
+#ifdef HOMEKIT_PAIR_RESUME
+// Every verified session can be resumed later under an id derived from its secret
+void client_store_resume_session(client_context_t *context, const byte *secret,
+		size_t secret_size) {
+	if (secret_size != HOMEKIT_RESUME_SECRET_SIZE) {
+		return;
+	}
+	const byte salt[] = "Pair-Verify-ResumeSessionID-Salt";
+	const byte info[] = "Pair-Verify-ResumeSessionID-Info";
+	byte id[HKDF_HASH_SIZE];
+	size_t id_size = sizeof(id);
+	if (!crypto_hkdf(secret, secret_size, salt, sizeof(salt) - 1, info, sizeof(info) - 1, id,
+			&id_size)) {
+		resume_session_store(context->server, id, secret, context->pairing_id,
+				context->permissions);
+	}
+}
+
+int resume_derive(const resume_session_t *session, const byte *salt, size_t salt_size,
+		const char *info, byte *output) {
+	size_t output_size = HKDF_HASH_SIZE;
+	return crypto_hkdf(session->secret, sizeof(session->secret), salt, salt_size,
+			(const byte*) info, strlen(info), output, &output_size);
+}
+
+// Pair Resume M1 carries a new device Curve25519 key, the session id and the auth
+// tag of an empty message. Returns false when the session can not be resumed,
+// the same M1 then runs full pair verify. A bad tag leaves the session cached,
+// so a forged request can not evict the controller's real one.
+bool homekit_server_on_pair_resume(client_context_t *context, tlv_values_t *message) {
+	tlv_t *tlv_device_public_key = tlv_get_value(message, TLVType_PublicKey);
+	tlv_t *tlv_session_id = tlv_get_value(message, TLVType_SessionID);
+	tlv_t *tlv_encrypted_data = tlv_get_value(message, TLVType_EncryptedData);
+	if (!tlv_device_public_key || tlv_device_public_key->size != 32 || !tlv_session_id
+			|| tlv_session_id->size != HOMEKIT_RESUME_SESSION_ID_SIZE || !tlv_encrypted_data
+			|| tlv_encrypted_data->size != HOMEKIT_FRAME_TAG_SIZE) {
+		CLIENT_ERROR(context, "Invalid pair resume request");
+		return false;
+	}
+
+	resume_session_t *session = resume_session_find(context->server, tlv_session_id->value);
+	if (!session) {
+		CLIENT_INFO(context, "Unknown resume session, doing full verify");
+		return false;
+	}
+
+	byte salt[32 + HOMEKIT_RESUME_SESSION_ID_SIZE];
+	memcpy(salt, tlv_device_public_key->value, 32);
+	memcpy(salt + 32, tlv_session_id->value, HOMEKIT_RESUME_SESSION_ID_SIZE);
+
+	byte key[HKDF_HASH_SIZE];
+	byte tag[HOMEKIT_FRAME_TAG_SIZE];
+	if (resume_derive(session, salt, sizeof(salt), "Pair-Resume-Request-Info", key)
+			|| crypto_chacha20poly1305_empty_tag(key, (const byte*) "\0\0\0\0PR-Msg01", tag)
+			|| memcmp(tag, tlv_encrypted_data->value, sizeof(tag))) {
+		CLIENT_ERROR(context, "Failed to verify resume request, doing full verify");
+		return false;
+	}
+
+	// the resumed session goes on under a new id and secret
+	byte session_id[HOMEKIT_RESUME_SESSION_ID_SIZE];
+	homekit_random_fill(session_id, sizeof(session_id));
+	memcpy(salt + 32, session_id, sizeof(session_id));
+
+	byte secret[HKDF_HASH_SIZE];
+	if (resume_derive(session, salt, sizeof(salt), "Pair-Resume-Response-Info", key)
+			|| crypto_chacha20poly1305_empty_tag(key, (const byte*) "\0\0\0\0PR-Msg02", tag)
+			|| resume_derive(session, salt, sizeof(salt), "Pair-Resume-Shared-Secret-Info", secret)
+			|| client_derive_session_keys(context, secret, sizeof(secret))) {
+		CLIENT_ERROR(context, "Failed to derive resumed session keys, doing full verify");
+		return false;
+	}
+
+	const int pairing_id = session->pairing_id;
+	const byte permissions = session->permissions;
+	memcpy(session->id, session_id, sizeof(session->id));
+	memcpy(session->secret, secret, sizeof(session->secret));
+	session->last_used = ++context->server->resume_clock;
+
+	tlv_values_t *response = tlv_new();
+	tlv_add_integer_value(response, TLVType_State, 1, 2);
+	tlv_add_integer_value(response, TLVType_Method, 1, TLVMethod_PairResume);
+	tlv_add_value(response, TLVType_SessionID, session_id, sizeof(session_id));
+	tlv_add_value(response, TLVType_EncryptedData, tag, sizeof(tag));
+	send_tlv_response(context, response);
+
+	if (context->verify_context) {
+		pair_verify_context_free(context->verify_context);
+		context->verify_context = NULL;
+	}
+
+	context->pairing_id = pairing_id;
+	context->permissions = permissions;
+	context->encrypted = true;
+
+	HOMEKIT_NOTIFY_EVENT(context->server, HOMEKIT_EVENT_CLIENT_VERIFIED);
+	CLIENT_INFO(context, "Resume successful, secure session established");
+	context->step = HOMEKIT_CLIENT_STEP_PAIR_VERIFY_2OF2;
+	return true;
+}
+#endif
+
+// Moves a pooled key out, false when the pool is empty
+bool ephemeral_key_take(homekit_server_t *server, curve25519_key *key) {
+	if (!server->ephemeral_keys_count) {
+		return false;
+	}
+	curve25519_key *pooled = &server->ephemeral_keys[--server->ephemeral_keys_count];
+	memcpy(key, pooled, sizeof(*key));
+	memset(pooled, 0, sizeof(*pooled));
+	return true;
+}
+
 void homekit_server_on_pair_verify(client_context_t *context, const byte *data, size_t size) {
 	DEBUG("HomeKit Pair Verify");DEBUG_HEAP();
 	DEBUG_TIME_BEGIN();
@@ -1419,7 +1990,15 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 	int r;
 	switch (tlv_get_integer_value(message, TLVType_State, -1)) {
 	case 1: {
+#ifdef HOMEKIT_PAIR_RESUME
+		if (tlv_get_integer_value(message, TLVType_Method, -1) == TLVMethod_PairResume
+				&& homekit_server_on_pair_resume(context, message)) {
+			break;
+		}
+#endif
+
 		CLIENT_INFO(context, "Pair Verify Step 1/2");
+		const uint32_t start_time = millis();
 		CLIENT_DEBUG(context, "Importing device Curve25519 public key");
 		tlv_t *tlv_device_public_key = tlv_get_value(message, TLVType_PublicKey);
 		if (!tlv_device_public_key) {
@@ -1443,9 +2022,14 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 			send_tlv_error_response(context, 2, TLVError_Unknown);
 			break;
 		}
-		CLIENT_DEBUG(context, "Generating accessory Curve25519 key");
 		curve25519_key my_key;
-		r = crypto_curve25519_generate(&my_key);
+		const bool pooled_key = ephemeral_key_take(context->server, &my_key);
+		if (pooled_key) {
+			r = 0;
+		} else {
+			CLIENT_DEBUG(context, "Generating accessory Curve25519 key");
+			r = crypto_curve25519_generate(&my_key);
+		}
 		if (r) {
 			CLIENT_ERROR(context, "Failed to generate accessory Curve25519 key (code %d)", r);
 			crypto_curve25519_done(&device_key);
@@ -1498,12 +2082,12 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 				tlv_device_public_key->value, tlv_device_public_key->size);
 
 		size_t accessory_signature_size = 0;
-		crypto_ed25519_sign(&context->server->accessory_key, accessory_info, accessory_info_size,
-		NULL, &accessory_signature_size);
+		accessory_sign(context->server, accessory_info, accessory_info_size, NULL,
+				&accessory_signature_size);
 
 		byte *accessory_signature = (byte*) malloc(accessory_signature_size);
-		r = crypto_ed25519_sign(&context->server->accessory_key, accessory_info,
-				accessory_info_size, accessory_signature, &accessory_signature_size);
+		r = accessory_sign(context->server, accessory_info, accessory_info_size,
+				accessory_signature, &accessory_signature_size);
 		free(accessory_info);
 		if (r) {
 			CLIENT_ERROR(context, "Failed to generate signature (code %d)", r);
@@ -1609,6 +2193,8 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 				tlv_device_public_key->size);
 		context->verify_context->device_public_key_size = tlv_device_public_key->size;
 		context->step = HOMEKIT_CLIENT_STEP_PAIR_VERIFY_1OF2;
+		CLIENT_INFO(context, "Pair Verify Step 1/2 took %u ms, %s key",
+				(unsigned) (millis() - start_time), pooled_key ? "pooled" : "new");
 		break;
 	}
 	case 3: {
@@ -1713,8 +2299,14 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 				context->verify_context->accessory_public_key_size);
 
 		CLIENT_DEBUG(context, "Verifying device signature");
-		r = crypto_ed25519_verify(&pairing.device_key, device_info, device_info_size,
-				tlv_device_signature->value, tlv_device_signature->size);
+		if (pairing.device_point) {
+			r = crypto_ed25519_verify_decoded(&pairing.device_key, pairing.device_point,
+					device_info, device_info_size, tlv_device_signature->value,
+					tlv_device_signature->size);
+		} else {
+			r = crypto_ed25519_verify(&pairing.device_key, device_info, device_info_size,
+					tlv_device_signature->value, tlv_device_signature->size);
+		}
 		free(device_info);
 		tlv_free(decrypted_message);
 
@@ -1726,36 +2318,15 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 			break;
 		}
 
-		const byte salt[] = "Control-Salt";
-		size_t read_key_size = sizeof(context->read_key);
-		const byte read_info[] = "Control-Read-Encryption-Key";
-		r = crypto_hkdf(context->verify_context->secret, context->verify_context->secret_size, salt,
-				sizeof(salt) - 1, read_info, sizeof(read_info) - 1, context->read_key,
-				&read_key_size);
+		r = client_derive_session_keys(context, context->verify_context->secret,
+				context->verify_context->secret_size);
 		if (r) {
-			CLIENT_ERROR(context, "Failed to derive read encryption key (code %d)", r);
 			pair_verify_context_free(context->verify_context);
 			context->verify_context = NULL;
 			send_tlv_error_response(context, 4, TLVError_Unknown);
 			break;
 		}
 
-		size_t write_key_size = sizeof(context->write_key);
-		const byte write_info[] = "Control-Write-Encryption-Key";
-
-		r = crypto_hkdf(context->verify_context->secret, context->verify_context->secret_size, salt,
-				sizeof(salt) - 1, write_info, sizeof(write_info) - 1, context->write_key,
-				&write_key_size);
-
-		pair_verify_context_free(context->verify_context);
-		context->verify_context = NULL;
-
-		if (r) {
-			CLIENT_ERROR(context, "Failed to derive write encryption key (code %d)", r);
-			send_tlv_error_response(context, 4, TLVError_Unknown);
-			break;
-		}
-
 		tlv_values_t *response = tlv_new();
 		tlv_add_integer_value(response, TLVType_State, 1, 4);
 		send_tlv_response(context, response);
@@ -1764,6 +2335,13 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 		context->permissions = permissions;
 		context->encrypted = true;
 
+#ifdef HOMEKIT_PAIR_RESUME
+		client_store_resume_session(context, context->verify_context->secret,
+				context->verify_context->secret_size);
+#endif
+		pair_verify_context_free(context->verify_context);
+		context->verify_context = NULL;
+
 		HOMEKIT_NOTIFY_EVENT(context->server, HOMEKIT_EVENT_CLIENT_VERIFIED);
 		CLIENT_INFO(context, "Verification successful, secure session established");
 		context->step = HOMEKIT_CLIENT_STEP_PAIR_VERIFY_2OF2;
@@ -1785,19 +2363,15 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 
 void homekit_client_process(client_context_t *context);
 
-void homekit_server_on_get_accessories(client_context_t *context) {
-	DEBUG_TIME_BEGIN();
-	CLIENT_INFO(context, "Get Accessories");DEBUG_HEAP();
-	client_send_P(context, json_200_response_headers_progmem);
-
-	CLIENT_DEBUG(context, "Get Accessories, start send json body");
-
-	json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, client_send_chunk, context);
+// With cache set characteristics are written static, followed by a splice marker
+// and no client is needed
+void write_accessories_json(json_stream *json, homekit_server_t *server,
+		client_context_t *context, bool cache) {
 	json_object_start(json);
 	json_string(json, "accessories");
 	json_array_start(json);
 
-	for (homekit_accessory_t **accessory_it = context->server->config->accessories;
+	for (homekit_accessory_t **accessory_it = server->config->accessories;
 			*accessory_it; accessory_it++) {
 
 		homekit_accessory_t *accessory = *accessory_it;
@@ -1831,34 +2405,256 @@ void homekit_server_on_get_accessories(client_context_t *context) {
 				json_array_end(json);
 			}
 
-			json_string(json, "characteristics");
-			json_array_start(json);
-
-			for (homekit_characteristic_t **ch_it = service->characteristics; *ch_it; ch_it++) {
-				homekit_characteristic_t *ch = *ch_it;
+			json_string(json, "characteristics");
+			json_array_start(json);
+
+			for (homekit_characteristic_t **ch_it = service->characteristics; *ch_it; ch_it++) {
+				homekit_characteristic_t *ch = *ch_it;
+
+				json_object_start(json);
+				if (cache) {
+					static const uint8_t splice = HOMEKIT_ACCESSORIES_CACHE_SPLICE;
+					write_characteristic_json(json, context, ch,
+							(characteristic_format_t) (characteristic_format_type
+									| characteristic_format_meta | characteristic_format_perms
+									| characteristic_format_static),
+							NULL);
+					json_raw(json, &splice, 1);
+				} else {
+					write_characteristic_json(json, context, ch,
+							(characteristic_format_t) (characteristic_format_type
+									| characteristic_format_meta | characteristic_format_perms
+									| characteristic_format_events),
+							NULL);
+				}
+				json_object_end(json);
+			}
+
+			json_array_end(json);
+			json_object_end(json); // service
+		}
+
+		json_array_end(json);
+		json_object_end(json); // accessory
+	}
+
+	json_array_end(json);
+	json_object_end(json); // response
+}
+
+static uint32_t fnv1a_add(uint32_t hash, const void *data, size_t size) {
+	const uint8_t *p = (const uint8_t*) data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ p[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+static uint32_t fnv1a_add_string(uint32_t hash, const char *s) {
+	return s ? fnv1a_add(hash, s, strlen(s) + 1) : fnv1a_add(hash, "", 1);
+}
+
+// Covers everything the static part is rendered from, firmware changes to the
+// database invalidate the cache even when config number stays the same
+uint32_t accessories_cache_key(homekit_server_config_t *config) {
+	uint32_t hash = fnv1a_add(2166136261UL, &config->config_number, sizeof(config->config_number));
+	for (homekit_accessory_t **accessory_it = config->accessories; *accessory_it; accessory_it++) {
+		homekit_accessory_t *accessory = *accessory_it;
+		hash = fnv1a_add(hash, &accessory->id, sizeof(accessory->id));
+		for (homekit_service_t **service_it = accessory->services; *service_it; service_it++) {
+			homekit_service_t *service = *service_it;
+			hash = fnv1a_add(hash, &service->id, sizeof(service->id));
+			hash = fnv1a_add_string(hash, service->type);
+			const bool flags[2] = { service->hidden, service->primary };
+			hash = fnv1a_add(hash, flags, sizeof(flags));
+			if (service->linked) {
+				for (homekit_service_t **linked = service->linked; *linked; linked++) {
+					hash = fnv1a_add(hash, &(*linked)->id, sizeof((*linked)->id));
+				}
+			}
+			for (homekit_characteristic_t **ch_it = service->characteristics; *ch_it; ch_it++) {
+				homekit_characteristic_t *ch = *ch_it;
+				hash = fnv1a_add(hash, &ch->id, sizeof(ch->id));
+				hash = fnv1a_add_string(hash, ch->type);
+				hash = fnv1a_add_string(hash, ch->description);
+				hash = fnv1a_add(hash, &ch->format, sizeof(ch->format));
+				hash = fnv1a_add(hash, &ch->unit, sizeof(ch->unit));
+				hash = fnv1a_add(hash, &ch->permissions, sizeof(ch->permissions));
+				if (ch->min_value)
+					hash = fnv1a_add(hash, ch->min_value, sizeof(float));
+				if (ch->max_value)
+					hash = fnv1a_add(hash, ch->max_value, sizeof(float));
+				if (ch->min_step)
+					hash = fnv1a_add(hash, ch->min_step, sizeof(float));
+				if (ch->max_len)
+					hash = fnv1a_add(hash, ch->max_len, sizeof(int));
+				if (ch->max_data_len)
+					hash = fnv1a_add(hash, ch->max_data_len, sizeof(int));
+				hash = fnv1a_add(hash, ch->valid_values.values,
+						ch->valid_values.count * sizeof(ch->valid_values.values[0]));
+				hash = fnv1a_add(hash, ch->valid_values_ranges.ranges,
+						ch->valid_values_ranges.count * sizeof(ch->valid_values_ranges.ranges[0]));
+			}
+		}
+	}
+	return hash;
+}
+
+typedef struct {
+	uint32_t magic;
+	uint32_t key;
+} accessories_cache_header_t;
+
+typedef struct {
+	File *file;
+	size_t written;
+	bool failed;
+} accessories_cache_writer_t;
+
+void accessories_cache_write(uint8_t *buffer, size_t size, void *arg) {
+	accessories_cache_writer_t *writer = (accessories_cache_writer_t*) arg;
+	if (writer->failed) {
+		return;
+	}
+	size_t written = writer->file->write(buffer, size);
+	writer->written += written;
+	writer->failed = written != size;
+}
+
+File accessories_cache_open(homekit_server_t *server) {
+	File file = homekit_file_open(HOMEKIT_ACCESSORIES_CACHE_PATH, "r");
+	if (file) {
+		accessories_cache_header_t header;
+		if (file.read((uint8_t*) &header, sizeof(header)) != sizeof(header)
+				|| header.magic != HOMEKIT_ACCESSORIES_CACHE_MAGIC
+				|| header.key != server->accessories_cache_key) {
+			file.close();
+			return File();
+		}
+	}
+	return file;
+}
+
+// Renders the cache at init unless the one in flash still matches the
+// database, so pairing controllers never wait for the flash write
+bool accessories_cache_prepare(homekit_server_t *server) {
+	File file = accessories_cache_open(server);
+	if (file) {
+		file.close();
+		return true;
+	}
+
+	file = homekit_file_open(HOMEKIT_ACCESSORIES_CACHE_PATH, "w");
+	if (!file) {
+		ERROR("Failed to create accessories cache");
+		return false;
+	}
+
+	// header goes last, a partial file never validates
+	accessories_cache_header_t header = { 0, server->accessories_cache_key };
+	accessories_cache_writer_t writer = { &file, 0, false };
+	accessories_cache_write((uint8_t*) &header, sizeof(header), &writer);
+
+	json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, accessories_cache_write, &writer);
+	write_accessories_json(json, server, NULL, true);
+	json_flush(json);
+	json_free(json);
+
+	if (!writer.failed) {
+		header.magic = HOMEKIT_ACCESSORIES_CACHE_MAGIC;
+		writer.failed = !file.seek(0)
+				|| file.write((const uint8_t*) &header, sizeof(header)) != sizeof(header);
+		writer.written += sizeof(header);
+	}
+	file.close();
+
+	if (writer.failed) {
+		ERROR("Failed to write accessories cache");
+		LittleFS.remove(HOMEKIT_ACCESSORIES_CACHE_PATH);
+		return false;
+	}
+	INFO("Accessories cache written, %u bytes", writer.written);
+	return true;
+}
+
+homekit_characteristic_t *accessories_next_characteristic(homekit_accessory_t ***accessory_it,
+		homekit_service_t ***service_it, homekit_characteristic_t ***ch_it) {
+	while (**accessory_it) {
+		if (!*service_it) {
+			*service_it = (**accessory_it)->services;
+		}
+		while (**service_it) {
+			if (!*ch_it) {
+				*ch_it = (**service_it)->characteristics;
+			}
+			if (**ch_it) {
+				return *(*ch_it)++;
+			}
+			(*service_it)++;
+			*ch_it = NULL;
+		}
+		(*accessory_it)++;
+		*service_it = NULL;
+	}
+	return NULL;
+}
+
+// Streams the cached static part, only ids, events and values are formatted
+void accessories_cache_send(client_context_t *context, File &file) {
+	json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, client_send_chunk, context);
 
-				json_object_start(json);
-				write_characteristic_json(json, context, ch,
-						(characteristic_format_t) (characteristic_format_type
-								| characteristic_format_meta | characteristic_format_perms
-								| characteristic_format_events),
-						NULL);
-				json_object_end(json);
+	homekit_accessory_t **accessory_it = context->server->config->accessories;
+	homekit_service_t **service_it = NULL;
+	homekit_characteristic_t **ch_it = NULL;
+
+	uint8_t buffer[128];
+	int size;
+	while ((size = file.read(buffer, sizeof(buffer))) > 0) {
+		int start = 0;
+		for (int i = 0; i < size; i++) {
+			if (buffer[i] != HOMEKIT_ACCESSORIES_CACHE_SPLICE) {
+				continue;
 			}
-
-			json_array_end(json);
-			json_object_end(json); // service
+			json_raw(json, buffer + start, i - start);
+			start = i + 1;
+
+			homekit_characteristic_t *ch = accessories_next_characteristic(&accessory_it,
+					&service_it, &ch_it);
+			if (!ch) {
+				CLIENT_ERROR(context, "Accessories cache does not match database");
+				continue;
+			}
+			json_object_resume(json);
+			write_characteristic_json(json, context, ch, characteristic_format_events, NULL);
+			json_object_suspend(json);
 		}
-
-		json_array_end(json);
-		json_object_end(json); // accessory
+		json_raw(json, buffer + start, size - start);
 	}
 
-	json_array_end(json);
-	json_object_end(json); // response
-
 	json_flush(json);
 	json_free(json);
+}
+
+void homekit_server_on_get_accessories(client_context_t *context) {
+	DEBUG_TIME_BEGIN();
+	CLIENT_INFO(context, "Get Accessories");DEBUG_HEAP();
+
+	// without a valid cache from init the whole database is formatted
+	File file = accessories_cache_open(context->server);
+
+	client_send_P(context, json_200_response_headers_progmem);
+
+	CLIENT_DEBUG(context, "Get Accessories, start send json body");
+
+	if (file) {
+		accessories_cache_send(context, file);
+		file.close();
+	} else {
+		json_stream *json = json_new(HOMEKIT_JSONBUFFER_SIZE, client_send_chunk, context);
+		write_accessories_json(json, context->server, context, false);
+		json_flush(json);
+		json_free(json);
+	}
 
 	client_send_chunk(NULL, 0, context);
 	DEBUG_TIME_END("get_accessories")
@@ -1876,10 +2672,33 @@ void write_characteristic_error(json_stream *json, uint32_t aid, uint32_t iid, i
 	json_string(json, "iid");
 	json_uint32(json, iid);
 	json_string(json, "status");
-	json_uint8(json, status);
+	json_integer(json, status);
 	json_object_end(json);
 }
 
+// Reads the next aid.iid of an id list in place,
+// returns 1 when read, 0 at the end and -1 when malformed
+int characteristic_id_next(const char **ids, uint32_t *aid, uint32_t *iid) {
+	const char *s = *ids;
+	if (!*s) {
+		return 0;
+	}
+
+	char *end;
+	*aid = strtoul(s, &end, 10);
+	if (end == s || *end != '.') {
+		return -1;
+	}
+	s = end + 1;
+	*iid = strtoul(s, &end, 10);
+	if (end == s || (*end && *end != ',')) {
+		return -1;
+	}
+
+	*ids = *end ? end + 1 : end;
+	return 1;
+}
+
 void homekit_server_on_get_characteristics(client_context_t *context) {
 	CLIENT_INFO(context, "Get Characteristics");DEBUG_HEAP();
 
@@ -1896,7 +2715,7 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 		return;
 	}
 
-	characteristic_format_t format = (characteristic_format_t) 0;
+	characteristic_format_t format = characteristic_format_data;
 	if (bool_endpoint_param("meta", context))
 		format = (characteristic_format_t) (format | characteristic_format_meta);
 
@@ -1911,21 +2730,10 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 
 	bool success = true;
 
-	char *id = strdup(id_param->value);
-	char *ch_id;
-	char *_id = id;
-	while ((ch_id = strsep(&_id, ","))) {
-		char *dot = strstr(ch_id, ".");
-		if (!dot) {
-			send_json_error_response(context, 400, HAPStatus_InvalidValue);
-			free(id);
-			return;
-		}
-
-		*dot = 0;
-		uint32_t aid = atoi(ch_id);
-		uint32_t iid = atoi(dot + 1);
-
+	const char *ids = id_param->value ? id_param->value : "";
+	uint32_t aid, iid;
+	int r;
+	while ((r = characteristic_id_next(&ids, &aid, &iid)) > 0) {
 		CLIENT_DEBUG(context, "Requested characteristic info for %u.%u", aid, iid);
 		homekit_characteristic_t *ch = homekit_characteristic_by_aid_and_iid(
 				context->server->config->accessories, aid, iid);
@@ -1939,9 +2747,10 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 			continue;
 		}
 	}
-
-	free(id);
-	id = strdup(id_param->value);
+	if (r < 0) {
+		send_json_error_response(context, 400, HAPStatus_InvalidValue);
+		return;
+	}
 
 	if (success) {
 		client_send_P(context, json_200_response_headers_progmem);
@@ -1954,13 +2763,8 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 	json_string(json, "characteristics");
 	json_array_start(json);
 
-	_id = id;
-	while ((ch_id = strsep(&_id, ","))) {
-		char *dot = strstr(ch_id, ".");
-		*dot = 0;
-		uint32_t aid = atoi(ch_id);
-		uint32_t iid = atoi(dot + 1);
-
+	ids = id_param->value ? id_param->value : "";
+	while (characteristic_id_next(&ids, &aid, &iid) > 0) {
 		CLIENT_DEBUG(context, "Requested characteristic info for %d.%d", aid, iid);
 		homekit_characteristic_t *ch = homekit_characteristic_by_aid_and_iid(
 				context->server->config->accessories, aid, iid);
@@ -1974,8 +2778,14 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 			continue;
 		}
 
-		json_object_start(json);
-		write_characteristic_json(json, context, ch, format, NULL);
+		characteristic_fragment_t *fragment = (!format && !ch->getter_ex)
+				? characteristic_fragment(context->server, ch, &ch->value) : NULL;
+		if (fragment) {
+			json_characteristic_fragment(json, fragment);
+		} else {
+			json_object_start(json);
+			write_characteristic_json(json, context, ch, format, NULL);
+		}
 		if (!success) {
 			json_string(json, "status");
 			json_uint8(json, HAPStatus_Success);
@@ -1990,33 +2800,46 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 	json_free(json);
 
 	client_send_chunk(NULL, 0, context);
-
-	free(id);
 }
 
-HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *context) {
-	cJSON *j_aid = cJSON_GetObjectItem(j_ch, "aid");
-	if (!j_aid) {
+// One element of a PUT /characteristics body, members not present have type none
+typedef struct {
+	json_token aid;
+	json_token iid;
+	json_token value;
+	json_token ev;
+} characteristic_update_t;
+
+typedef struct {
+	uint32_t aid;
+	uint32_t iid;
+	HAPStatus status;
+} characteristic_update_status_t;
+
+HAPStatus process_characteristics_update(const characteristic_update_t *update,
+		client_context_t *context) {
+	const json_token *j_aid = &update->aid;
+	if (j_aid->type == json_token_none) {
 		CLIENT_ERROR(context, "Failed to process request: no \"aid\" field");
 		return HAPStatus_NoResource;
 	}
-	if (j_aid->type != cJSON_Number) {
+	if (j_aid->type != json_token_number) {
 		CLIENT_ERROR(context, "Failed to process request: \"aid\" field is not a number");
 		return HAPStatus_NoResource;
 	}
 
-	cJSON *j_iid = cJSON_GetObjectItem(j_ch, "iid");
-	if (!j_iid) {
+	const json_token *j_iid = &update->iid;
+	if (j_iid->type == json_token_none) {
 		CLIENT_ERROR(context, "Failed to process request: no \"iid\" field");
 		return HAPStatus_NoResource;
 	}
-	if (j_iid->type != cJSON_Number) {
+	if (j_iid->type != json_token_number) {
 		CLIENT_ERROR(context, "Failed to process request: \"iid\" field is not a number");
 		return HAPStatus_NoResource;
 	}
 
-	uint32_t aid = (uint32_t)j_aid->valuedouble;//j_aid->valueint;
-	uint32_t iid = (uint32_t)j_iid->valuedouble;//j_iid->valueint;
+	uint32_t aid = (uint32_t)j_aid->number;
+	uint32_t iid = (uint32_t)j_iid->number;
 
 	homekit_characteristic_t *ch = homekit_characteristic_by_aid_and_iid(
 			context->server->config->accessories, aid, iid);
@@ -2026,9 +2849,10 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 		return HAPStatus_NoResource;
 	}
 
-	cJSON *j_value = cJSON_GetObjectItem(j_ch, "value");
-	if (j_value) {
+	const json_token *j_value = &update->value;
+	if (j_value->type != json_token_none) {
 		homekit_value_t h_value = HOMEKIT_NULL_CPP();
+		char *string_value = NULL;
 
 		if (!(ch->permissions & homekit_permissions_paired_write)) {
 			CLIENT_ERROR(context, "Failed to update %d.%d: no write permission", aid, iid);
@@ -2038,13 +2862,13 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 		switch (ch->format) {
 		case homekit_format_bool: {
 			bool value = false;
-			if (j_value->type == cJSON_True) {
+			if (j_value->type == json_token_true) {
 				value = true;
-			} else if (j_value->type == cJSON_False) {
+			} else if (j_value->type == json_token_false) {
 				value = false;
-			} else if (j_value->type == cJSON_Number
-					&& (j_value->valueint == 0 || j_value->valueint == 1)) {
-				value = j_value->valueint == 1;
+			} else if (j_value->type == json_token_number
+					&& ((int) j_value->number == 0 || (int) j_value->number == 1)) {
+				value = (int) j_value->number == 1;
 			} else {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a boolean or 0/1", aid,
 						iid);
@@ -2067,8 +2891,8 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			case homekit_format_uint64:
 			case homekit_format_int: {
 			// We accept boolean values here in order to fix a bug in HomeKit. HomeKit sometimes sends a boolean instead of an integer of value 0 or 1.
-			if (j_value->type != cJSON_Number && j_value->type != cJSON_False
-					&& j_value->type != cJSON_True) {
+			if (j_value->type != json_token_number && j_value->type != json_token_false
+					&& j_value->type != json_token_true) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a number", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
@@ -2113,7 +2937,7 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			if (ch->max_value)
 				max_value = *ch->max_value;
 
-			double value = j_value->valuedouble;
+			double value = j_value->number;
 			if (value < min_value || value > max_value) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value %g is not in range %g..%g",
 						aid, iid, value, min_value, max_value);
@@ -2187,12 +3011,12 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			break;
 		}
 		case homekit_format_float: {
-			if (j_value->type != cJSON_Number) {
+			if (j_value->type != json_token_number) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a number", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
 
-			float value = j_value->valuedouble;
+			float value = j_value->number;
 			if ((ch->min_value && value < *ch->min_value)
 					|| (ch->max_value && value > *ch->max_value)) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not in range", aid, iid);
@@ -2210,15 +3034,20 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			break;
 		}
 		case homekit_format_string: {
-			if (j_value->type != cJSON_String) {
+			if (j_value->type != json_token_string) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a string", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
 
 			int max_len = (ch->max_len) ? *ch->max_len : 64;
 
-			char *value = j_value->valuestring;
+			char *value = json_token_strdup(j_value);
+			if (!value) {
+				CLIENT_ERROR(context, "Failed to update %d.%d: invalid string", aid, iid);
+				return HAPStatus_InvalidValue;
+			}
 			if (strlen(value) > max_len) {
+				free(value);
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is too long", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
@@ -2232,26 +3061,35 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 				homekit_value_destruct(&ch->value);
 				homekit_value_copy(&ch->value, &h_value);
 			}
+			// notified below, copied by every listener that keeps it
+			string_value = value;
 			break;
 		}
 		case homekit_format_tlv: {
-			if (j_value->type != cJSON_String) {
+			if (j_value->type != json_token_string) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a string", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
 
 			int max_len = (ch->max_len) ? *ch->max_len : 256;
 
-			char *value = j_value->valuestring;
+			char *value = json_token_strdup(j_value);
+			if (!value) {
+				CLIENT_ERROR(context, "Failed to update %d.%d: invalid string", aid, iid);
+				return HAPStatus_InvalidValue;
+			}
 			size_t value_len = strlen(value);
 			if (value_len > max_len) {
+				free(value);
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is too long", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
 
 			size_t tlv_size = base64_decoded_size((unsigned char*) value, value_len);
 			byte *tlv_data = (byte*) malloc(tlv_size);
-			if (base64_decode_((byte*) value, value_len, tlv_data) < 0) {
+			int decoded = base64_decode_((byte*) value, value_len, tlv_data);
+			free(value);
+			if (decoded < 0) {
 				free(tlv_data);
 				CLIENT_ERROR(context, "Failed to update %d.%d: error Base64 decoding", aid, iid);
 				return HAPStatus_InvalidValue;
@@ -2285,7 +3123,7 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			break;
 		}
 		case homekit_format_data: {
-			if (j_value->type != cJSON_String) {
+			if (j_value->type != json_token_string) {
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is not a string", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
@@ -2294,16 +3132,23 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			// for this accessory
 			int max_len = (ch->max_data_len) ? *ch->max_data_len : 4096;
 
-			char *value = j_value->valuestring;
+			char *value = json_token_strdup(j_value);
+			if (!value) {
+				CLIENT_ERROR(context, "Failed to update %d.%d: invalid string", aid, iid);
+				return HAPStatus_InvalidValue;
+			}
 			size_t value_len = strlen(value);
 			if (value_len > max_len) {
+				free(value);
 				CLIENT_ERROR(context, "Failed to update %d.%d: value is too long", aid, iid);
 				return HAPStatus_InvalidValue;
 			}
 
 			size_t data_size = base64_decoded_size((unsigned char*) value, value_len);
 			byte *data = (byte*) malloc(data_size);
-			if (base64_decode_((byte*) value, value_len, data) < 0) {
+			int decoded = base64_decode_((byte*) value, value_len, data);
+			free(value);
+			if (decoded < 0) {
 				free(data);
 				CLIENT_ERROR(context, "Failed to update %d.%d: error Base64 decoding", aid, iid);
 				return HAPStatus_InvalidValue;
@@ -2331,23 +3176,29 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 			context->current_characteristic = NULL;
 			context->current_value = NULL;
 		}
+		free(string_value);
 	}
 
-	cJSON *j_events = cJSON_GetObjectItem(j_ch, "ev");
-	if (j_events) {
-		if (!(ch->permissions && homekit_permissions_notify)) {
+	const json_token *j_events = &update->ev;
+	if (j_events->type != json_token_none) {
+		if (!(ch->permissions & homekit_permissions_notify)) {
 			CLIENT_ERROR(context,
 					"Failed to set notification state for %d.%d: " "notifications are not supported",
 					aid, iid);
 			return HAPStatus_NotificationsUnsupported;
 		}
+		if (j_events->type == json_token_true && ch->event_slot == HOMEKIT_EVENT_SLOT_NONE) {
+			CLIENT_ERROR(context,
+					"Failed to set notification state for %d.%d: " "no event slot", aid, iid);
+			return HAPStatus_NotificationsUnsupported;
+		}
 
-		if ((j_events->type != cJSON_True) && (j_events->type != cJSON_False)) {
+		if ((j_events->type != json_token_true) && (j_events->type != json_token_false)) {
 			CLIENT_ERROR(context,
 					"Failed to set notification state for %d.%d: " "invalid state value", aid, iid);
 		}
 
-		if (j_events->type == cJSON_True) {
+		if (j_events->type == json_token_true) {
 			homekit_characteristic_add_notify_callback(ch, client_notify_characteristic, context);
 		} else {
 			homekit_characteristic_remove_notify_callback(ch, client_notify_characteristic,
@@ -2358,50 +3209,145 @@ HAPStatus process_characteristics_update(const cJSON *j_ch, client_context_t *co
 	return HAPStatus_Success;
 }
 
-void homekit_server_on_update_characteristics(client_context_t *context, const byte *data,
-		size_t size) {
-	DEBUG_TIME_BEGIN();
-	CLIENT_INFO(context, "Update Characteristics");DEBUG_HEAP();
+#ifndef HOMEKIT_MAX_CHARACTERISTIC_UPDATES
+#define HOMEKIT_MAX_CHARACTERISTIC_UPDATES 16 // elements of one PUT, statuses are kept on stack
+#endif
 
-	char *data1 = strndup((char*) data, size);
-	cJSON *json = cJSON_Parse(data1);
-	free(data1);
+bool characteristic_update_read(json_reader *reader, characteristic_update_t *update) {
+	memset(update, 0, sizeof(*update));
+	if (!json_reader_next(reader, '{')) {
+		return false;
+	}
+	if (json_reader_next(reader, '}')) {
+		return true;
+	}
+	do {
+		const char *key;
+		size_t key_size;
+		if (!json_reader_key(reader, &key, &key_size)) {
+			return false;
+		}
+
+		json_token skipped;
+		json_token *token = &skipped;
+		if (json_token_key_equals(key, key_size, "aid")) {
+			token = &update->aid;
+		} else if (json_token_key_equals(key, key_size, "iid")) {
+			token = &update->iid;
+		} else if (json_token_key_equals(key, key_size, "value")) {
+			token = &update->value;
+		} else if (json_token_key_equals(key, key_size, "ev")) {
+			token = &update->ev;
+		}
+		if (!json_reader_value(reader, token)) {
+			return false;
+		}
+	} while (json_reader_next(reader, ','));
+
+	return json_reader_next(reader, '}');
+}
+
+// Walks {"characteristics":[...]} without building a document. Without statuses
+// the body is only checked and counted, with them every element is applied.
+// Returns the number of elements or -1 when the body is invalid.
+int characteristic_updates_process(client_context_t *context, const byte *data, size_t size,
+		characteristic_update_status_t *statuses) {
+	json_reader reader;
+	json_reader_init(&reader, (const char*) data, size);
 
-	if (!json) {
+	if (!json_reader_next(&reader, '{')) {
 		CLIENT_ERROR(context, "Failed to parse request JSON");
-		send_json_error_response(context, 400, HAPStatus_InvalidValue);
-		return;
+		return -1;
+	}
+
+	int count = -1;
+	bool done = json_reader_next(&reader, '}');
+	while (!done) {
+		const char *key;
+		size_t key_size;
+		if (!json_reader_key(&reader, &key, &key_size)) {
+			CLIENT_ERROR(context, "Failed to parse request JSON");
+			return -1;
+		}
+
+		if (!json_token_key_equals(key, key_size, "characteristics")) {
+			json_token skipped;
+			if (!json_reader_value(&reader, &skipped)) {
+				CLIENT_ERROR(context, "Failed to parse request JSON");
+				return -1;
+			}
+		} else if (!json_reader_next(&reader, '[')) {
+			CLIENT_ERROR(context, "Failed to parse request: \"characteristics\" field is not an list");
+			return -1;
+		} else {
+			count = 0;
+			bool empty = json_reader_next(&reader, ']');
+			while (!empty) {
+				characteristic_update_t update;
+				if (!characteristic_update_read(&reader, &update)) {
+					CLIENT_ERROR(context, "Failed to parse request JSON");
+					return -1;
+				}
+
+				if (statuses) {
+					characteristic_update_status_t *status = &statuses[count];
+					status->aid = update.aid.type == json_token_number ? update.aid.number : 0;
+					status->iid = update.iid.type == json_token_number ? update.iid.number : 0;
+					CLIENT_DEBUG(context, "Processing element %u.%u", status->aid, status->iid);
+					status->status = process_characteristics_update(&update, context);
+				}
+				count++;
+
+				if (json_reader_next(&reader, ']')) {
+					break;
+				}
+				if (!json_reader_next(&reader, ',')) {
+					CLIENT_ERROR(context, "Failed to parse request JSON");
+					return -1;
+				}
+				if (count == HOMEKIT_MAX_CHARACTERISTIC_UPDATES) {
+					CLIENT_ERROR(context, "Failed to process request: more than %d characteristics",
+							HOMEKIT_MAX_CHARACTERISTIC_UPDATES);
+					return -1;
+				}
+			}
+		}
+
+		if (json_reader_next(&reader, '}')) {
+			done = true;
+		} else if (!json_reader_next(&reader, ',')) {
+			CLIENT_ERROR(context, "Failed to parse request JSON");
+			return -1;
+		}
 	}
 
-	cJSON *characteristics = cJSON_GetObjectItem(json, "characteristics");
-	if (!characteristics) {
+	if (!json_reader_at_end(&reader)) {
+		CLIENT_ERROR(context, "Failed to parse request JSON");
+		return -1;
+	}
+	if (count < 0) {
 		CLIENT_ERROR(context, "Failed to parse request: no \"characteristics\" field");
-		cJSON_Delete(json);
-		send_json_error_response(context, 400, HAPStatus_InvalidValue);
-		return;
 	}
-	if (characteristics->type != cJSON_Array) {
-		CLIENT_ERROR(context, "Failed to parse request: \"characteristics\" field is not an list");
-		cJSON_Delete(json);
+	return count;
+}
+
+void homekit_server_on_update_characteristics(client_context_t *context, const byte *data,
+		size_t size) {
+	DEBUG_TIME_BEGIN();
+	CLIENT_INFO(context, "Update Characteristics");DEBUG_HEAP();
+
+	// nothing is applied unless the whole body is valid
+	if (characteristic_updates_process(context, data, size, NULL) < 0) {
 		send_json_error_response(context, 400, HAPStatus_InvalidValue);
 		return;
 	}
 
-	HAPStatus *statuses = (HAPStatus*) malloc(
-			sizeof(HAPStatus) * cJSON_GetArraySize(characteristics));
-	bool has_errors = false;
-
-	for (int i = 0; i < cJSON_GetArraySize(characteristics); i++) {
-
-		cJSON *j_ch = cJSON_GetArrayItem(characteristics, i);
+	characteristic_update_status_t statuses[HOMEKIT_MAX_CHARACTERISTIC_UPDATES];
+	int count = characteristic_updates_process(context, data, size, statuses);
 
-		char *s = cJSON_Print(j_ch);
-		CLIENT_DEBUG(context, "Processing element %s", s);
-		free(s);
-
-		statuses[i] = process_characteristics_update(j_ch, context);
-
-		if (statuses[i] != HAPStatus_Success)
+	bool has_errors = false;
+	for (int i = 0; i < count; i++) {
+		if (statuses[i].status != HAPStatus_Success)
 			has_errors = true;
 	}
 
@@ -2418,17 +3364,14 @@ void homekit_server_on_update_characteristics(client_context_t *context, const b
 		json_string(json1, "characteristics");
 		json_array_start(json1);
 
-		for (int i = 0; i < cJSON_GetArraySize(characteristics); i++) {
-
-			cJSON *j_ch = cJSON_GetArrayItem(characteristics, i);
-
+		for (int i = 0; i < count; i++) {
 			json_object_start(json1);
 			json_string(json1, "aid");
-			json_uint32(json1, cJSON_GetObjectItem(j_ch, "aid")->valuedouble);//->valueint);
+			json_uint32(json1, statuses[i].aid);
 			json_string(json1, "iid");
-			json_uint32(json1, cJSON_GetObjectItem(j_ch, "iid")->valuedouble);//->valueint);
+			json_uint32(json1, statuses[i].iid);
 			json_string(json1, "status");
-			json_uint8(json1, statuses[i]);
+			json_integer(json1, statuses[i].status);
 			json_object_end(json1);
 		}
 
@@ -2441,8 +3384,6 @@ void homekit_server_on_update_characteristics(client_context_t *context, const b
 		client_send_chunk(NULL, 0, context);
 	}
 
-	free(statuses);
-	cJSON_Delete(json);
 	DEBUG_TIME_END("update_characteristics");
 }
 
@@ -2541,6 +3482,9 @@ void homekit_server_on_pairings(client_context_t *context, const byte *data, siz
 				break;
 			}
 
+#ifdef HOMEKIT_PAIR_RESUME
+			resume_sessions_forget(context->server, pairing.id);
+#endif
 			INFO("Updated pairing with %s", device_identifier);
 		} else {
 			if (!homekit_storage_can_add_pairing()) {
@@ -2603,6 +3547,9 @@ void homekit_server_on_pairings(client_context_t *context, const byte *data, siz
 				break;
 			}
 
+#ifdef HOMEKIT_PAIR_RESUME
+			resume_sessions_forget(context->server, pairing.id);
+#endif
 			INFO("Removed pairing with %s", device_identifier);
 
 			HOMEKIT_NOTIFY_EVENT(context->server, HOMEKIT_EVENT_PAIRING_REMOVED);
@@ -2893,55 +3840,61 @@ void homekit_client_process(client_context_t *context) {
 		if (!context->socket->connected()) {
 			CLIENT_INFO(context, "Disconnected!");
 			context->disconnect = true;
-			homekit_server_close_client(context->server, context);
 		}
 		return;
 	}
 	CLIENT_DEBUG(context, "Got %d incomming data, encrypted is %s",
 			data_len, context->encrypted ? "true" : "false");
-	byte *payload = (byte*) context->data;
-	size_t payload_size = (size_t) data_len;
-
-	byte *decrypted = NULL;
-	size_t decrypted_size = 0;
 
 	if (context->encrypted) {
 		CLIENT_DEBUG(context, "Decrypting data");
 
-		client_decrypt_(context, context->data, data_len, NULL, &decrypted_size);
+		// Frames are decrypted in place and parsed one by one,
+		// only an unfinished frame is moved to the buffer start
+		size_t available = context->data_available + data_len;
+		size_t offset = 0;
+		while (!context->disconnect) {
+			int frame_size = client_decrypt_frame_(context, context->data + offset,
+					available - offset);
+			if (frame_size == -2) {
+				break;
+			}
+			if (frame_size < 0) {
+				// the frame counters are out of step now, nothing after it decrypts
+				CLIENT_ERROR(context, "Invalid client data");
+				context->data_available = 0;
+				context->disconnect = true;
+				return;
+			}
 
-		decrypted = (byte*) malloc(decrypted_size);
-		int r = client_decrypt_(context, context->data, data_len, decrypted, &decrypted_size);
+			byte *payload = context->data + offset + HOMEKIT_FRAME_AAD_SIZE;
+			offset += HOMEKIT_FRAME_AAD_SIZE + frame_size + HOMEKIT_FRAME_TAG_SIZE;
+			if (!frame_size) {
+				continue; // zero length would tell the parser the stream ended
+			}
+			print_binary("Decrypted data", payload, frame_size);
 
-		if (r < 0) {
-			CLIENT_ERROR(context, "Invalid client data");
-			free(decrypted);
-			return;
+			current_client_context = context;
+			http_parser_execute(&context->parser, &homekit_http_parser_settings,
+					(char*) payload, frame_size);
+			current_client_context = NULL;
 		}
-		context->data_available = data_len - r;
-		if (r && context->data_available) {
-			memmove(context->data, &context->data[r], context->data_available);
-		}
-		CLIENT_DEBUG(context, "Decrypted %d bytes, available %d", decrypted_size, context->data_available);
 
-		payload = decrypted;
-		payload_size = decrypted_size;
-		if (payload_size)
-			print_binary("Decrypted data", payload, payload_size);
+		context->data_available = available - offset;
+		if (offset && context->data_available) {
+			memmove(context->data, context->data + offset, context->data_available);
+		}
+		CLIENT_DEBUG(context, "Decrypted %d bytes, available %d", offset, context->data_available);
 	} else {
 		context->data_available = 0;
-	}
 
-	current_client_context = context;
-	http_parser_execute(&context->parser, &homekit_http_parser_settings,
-			(char*) payload, payload_size);
-	current_client_context = NULL;
+		current_client_context = context;
+		http_parser_execute(&context->parser, &homekit_http_parser_settings,
+				(char*) context->data, data_len);
+		current_client_context = NULL;
+	}
 
 	CLIENT_DEBUG(context, "Finished processing");
-
-	if (decrypted) {
-		free(decrypted);
-	}
 }
 
 void homekit_server_close_client(homekit_server_t *server, client_context_t *context) {
@@ -2974,6 +3927,11 @@ void homekit_server_close_client(homekit_server_t *server, client_context_t *con
 	homekit_accessories_clear_notify_callbacks(context->server->config->accessories,
 			client_notify_characteristic, context);
 
+	if (server->tx_client == context) {
+		server->tx_size = server->tx_frame = 0;
+		server->tx_client = NULL;
+	}
+
 	HOMEKIT_NOTIFY_EVENT(server, HOMEKIT_EVENT_CLIENT_DISCONNECTED);
 
 	client_context_free(context);
@@ -3011,6 +3969,7 @@ client_context_t* homekit_server_accept_client(homekit_server_t *server) {
 
 	client_context_t *context = client_context_new(wifiClient);
 	context->server = server;
+	client_event_slots_init(context);
 	context->socket = wifiClient;
 
 	context->next = server->clients;
@@ -3023,10 +3982,48 @@ client_context_t* homekit_server_accept_client(homekit_server_t *server) {
 	return context;
 }
 
+// Refills the client token bucket and checks the link can take an EVENT now
+bool client_event_allowed(client_context_t *context) {
+	const uint32_t now = millis();
+	if (context->event_backoff && (int32_t) (now - context->event_backoff_until) < 0) {
+		return false;
+	}
+
+	uint32_t elapsed = now - context->event_tokens_time;
+	context->event_tokens_time = now;
+	if (elapsed > HOMEKIT_EVENT_BURST * 1000) {
+		elapsed = HOMEKIT_EVENT_BURST * 1000;
+	}
+	context->event_tokens += elapsed * HOMEKIT_EVENT_RATE_PER_SEC;
+	if (context->event_tokens > HOMEKIT_EVENT_BURST * 1000) {
+		context->event_tokens = HOMEKIT_EVENT_BURST * 1000;
+	}
+	if (context->event_tokens < 1000) {
+		return false;
+	}
+
+	if (!context->socket
+			|| context->socket->availableForWrite() < HOMEKIT_JSONBUFFER_SIZE + 18) {
+		// Previous data not acked yet, writing now would fail and drop the client
+		context->event_backoff = context->event_backoff ?
+				context->event_backoff * 2 : HOMEKIT_EVENT_BACKOFF_MIN_MS;
+		if (context->event_backoff > HOMEKIT_EVENT_BACKOFF_MAX_MS) {
+			context->event_backoff = HOMEKIT_EVENT_BACKOFF_MAX_MS;
+		}
+		context->event_backoff_until = now + context->event_backoff;
+		CLIENT_INFO(context, "Send buffer full, holding events for %d ms", context->event_backoff);
+		return false;
+	}
+
+	context->event_backoff = 0;
+	context->event_tokens -= 1000;
+	return true;
+}
+
 //设备向iPhone传递characteristic的消息
 void homekit_server_process_notifications(homekit_server_t *server) {
 	client_context_t *context = server->clients;
-	// 把characteristic_event_t拼接成client_event_t链表
+	// 每个client的dirty slot合并为一个EVENT
 	// 按照Apple的规定，Nofiy消息需合并发送
 	while (context) {
 		if (context->step != HOMEKIT_CLIENT_STEP_PAIR_VERIFY_2OF2) {
@@ -3034,63 +4031,14 @@ void homekit_server_process_notifications(homekit_server_t *server) {
 			context = context->next;
 			continue;
 		}
-		characteristic_event_t *event = NULL;
-		if (context->event_queue && q_pop(context->event_queue, &event)) {
-			// Get and coalesce all client events
-			client_event_t *events_head = (client_event_t*) malloc(sizeof(client_event_t));
-			events_head->characteristic = event->characteristic;
-			homekit_value_copy(&events_head->value, &event->value);
-			events_head->next = NULL;
-
-			homekit_value_destruct(&event->value);
-			free(event);
-
-			client_event_t *events_tail = events_head;
-
-			while (q_pop(context->event_queue, &event)) {
-				//q_pop第二个参数必须传指针的地址
-				//event = context->event_queue->shift();
-				client_event_t *e = events_head;
-				while (e) {
-					if (e->characteristic == event->characteristic) {
-						break;
-					}
-					e = e->next;
-				}
-
-				if (e) {
-					homekit_value_destruct(&e->value);
-				} else {
-					e = (client_event_t*) malloc(sizeof(client_event_t));
-					e->characteristic = event->characteristic;
-					e->next = NULL;
-
-					events_tail->next = e;
-					events_tail = e;
-				}
-
-				homekit_value_copy(&e->value, &event->value);
-
-				homekit_value_destruct(&event->value);
-				free(event);
-			}
-
-			send_client_events(context, events_head);
-
-			client_event_t *e = events_head;
-			while (e) {
-				client_event_t *next = e->next;
-
-				homekit_value_destruct(&e->value);
-				free(e);
-
-				e = next;
-			}
+		if (context->events_head == HOMEKIT_EVENT_SLOT_NONE || !client_event_allowed(context)) {
+			context = context->next;
+			continue;
 		}
 
+		send_client_events(context);
 		context = context->next;
 	}
-
 }
 
 bool homekit_client_need_process_data(client_context_t *context) {
@@ -3101,6 +4049,38 @@ bool homekit_client_need_process_data(client_context_t *context) {
 	return false;
 }
 
+// Generates one pooled key per call, only while no client is in a handshake
+void ephemeral_keys_refill(homekit_server_t *server) {
+	if (server->ephemeral_keys_count == HOMEKIT_EPHEMERAL_KEYS) {
+		return;
+	}
+	for (client_context_t *context = server->clients; context; context = context->next) {
+		if (homekit_client_need_process_data(context)) {
+			return;
+		}
+	}
+
+	curve25519_key *key = &server->ephemeral_keys[server->ephemeral_keys_count];
+	int r = crypto_curve25519_generate(key);
+	if (r) {
+		ERROR("Failed to pregenerate Curve25519 key (code %d)", r);
+		return;
+	}
+	server->ephemeral_keys_count++;
+}
+
+// Clients are only freed here, handlers and writes just mark them
+void homekit_server_close_disconnected(homekit_server_t *server) {
+	client_context_t *context = server->clients;
+	while (context) {
+		client_context_t *next = context->next;
+		if (context->disconnect) {
+			homekit_server_close_client(server, context);
+		}
+		context = next;
+	}
+}
+
 //run in loop, include {accept_client, client_process, notifications}
 void homekit_server_process(homekit_server_t *server) {
 
@@ -3108,7 +4088,7 @@ void homekit_server_process(homekit_server_t *server) {
 
 	client_context_t *context = server->clients;
 	while (context) {
-		//homekit_client_process includes {handle data and stop disconnected client}
+		//homekit_client_process includes {handle data and mark disconnected client}
 //		do{
 //			if(homekit_client_need_process_data(context)){
 //				CLIENT_INFO(context, "Step is %d", context->step);
@@ -3120,6 +4100,7 @@ void homekit_server_process(homekit_server_t *server) {
 		context = context->next;
 	}
 	homekit_server_process_notifications(server);
+	homekit_server_close_disconnected(server);
 }
 
 //=====================================================
@@ -3350,6 +4331,8 @@ void homekit_server_init(homekit_server_config_t *config) {
 	homekit_server_t *server = server_new();
 	running_server = server;
 	server->config = config;
+	server_event_slots_init(server);
+	server->accessories_cache_key = accessories_cache_key(config);
 
 	//homekit_server_task(server);
 	INFO("Starting server");
@@ -3377,6 +4360,9 @@ void homekit_server_init(homekit_server_config_t *config) {
 		INFO("Using existing accessory ID: %s", server->accessory_id);
 	}
 
+	server->accessory_key_expanded_valid = !crypto_ed25519_expand_key(&server->accessory_key,
+			server->accessory_key_expanded);
+
 	pairing_iterator_t pairing_it;
 	homekit_storage_pairing_iterator_init(&pairing_it);
 
@@ -3390,14 +4376,17 @@ void homekit_server_init(homekit_server_config_t *config) {
 	}
 	homekit_storage_pairing_iterator_done(&pairing_it);
 
+	// only started here, arduino_homekit_loop runs the exponentiations a slice at a time
 	if (!server->paired) {
-		if (!arduino_homekit_preinit(server)) {
-			ERROR("Error in arduino_homekit_preinit, please check and retry");
+		if (!preinit_start(server)) {
+			ERROR("Error in preinit_start, please check and retry");
 			system_restart();
 			return;
 		}
 	}
 
+	accessories_cache_prepare(server);
+
 	homekit_mdns_init(server);
 	HOMEKIT_NOTIFY_EVENT(server, HOMEKIT_EVENT_SERVER_INITIALIZED);
 	homekit_server_process(server);
@@ -3494,12 +4483,45 @@ int homekit_get_setup_uri(const homekit_server_config_t *config, char *buffer, s
 	return 0;
 }
 
+// Starts the SRP setup from the state saved by preinit_save for the same fixed
+// setup code, only the public key is left to compute. Returns 1 when restored,
+// 0 when nothing matching was saved, negative when the context has to be recreated.
+int preinit_restore(pairing_context_t *context, const char *password) {
+	byte *state = (byte*) malloc(CRYPTO_SRP_STATE_SIZE);
+	if (!state || homekit_storage_load_srp_state(state)) {
+		free(state);
+		return 0;
+	}
+
+	int r = crypto_srp_setup_restore(context->srp, "Pair-Setup", password, state,
+			&context->srp_setup);
+	memset(state, 0, CRYPTO_SRP_STATE_SIZE);
+	free(state);
+	if (r) {
+		return r == -1 ? 0 : -1; // -1 is a different setup code
+	}
+	preinit_state_saved = true;
+	return 1;
+}
+
+// Keeps salt and verifier, a reboot before pairing then only computes the public key
+void preinit_save(pairing_context_t *context, const char *password) {
+	byte *state = (byte*) malloc(CRYPTO_SRP_STATE_SIZE);
+	if (!state) {
+		return;
+	}
+	if (!crypto_srp_setup_export(context->srp_setup, password, state)
+			&& !homekit_storage_save_srp_state(state)) {
+		preinit_state_saved = true;
+	}
+	memset(state, 0, CRYPTO_SRP_STATE_SIZE);
+	free(state);
+}
+
 // Pre-initialize the pairing_context used in Pair-Setep 1/3
 // For avoiding timeout caused sockect disconnection from iOS device.
-bool arduino_homekit_preinit(homekit_server_t *server) {
-	if (saved_preinit_pairing_context != nullptr) {
-		return true;
-	}
+// Starts SRP pre-init with a new setup code, the exponentiations run in preinit_step
+bool preinit_start(homekit_server_t *server) {
 	INFO("Preiniting pairing context");
 	pairing_context_t *preinit_pairing_context = pairing_context_new();
 	DEBUG_HEAP();
@@ -3522,47 +4544,112 @@ bool arduino_homekit_preinit(homekit_server_t *server) {
 		server->config->password_callback(password);
 	}
 
-	watchdog_disable_all();
-	watchdog_check_begin();
-	crypto_srp_init(preinit_pairing_context->srp, "Pair-Setup", password);
-	watchdog_check_end("crypto_srp_init");  // 6585ms
-	watchdog_enable_all();
+	if (server->config->password) {
+		const int restored = preinit_restore(preinit_pairing_context, server->config->password);
+		if (restored > 0) {
+			INFO("Preinit SRP verifier restored from storage");
+		}
+		if (restored < 0) {
+			pairing_context_free(preinit_pairing_context);
+			preinit_pairing_context = pairing_context_new();
+		}
+	}
 
-	delay(10);
+	if (!preinit_pairing_context->srp_setup) {
+		preinit_pairing_context->srp_setup = crypto_srp_setup_new(preinit_pairing_context->srp,
+				"Pair-Setup", password);
+	}
+	if (!preinit_pairing_context->srp_setup) {
+		ERROR("Failed to start SRP setup");
+		pairing_context_free(preinit_pairing_context);
+		return false;
+	}
+	pending_preinit_pairing_context = preinit_pairing_context;
+	return true;
+}
+
+// Runs up to max_bits exponent bits of the pending pre-init.
+// Returns 1 while it is running, 0 once the pairing context is ready, negative on error.
+int preinit_step(homekit_server_t *server, unsigned max_bits) {
+	pairing_context_t *preinit_pairing_context = pending_preinit_pairing_context;
+	const int progress = crypto_srp_setup_progress(preinit_pairing_context->srp_setup);
+	int r = crypto_srp_setup_step(preinit_pairing_context->srp_setup, max_bits);
+	if (r > 0) {
+		const int new_progress = crypto_srp_setup_progress(preinit_pairing_context->srp_setup);
+		if (new_progress / 25 != progress / 25) {
+			INFO("Preinit pairing context %d%%", new_progress);
+		}
+		return 1;
+	}
+
+	if (!r) {
+		preinit_pairing_context->public_key_size = 0;
+		crypto_srp_setup_get_public_key(preinit_pairing_context->srp_setup, NULL,
+				&preinit_pairing_context->public_key_size);
+		preinit_pairing_context->public_key = (byte*) malloc(
+				preinit_pairing_context->public_key_size);
+		r = crypto_srp_setup_get_public_key(preinit_pairing_context->srp_setup,
+				preinit_pairing_context->public_key, &preinit_pairing_context->public_key_size);
+	}
+	if (r) {
+		ERROR("Failed to dump SPR public key (code %d)", r);
+		pairing_context_free(preinit_pairing_context);
+		return r < 0 ? r : -r;
+	}
 
-	if (preinit_pairing_context->public_key) {
-		free(preinit_pairing_context->public_key);
-		preinit_pairing_context->public_key = NULL;
+	if (server->config->password && !preinit_state_saved) {
+		preinit_save(preinit_pairing_context, server->config->password);
 	}
-	preinit_pairing_context->public_key_size = 0;
-	crypto_srp_get_public_key(preinit_pairing_context->srp, NULL,
-			&preinit_pairing_context->public_key_size);
 
-	preinit_pairing_context->public_key = (byte*) malloc(preinit_pairing_context->public_key_size);
+	crypto_srp_setup_free(preinit_pairing_context->srp_setup);
+	preinit_pairing_context->srp_setup = NULL;
+	pending_preinit_pairing_context = nullptr;
+	saved_preinit_pairing_context = preinit_pairing_context;
+
+	INFO("Preinit pairing context success");
+	MDNS.announce();		// update "paired" state
+	return 0;
+}
+
+// Finishes pre-init now, for a controller that starts pair setup before the loop did
+bool arduino_homekit_preinit(homekit_server_t *server) {
+	if (saved_preinit_pairing_context != nullptr) {
+		return true;
+	}
+	if (pending_preinit_pairing_context == nullptr && !preinit_start(server)) {
+		return false;
+	}
 
 	watchdog_disable_all();
 	watchdog_check_begin();
-	int r = crypto_srp_get_public_key(preinit_pairing_context->srp,
-			preinit_pairing_context->public_key, &preinit_pairing_context->public_key_size);
-	watchdog_check_end("crypto_srp_get_public_key");  // 3310ms
+	int r = preinit_step(server, ~0u); // all that is left
+	watchdog_check_end("crypto_srp_setup_step");
 	watchdog_enable_all();
 
 	delay(10);
+	return !r;
+}
 
-	if (r) {
-		//CLIENT_ERROR(context, "Failed to dump SPR public key (code %d)", r);
-		ERROR("Failed to dump SPR public key (code %d)");
-		pairing_context_free(preinit_pairing_context);
-		preinit_pairing_context = NULL;
-		// In preinit, we should not send response
-		// send_tlv_error_response(context, 2, TLVError_Unknown);
-		return false;
+// A slice of pre-init per loop, so the device stays responsive while unpaired
+void arduino_homekit_preinit_loop(homekit_server_t *server) {
+	if (saved_preinit_pairing_context != nullptr) {
+		return;
 	}
-	saved_preinit_pairing_context = preinit_pairing_context;
+	if (pending_preinit_pairing_context == nullptr) {
+		preinit_start(server);
+		return;
+	}
+	preinit_step(server, HOMEKIT_SRP_SETUP_BITS);
+}
 
-	INFO("Preinit pairing context success");
-	MDNS.announce();		// update "paired" state
-	return true;
+int arduino_homekit_preinit_progress() {
+	if (saved_preinit_pairing_context) {
+		return 100;
+	}
+	if (pending_preinit_pairing_context) {
+		return crypto_srp_setup_progress(pending_preinit_pairing_context->srp_setup);
+	}
+	return -1;
 }
 
 void arduino_homekit_setup(homekit_server_config_t *config) {
@@ -3590,9 +4677,12 @@ void arduino_homekit_loop() {
 	if (running_server != nullptr) {
 		if (!running_server->paired) {
 			//If not paired or pairing was removed, preinit paring context.
-			arduino_homekit_preinit(running_server);
+			arduino_homekit_preinit_loop(running_server);
 		}
 		homekit_server_process(running_server);
+		if (running_server->paired) {
+			ephemeral_keys_refill(running_server);
+		}
 	}
 }
 
@@ -4,8 +4,13 @@
 
 #include <WiFiServer.h>
 #include <WiFiClient.h>
+#include <FS.h>
 #include <string.h> //size_t
 
+// Implemented by the application, files the server keeps in flash are
+// opened there so their I/O is counted with the rest of flash I/O
+File homekit_file_open(const char *path, const char *mode);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,7 +24,6 @@ extern "C" {
 #include "json.h"
 #include "homekit_debug.h"
 #include "port.h"
-#include "cQueue.h"
 #include "homekit/homekit.h"
 #include "http_parser.h"
 
@@ -50,8 +54,13 @@ typedef enum {
 struct _client_context_t;
 typedef struct _client_context_t client_context_t;
 
+#ifndef HOMEKIT_SRP_SETUP_BITS
+#define HOMEKIT_SRP_SETUP_BITS 4 // exponent bits of SRP pre-init per loop, each ~13 ms
+#endif
+
 typedef struct {
 	Srp *srp;
+	crypto_srp_setup_t *srp_setup; // while pre-init is running
 	byte *public_key;
 	size_t public_key_size;
 
@@ -69,10 +78,46 @@ typedef struct {
 	size_t accessory_public_key_size;
 } pair_verify_context_t;
 
+#ifndef HOMEKIT_FRAGMENT_SIZE
+#define HOMEKIT_FRAGMENT_SIZE 48 // below 255, fits {"aid":..,"iid":..,"value":.. of any number
+#endif
+
+// Rendered ids and value of a characteristic, shared by all clients
+typedef struct {
+	homekit_value_t value; // rendered from, bool and numbers only
+	uint8_t size; // 0 when not rendered or too large
+	char json[HOMEKIT_FRAGMENT_SIZE]; // starts with the object start
+} characteristic_fragment_t;
+
+// Pair Resume is part of HAP over BLE only, IP controllers always run a full
+// pair verify. Define HOMEKIT_PAIR_RESUME to accept it anyway.
+#ifdef HOMEKIT_PAIR_RESUME
+#ifndef HOMEKIT_RESUME_SESSIONS
+#define HOMEKIT_RESUME_SESSIONS 4 // controllers that can reconnect with Pair Resume
+#endif
+#define HOMEKIT_RESUME_SESSION_ID_SIZE 8
+#define HOMEKIT_RESUME_SECRET_SIZE 32
+
+// Shared secret of a verified session, kept to resume it without key agreement
+typedef struct {
+	byte id[HOMEKIT_RESUME_SESSION_ID_SIZE];
+	byte secret[HOMEKIT_RESUME_SECRET_SIZE];
+	int pairing_id;
+	byte permissions;
+	uint32_t last_used; // 0 when free
+} resume_session_t;
+#endif
+
+#ifndef HOMEKIT_EPHEMERAL_KEYS
+#define HOMEKIT_EPHEMERAL_KEYS 2 // Curve25519 keys generated ahead of pair verify
+#endif
+
 typedef struct {
 	WiFiServer *wifi_server;
 	char accessory_id[ACCESSORY_ID_SIZE + 1];
 	ed25519_key accessory_key;
+	byte accessory_key_expanded[CRYPTO_ED25519_EXPANDED_KEY_SIZE];
+	bool accessory_key_expanded_valid; // else every signature hashes the key
 
 	homekit_server_config_t *config;
 
@@ -85,12 +130,41 @@ typedef struct {
 	int nfds;// arduino homekit uses this to record client count
 
 	client_context_t *clients;
+
+	homekit_characteristic_t **event_characteristics; // by event slot
+	uint8_t event_slots_count;
+	characteristic_fragment_t *event_fragments; // by event slot
+
+	// Frames of the client being answered, empty between responses
+	byte *tx_buffer;
+	size_t tx_size;  // laid out bytes
+	size_t tx_frame; // start of the open frame
+	client_context_t *tx_client; // whose keys seal the frames
+
+	uint32_t accessories_cache_key; // config number and database hash
+
+#ifdef HOMEKIT_PAIR_RESUME
+	resume_session_t resume_sessions[HOMEKIT_RESUME_SESSIONS]; // least recently used is replaced
+	uint32_t resume_clock;
+#endif
+
+	curve25519_key ephemeral_keys[HOMEKIT_EPHEMERAL_KEYS]; // each is used by one pair verify only
+	uint8_t ephemeral_keys_count;
 } homekit_server_t;
 
 typedef struct {
 	homekit_characteristic_t *characteristic;
 	homekit_value_t value;
-} characteristic_event_t;
+} homekit_characteristic_change_t;
+
+#define HOMEKIT_EVENT_SLOT_NONE 0xFF
+
+// Latest unsent value of one characteristic for a client
+typedef struct {
+	homekit_value_t value;
+	uint8_t next; // next dirty slot, in order of first change
+	bool dirty;
+} client_event_slot_t;
 
 struct _client_context_t {
 	homekit_server_t *server;
@@ -122,8 +196,13 @@ struct _client_context_t {
 	int count_reads;
 	int count_writes;
 
-	//QueueHandle_t event_queue;
-	Queue_t *event_queue;
+	client_event_slot_t *event_slots; // one per server event slot
+	uint8_t events_head; // dirty list
+	uint8_t events_tail;
+	uint32_t event_tokens; // 1/1000 of an EVENT message
+	uint32_t event_tokens_time;
+	uint32_t event_backoff; // ms, 0 when the link is not congested
+	uint32_t event_backoff_until;
 	pair_verify_context_t *verify_context;
 
 	homekit_client_step_t step; // WangBin added
@@ -152,9 +231,10 @@ typedef enum {
 							   // None (0x00): Regular user
 							   // Bit 1 (0x01): Admin that is able to add and remove
 							   // pairings against the accessory
-	TLVType_FragmentData = 13, // (bytes) Non-last fragment of data. If length is 0,
+	TLVType_FragmentData = 12, // (bytes) Non-last fragment of data. If length is 0,
 							   // it's an ACK.
-	TLVType_FragmentLast = 14, // (bytes) Last fragment of data
+	TLVType_FragmentLast = 13, // (bytes) Last fragment of data
+	TLVType_SessionID = 14,    // (bytes) 8 byte Pair Resume session identifier
 	TLVType_Separator = 0xff,
 } TLVType;
 
@@ -164,6 +244,7 @@ typedef enum {
 	TLVMethod_AddPairing = 3,
 	TLVMethod_RemovePairing = 4,
 	TLVMethod_ListPairings = 5,
+	TLVMethod_PairResume = 6,
 } TLVMethod;
 
 typedef enum {
@@ -212,15 +293,10 @@ typedef enum {
 	characteristic_format_meta = (1 << 2),
 	characteristic_format_perms = (1 << 3),
 	characteristic_format_events = (1 << 4),
+	characteristic_format_static = (1 << 5), // no ids, events or value, for cached database
+	characteristic_format_data = (1 << 6), // values of a data_reader, only read on request
 } characteristic_format_t;
 
-typedef struct _client_event {
-	const homekit_characteristic_t *characteristic;
-	homekit_value_t value;
-
-	struct _client_event *next;
-} client_event_t;
-
 #define ISDIGIT(x) isdigit((unsigned char)(x))
 #define ISBASE36(x) (isdigit((unsigned char)(x)) || (x >= 'A' && x <= 'Z'))
 
@@ -229,7 +305,11 @@ void arduino_homekit_setup(homekit_server_config_t *config);
 void arduino_homekit_loop();
 
 homekit_server_t * arduino_homekit_get_running_server();
+// Notify a set of changed values together, each subscribed client gets them in one EVENT
+void homekit_characteristics_notify(const homekit_characteristic_change_t *changes, size_t count);
 int arduino_homekit_connected_clients_count();
+// Percent of SRP pre-init done while unpaired, -1 when there is none
+int arduino_homekit_preinit_progress();
 void homekit_update_config_number();
 
 #ifdef __cplusplus
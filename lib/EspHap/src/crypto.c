@@ -6,11 +6,14 @@
 #include <wolfssl/wolfcrypt/curve25519.h>
 #include <wolfssl/wolfcrypt/sha512.h>
 #include <wolfssl/wolfcrypt/chacha20_poly1305.h>
+#include <wolfssl/wolfcrypt/chacha.h>
+#include <wolfssl/wolfcrypt/poly1305.h>
 #include <wolfssl/wolfcrypt/srp.h>
 #include <wolfssl/wolfcrypt/error-crypt.h>
 
 #include "homekit_debug.h"
 #include "port.h"
+#include "srp_math.h"
 #include <pgmspace.h>
 
 // 3072-bit group N (per RFC5054, Appendix A)
@@ -55,6 +58,9 @@ const byte PROGMEM N[] = {
 // 3072-bit group generator (per RFC5054, Appendix A)
 const byte g[] = {0x05};
 
+#define SRP_SALT_SIZE 16
+#define SRP_PRIVATE_KEY_SIZE (SRP_PRIVATE_KEY_MIN_BITS / 8)
+
 
 int wc_SrpSetKeyH(Srp *srp, byte *secret, word32 size) {
     SrpHash hash;
@@ -98,11 +104,7 @@ void crypto_srp_free(Srp *srp) {
 }
 
 
-int crypto_srp_init(Srp *srp, const char *username, const char *password) {
-    DEBUG("Generating salt");
-    byte salt[16];
-    homekit_random_fill(salt, sizeof(salt));
-
+static int crypto_srp_set_credentials(Srp *srp, const char *username, const char *password, const byte *salt) {
     int r;
     DEBUG("Setting SRP username");
     r = wc_SrpSetUsername(srp, (byte*)username, strlen(username));
@@ -115,7 +117,7 @@ int crypto_srp_init(Srp *srp, const char *username, const char *password) {
     // Ref: https://arduino-esp8266.readthedocs.io/en/2.6.3/PROGMEM.html
 	byte N_ram[N_SIZE];
 	memcpy_P(N_ram, N, N_SIZE);
-    r = wc_SrpSetParams(srp, N_ram, N_SIZE, g, sizeof(g), salt, sizeof(salt));
+    r = wc_SrpSetParams(srp, N_ram, N_SIZE, g, sizeof(g), salt, SRP_SALT_SIZE);
     if (r) {
         DEBUG("Failed to set SRP params (code %d)", r);
         return r;
@@ -128,6 +130,19 @@ int crypto_srp_init(Srp *srp, const char *username, const char *password) {
         return r;
     }
 
+    return 0;
+}
+
+
+int crypto_srp_init(Srp *srp, const char *username, const char *password) {
+    DEBUG("Generating salt");
+    byte salt[SRP_SALT_SIZE];
+    homekit_random_fill(salt, sizeof(salt));
+
+    int r = crypto_srp_set_credentials(srp, username, password, salt);
+    if (r)
+        return r;
+
     DEBUG("Getting SRP verifier");
     word32 verifierLen = 1024;
     byte *verifier = malloc(verifierLen);
@@ -153,6 +168,314 @@ int crypto_srp_init(Srp *srp, const char *username, const char *password) {
 }
 
 
+typedef enum {
+    srp_setup_verifier = 0, // v = g^x % N
+    srp_setup_public_key,   // B = k*v + g^b % N
+    srp_setup_done,
+} srp_setup_stage_t;
+
+typedef struct crypto_srp_setup {
+    Srp *srp;
+    srp_setup_stage_t stage;
+
+    // g^e % N in Montgomery form, one exponent bit per step from the top
+    srp_mont_t mont;
+    srp_num_t result;
+    byte exponent[N_SIZE];
+    size_t exponent_size;
+    int bit;
+
+    int bits_done;
+    int bits_total;
+
+    byte public_key[N_SIZE];
+    size_t public_key_size;
+} crypto_srp_setup_t;
+
+
+static int srp_setup_exptmod_start(crypto_srp_setup_t *setup, mp_int *exponent) {
+    // g is a single digit, multiplying by it needs no reduction but a few subtractions
+    if (setup->srp->g.used != 1)
+        return BAD_FUNC_ARG;
+
+    int size = mp_unsigned_bin_size(exponent);
+    if (size < 0 || (size_t) size > sizeof(setup->exponent))
+        return BUFFER_E;
+
+    int r = mp_to_unsigned_bin(exponent, setup->exponent);
+    setup->exponent_size = size;
+    setup->bit = mp_count_bits(exponent) - 1;
+    srp_mont_one(&setup->mont, &setup->result);
+    return r;
+}
+
+
+static void srp_setup_exptmod_step(crypto_srp_setup_t *setup) {
+    srp_mont_mul(&setup->mont, &setup->result, &setup->result, &setup->result);
+
+    const byte *exponent = setup->exponent + setup->exponent_size - 1 - setup->bit / 8;
+    if ((*exponent >> (setup->bit % 8)) & 1)
+        srp_mont_mul_digit(&setup->mont, &setup->result, setup->srp->g.dp[0]);
+
+    setup->bit--;
+    setup->bits_done++;
+}
+
+
+static int srp_setup_finish_verifier(crypto_srp_setup_t *setup) {
+    Srp *srp = setup->srp;
+    srp_mont_from(&setup->mont, &setup->result);
+
+    byte verifier[N_SIZE];
+    srp_num_to_bytes(&setup->result, verifier);
+    size_t verifier_size = srp_num_size(&setup->result);
+
+    srp->side = SRP_SERVER_SIDE;
+    DEBUG("Setting SRP verifier");
+    int r = wc_SrpSetVerifier(srp, verifier + N_SIZE - verifier_size, verifier_size);
+    if (r)
+        DEBUG("Failed to set SRP verifier (code %d)", r);
+
+    memset(verifier, 0, sizeof(verifier));
+    return r;
+}
+
+
+// b is new for every setup, a saved verifier must not make B predictable
+static int srp_setup_start_public_key(crypto_srp_setup_t *setup) {
+    byte private_key[SRP_PRIVATE_KEY_SIZE];
+    homekit_random_fill(private_key, sizeof(private_key));
+    int r = wc_SrpSetPrivate(setup->srp, private_key, sizeof(private_key));
+    memset(private_key, 0, sizeof(private_key));
+
+    if (!r) r = srp_setup_exptmod_start(setup, &setup->srp->priv);
+    setup->stage = srp_setup_public_key;
+    return r;
+}
+
+
+static int srp_setup_finish_public_key(crypto_srp_setup_t *setup) {
+    Srp *srp = setup->srp;
+    srp_mont_from(&setup->mont, &setup->result);
+    srp_num_to_bytes(&setup->result, setup->public_key);
+
+    mp_int i, j, B;
+    int r = mp_init_multi(&i, &j, &B, 0, 0, 0);
+    if (r)
+        return r;
+
+    r = mp_read_unsigned_bin(&i, srp->k, WC_SHA512_DIGEST_SIZE);
+    if (!r) r = mp_iszero(&i) == MP_YES ? SRP_BAD_KEY_E : 0;
+    if (!r) r = mp_mulmod(&i, &srp->auth, &srp->N, &j);
+    if (!r) r = mp_read_unsigned_bin(&B, setup->public_key, N_SIZE);
+    if (!r) r = mp_add(&j, &B, &i);
+    if (!r) r = mp_mod(&i, &srp->N, &B);
+
+    memset(setup->public_key, 0, sizeof(setup->public_key));
+    if (!r) r = mp_to_unsigned_bin(&B, setup->public_key);
+    if (!r) setup->public_key_size = mp_unsigned_bin_size(&B);
+
+    mp_clear(&i);
+    mp_clear(&j);
+    mp_clear(&B);
+    return r;
+}
+
+
+void crypto_srp_setup_free(crypto_srp_setup_t *setup) {
+    if (!setup)
+        return;
+
+    memset(setup, 0, sizeof(*setup));
+    free(setup);
+}
+
+
+static crypto_srp_setup_t *crypto_srp_setup_alloc(Srp *srp) {
+    crypto_srp_setup_t *setup = calloc(1, sizeof(crypto_srp_setup_t));
+    if (!setup)
+        return NULL;
+
+    setup->srp = srp;
+
+    byte N_ram[N_SIZE];
+    memcpy_P(N_ram, N, N_SIZE);
+    if (srp_mont_init(&setup->mont, N_ram, N_SIZE)) {
+        free(setup);
+        return NULL;
+    }
+    return setup;
+}
+
+
+crypto_srp_setup_t *crypto_srp_setup_new(Srp *srp, const char *username, const char *password) {
+    crypto_srp_setup_t *setup = crypto_srp_setup_alloc(srp);
+    if (!setup)
+        return NULL;
+
+    DEBUG("Generating salt");
+    byte salt[SRP_SALT_SIZE];
+    homekit_random_fill(salt, sizeof(salt));
+    int r = crypto_srp_set_credentials(srp, username, password, salt);
+
+    if (!r) {
+        // b is drawn once the verifier is done, its size is known up front
+        setup->bits_total = mp_count_bits(&srp->auth) + SRP_PRIVATE_KEY_SIZE * 8;
+        r = srp_setup_exptmod_start(setup, &srp->auth);
+    }
+
+    if (r) {
+        DEBUG("Failed to start SRP setup (code %d)", r);
+        crypto_srp_setup_free(setup);
+        return NULL;
+    }
+
+    return setup;
+}
+
+
+int crypto_srp_setup_step(crypto_srp_setup_t *setup, unsigned max_bits) {
+    int r = 0;
+    while (!r && setup->stage != srp_setup_done && max_bits) {
+        if (setup->bit >= 0) {
+            srp_setup_exptmod_step(setup);
+            max_bits--;
+            continue;
+        }
+
+        if (setup->stage == srp_setup_verifier) {
+            r = srp_setup_finish_verifier(setup);
+            if (!r) r = srp_setup_start_public_key(setup);
+        } else {
+            r = srp_setup_finish_public_key(setup);
+            setup->stage = srp_setup_done;
+        }
+    }
+
+    if (r) {
+        DEBUG("SRP setup failed (code %d)", r);
+        return r < 0 ? r : -r;
+    }
+    return setup->stage != srp_setup_done;
+}
+
+
+int crypto_srp_setup_progress(const crypto_srp_setup_t *setup) {
+    if (setup->stage == srp_setup_done)
+        return 100;
+    if (!setup->bits_total)
+        return 0;
+    return setup->bits_done * 100 / (setup->bits_total + 1);
+}
+
+
+int crypto_srp_setup_get_public_key(const crypto_srp_setup_t *setup, byte *buffer, size_t *buffer_size) {
+    if (buffer_size == NULL)
+        return -1;
+
+    if (setup->stage != srp_setup_done)
+        return -3;
+
+    if (*buffer_size < setup->public_key_size) {
+        *buffer_size = setup->public_key_size;
+        return -2;
+    }
+
+    memcpy(buffer, setup->public_key, setup->public_key_size);
+    *buffer_size = setup->public_key_size;
+    return 0;
+}
+
+
+typedef struct {
+    byte check[32]; // SHA-512 of salt and password, truncated
+    byte salt[SRP_SALT_SIZE];
+    byte verifier[N_SIZE];
+} crypto_srp_state_t;
+
+
+static int crypto_srp_state_check(const byte *salt, const char *password, byte *check) {
+    wc_Sha512 sha;
+    byte digest[WC_SHA512_DIGEST_SIZE];
+
+    int r = wc_InitSha512(&sha);
+    if (!r) r = wc_Sha512Update(&sha, salt, SRP_SALT_SIZE);
+    if (!r) r = wc_Sha512Update(&sha, (const byte *)password, strlen(password));
+    if (!r) r = wc_Sha512Final(&sha, digest);
+    if (!r) memcpy(check, digest, sizeof(((crypto_srp_state_t *)0)->check));
+
+    memset(&sha, 0, sizeof(sha));
+    memset(digest, 0, sizeof(digest));
+    return r;
+}
+
+
+// Numbers are stored left padded to the field size
+static int crypto_srp_state_put(mp_int *a, byte *buffer, size_t size) {
+    int a_size = mp_unsigned_bin_size(a);
+    if (a_size < 0 || (size_t)a_size > size)
+        return BUFFER_E;
+
+    memset(buffer, 0, size - a_size);
+    return mp_to_unsigned_bin(a, buffer + size - a_size);
+}
+
+
+int crypto_srp_setup_export(const crypto_srp_setup_t *setup, const char *password, byte *buffer) {
+    crypto_srp_state_t *state = (crypto_srp_state_t *)buffer;
+    Srp *srp = setup->srp;
+    if (setup->stage != srp_setup_done || srp->saltSz != SRP_SALT_SIZE)
+        return BAD_FUNC_ARG;
+
+    memcpy(state->salt, srp->salt, SRP_SALT_SIZE);
+
+    int r = crypto_srp_state_check(state->salt, password, state->check);
+    if (!r) r = crypto_srp_state_put(&srp->auth, state->verifier, N_SIZE);
+    if (r)
+        DEBUG("Failed to export SRP state (code %d)", r);
+
+    return r;
+}
+
+
+int crypto_srp_setup_restore(Srp *srp, const char *username, const char *password, const byte *buffer,
+                             crypto_srp_setup_t **result) {
+    const crypto_srp_state_t *state = (const crypto_srp_state_t *)buffer;
+
+    byte check[sizeof(state->check)];
+    int r = crypto_srp_state_check(state->salt, password, check);
+    if (r)
+        return r < 0 ? r : -r;
+    if (memcmp(check, state->check, sizeof(check))) {
+        DEBUG("Saved SRP state is for another setup code");
+        return -1;
+    }
+
+    crypto_srp_setup_t *setup = crypto_srp_setup_alloc(srp);
+    if (!setup)
+        return MEMORY_E;
+
+    r = crypto_srp_set_credentials(srp, username, password, state->salt);
+    if (!r) {
+        srp->side = SRP_SERVER_SIDE;
+        r = wc_SrpSetVerifier(srp, state->verifier, N_SIZE);
+    }
+    if (!r) {
+        setup->bits_total = SRP_PRIVATE_KEY_SIZE * 8;
+        r = srp_setup_start_public_key(setup);
+    }
+
+    if (r) {
+        DEBUG("Failed to restore SRP setup (code %d)", r);
+        crypto_srp_setup_free(setup);
+        return r < 0 ? r : -r;
+    }
+
+    *result = setup;
+    return 0;
+}
+
+
 int crypto_srp_get_salt(Srp *srp, byte *buffer, size_t *buffer_size) {
     if (buffer_size == NULL)
         return -1;
@@ -162,7 +485,9 @@ int crypto_srp_get_salt(Srp *srp, byte *buffer, size_t *buffer_size) {
         return -2;
     }
 
-    memcpy(buffer, srp->salt, srp->saltSz);
+    // a refused restore leaves the salt unset
+    if (srp->saltSz)
+        memcpy(buffer, srp->salt, srp->saltSz);
     *buffer_size = srp->saltSz;
     return 0;
 }
@@ -277,12 +602,67 @@ int crypto_srp_hkdf(
 }
 
 
+// Zeros up to the next 16 bytes after size bytes of data
+static int crypto_poly1305_pad(Poly1305 *poly1305, size_t size) {
+    static const byte zeros[16] = { 0 };
+    return size % 16 ? wc_Poly1305Update(poly1305, zeros, 16 - size % 16) : 0;
+}
+
+
+// ChaCha20-Poly1305 (RFC 8439) in a single pass: every 64-byte keystream
+// block is applied and its ciphertext fed to Poly1305 while still in cache.
+// Block 0 of the same counter gives the one-time Poly1305 key.
+static int crypto_chacha20poly1305_process(
+    const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
+    const byte *input, byte *output, size_t size, bool encrypt, byte *tag
+) {
+    ChaCha chacha;
+    Poly1305 poly1305;
+    byte block[CHACHA_CHUNK_BYTES];
+    memset(block, 0, sizeof(block));
+
+    int r = wc_Chacha_SetKey(&chacha, key, CHACHA20_POLY1305_AEAD_KEYSIZE);
+    if (!r) r = wc_Chacha_SetIV(&chacha, nonce, 0);
+    if (!r) r = wc_Chacha_Process(&chacha, block, block, sizeof(block));
+    if (!r) r = wc_Poly1305SetKey(&poly1305, block, CHACHA20_POLY1305_AEAD_KEYSIZE);
+    if (!r && aad_size) r = wc_Poly1305Update(&poly1305, aad, aad_size);
+    if (!r) r = crypto_poly1305_pad(&poly1305, aad_size);
+
+    for (size_t offset = 0; !r && offset < size; offset += CHACHA_CHUNK_BYTES) {
+        word32 chunk = size - offset < CHACHA_CHUNK_BYTES ? size - offset : CHACHA_CHUNK_BYTES;
+        if (!encrypt)
+            r = wc_Poly1305Update(&poly1305, input + offset, chunk);
+        if (!r) r = wc_Chacha_Process(&chacha, output + offset, input + offset, chunk);
+        if (!r && encrypt)
+            r = wc_Poly1305Update(&poly1305, output + offset, chunk);
+    }
+
+    if (!r) r = crypto_poly1305_pad(&poly1305, size);
+
+    // both lengths as 64-bit little endian
+    byte lengths[16];
+    memset(lengths, 0, sizeof(lengths));
+    for (int i = 0; i < 4; i++) {
+        lengths[i] = (uint32_t) aad_size >> (8 * i);
+        lengths[8 + i] = (uint32_t) size >> (8 * i);
+    }
+    if (!r) r = wc_Poly1305Update(&poly1305, lengths, sizeof(lengths));
+    if (!r) r = wc_Poly1305Final(&poly1305, tag);
+
+    memset(block, 0, sizeof(block));
+    memset(&chacha, 0, sizeof(chacha));
+    memset(&poly1305, 0, sizeof(poly1305));
+    return r;
+}
+
+
 int crypto_chacha20poly1305_decrypt(
     const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
     const byte *message, size_t message_size,
     byte *decrypted, size_t *decrypted_size
 ) {
-    if (message_size <= CHACHA20_POLY1305_AEAD_AUTHTAG_SIZE) { 
+    // a tag alone is an empty message, HAP sends those as frames
+    if (message_size < CHACHA20_POLY1305_AEAD_AUTHTAG_SIZE) {
         DEBUG("Decrypted message is too small");
         return -2;
     }
@@ -298,11 +678,18 @@ int crypto_chacha20poly1305_decrypt(
 
     *decrypted_size = len;
 
-    int r = wc_ChaCha20Poly1305_Decrypt(
-        key, nonce, aad, aad_size,
-        message, len, &message[len],
-        decrypted
-    );
+    byte tag[CHACHA20_POLY1305_AEAD_AUTHTAG_SIZE];
+    int r = crypto_chacha20poly1305_process(key, nonce, aad, aad_size, message, decrypted, len, false, tag);
+
+    byte diff = 0;
+    for (size_t i = 0; i < sizeof(tag); i++)
+        diff |= tag[i] ^ message[len + i];
+    if (!r && diff)
+        r = MAC_CMP_FAILED_E;
+
+    // decrypted in the same pass, so a forged message is wiped afterwards
+    if (r)
+        memset(decrypted, 0, len);
 
     return r;
 }
@@ -323,13 +710,14 @@ int crypto_chacha20poly1305_encrypt(
 
     *encrypted_size = len;
 
-    int r = wc_ChaCha20Poly1305_Encrypt(
-        key, nonce, aad, aad_size,
-        message, message_size,
-        encrypted, encrypted+message_size
-    );
+    return crypto_chacha20poly1305_process(key, nonce, aad, aad_size, message, encrypted, message_size, true,
+                                           encrypted + message_size);
+}
 
-    return r;
+
+int crypto_chacha20poly1305_empty_tag(const byte *key, const byte *nonce, byte *tag) {
+    // the tag is Poly1305 over both zero lengths
+    return crypto_chacha20poly1305_process(key, nonce, NULL, 0, NULL, NULL, 0, true, tag);
 }
 
 
@@ -418,8 +806,13 @@ int crypto_ed25519_export_public_key(const ed25519_key *key, byte *buffer, size_
 }
 
 
-int crypto_ed25519_sign(
-    const ed25519_key *key,
+int crypto_ed25519_expand_key(const ed25519_key *key, byte *expanded) {
+    return wc_ed25519_expand_private((ed25519_key *)key, expanded);
+}
+
+
+int crypto_ed25519_sign_expanded(
+    const ed25519_key *key, const byte *expanded,
     const byte *message, size_t message_size,
     byte *signature, size_t *signature_size
 ) {
@@ -441,16 +834,34 @@ int crypto_ed25519_sign(
 
     word32 len = *signature_size;
 
-    int r = wc_ed25519_sign_msg(
-        message, message_size,
-        signature, &len,
-        (ed25519_key *)key
-    );
+    int r;
+    if (expanded) {
+        r = wc_ed25519_sign_msg_expanded(
+            message, message_size,
+            signature, &len,
+            (ed25519_key *)key, expanded
+        );
+    } else {
+        r = wc_ed25519_sign_msg(
+            message, message_size,
+            signature, &len,
+            (ed25519_key *)key
+        );
+    }
     *signature_size = len;
     return r;
 }
 
 
+int crypto_ed25519_sign(
+    const ed25519_key *key,
+    const byte *message, size_t message_size,
+    byte *signature, size_t *signature_size
+) {
+    return crypto_ed25519_sign_expanded(key, NULL, message, message_size, signature, signature_size);
+}
+
+
 int crypto_ed25519_verify(
     const ed25519_key *key,
     const byte *message, size_t message_size,
@@ -471,8 +882,35 @@ int crypto_ed25519_verify(
         message, message_size,
         &verified, (ed25519_key *)key
     );
-    //return (r == 0) && (verified == 1);
-    return !r && !verified;
+    // a bad signature is reported as SIG_VERIFY_E, not only by verified
+    return r ? r : !verified;
+#endif
+}
+
+
+int crypto_ed25519_decode_public_key(const ed25519_key *key, ge_p3 *point) {
+    return wc_ed25519_decode_public((ed25519_key *)key, point);
+}
+
+
+int crypto_ed25519_verify_decoded(
+    const ed25519_key *key, const ge_p3 *point,
+    const byte *message, size_t message_size,
+    const byte *signature, size_t signature_size
+) {
+#if defined(ARDUINO_HOMEKIT_SKIP_ED25519_VERIFY)
+	return 0;
+#else
+#if defined(ARDUINO_HOMEKIT_LOWROM)
+    yield();
+#endif
+    int verified;
+    int r = wc_ed25519_verify_msg_decoded(
+        signature, signature_size,
+        message, message_size,
+        &verified, (ed25519_key *)key, point
+    );
+    return r ? r : !verified;
 #endif
 }
 
@@ -45,6 +45,30 @@ int crypto_srp_init(Srp *srp, const char *username, const char *password);
 int crypto_srp_get_salt(Srp *srp, byte *buffer, size_t *buffer_length);
 int crypto_srp_get_public_key(Srp *srp, byte *buffer, size_t *buffer_length);
 
+// Same as crypto_srp_init and crypto_srp_get_public_key, but resumable: the
+// verifier and public key exponentiations run a few exponent bits per step
+struct crypto_srp_setup;
+typedef struct crypto_srp_setup crypto_srp_setup_t;
+
+crypto_srp_setup_t *crypto_srp_setup_new(Srp *srp, const char *username, const char *password);
+void crypto_srp_setup_free(crypto_srp_setup_t *setup);
+// Returns 1 while there is work left, 0 when done, negative on error
+int crypto_srp_setup_step(crypto_srp_setup_t *setup, unsigned max_bits);
+// 0 to 100
+int crypto_srp_setup_progress(const crypto_srp_setup_t *setup);
+int crypto_srp_setup_get_public_key(const crypto_srp_setup_t *setup, byte *buffer, size_t *buffer_length);
+
+// Salt and verifier of a finished setup, bound to the password by a hash. A fixed
+// setup code then skips the verifier exponentiation after a reboot, the private
+// and public key are never saved and are new for every setup.
+#define CRYPTO_SRP_STATE_SIZE (32 + 16 + 384)
+
+int crypto_srp_setup_export(const crypto_srp_setup_t *setup, const char *password, byte *buffer);
+// Starts a setup at the public key from an exported state. Returns -1 without
+// touching srp when the state is for another password.
+int crypto_srp_setup_restore(Srp *srp, const char *username, const char *password, const byte *buffer,
+                             crypto_srp_setup_t **setup);
+
 int crypto_srp_compute_key(
     Srp *srp,
     const byte *client_public_key, size_t client_public_key_size,
@@ -70,6 +94,8 @@ int crypto_chacha20poly1305_decrypt(
     const byte *message, size_t message_size,
     byte *decrypted, size_t *descrypted_size
 );
+// Auth tag of an empty message without aad, as used by Pair Resume
+int crypto_chacha20poly1305_empty_tag(const byte *key, const byte *nonce, byte *tag);
 
 // ED25519
 int crypto_ed25519_init(ed25519_key *key);
@@ -100,11 +126,27 @@ int crypto_ed25519_sign(
     const byte *message, size_t message_size,
     byte *signature, size_t *signature_size
 );
+// Hashed and clamped private key, to sign without hashing it every time
+#define CRYPTO_ED25519_EXPANDED_KEY_SIZE 64
+int crypto_ed25519_expand_key(const ed25519_key *key, byte *expanded);
+// expanded may be NULL, then the key is expanded for this signature only
+int crypto_ed25519_sign_expanded(
+    const ed25519_key *key, const byte *expanded,
+    const byte *message, size_t message_size,
+    byte *signature, size_t *signature_size
+);
 int crypto_ed25519_verify(
     const ed25519_key *key,
     const byte *message, size_t message_size,
     const byte *signature, size_t signature_size
 );
+// Decompressed public key, to verify without decoding it every time
+int crypto_ed25519_decode_public_key(const ed25519_key *key, ge_p3 *point);
+int crypto_ed25519_verify_decoded(
+    const ed25519_key *key, const ge_p3 *point,
+    const byte *message, size_t message_size,
+    const byte *signature, size_t signature_size
+);
 
 
 // CURVE25519
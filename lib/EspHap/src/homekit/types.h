@@ -210,10 +210,15 @@ struct _homekit_characteristic {
     homekit_value_t (*getter)();
     void (*setter)(const homekit_value_t);
     homekit_characteristic_change_callback_t *callback;
+    uint8_t event_slot; // index in per client event table, set by server
 
     homekit_value_t (*getter_ex)(const homekit_characteristic_t *ch);
     void (*setter_ex)(homekit_characteristic_t *ch, const homekit_value_t value);
 
+    // Optional for data format, value is read in pieces straight into the response.
+    // Returns bytes copied, less than size only at the end.
+    size_t (*data_reader)(const homekit_characteristic_t *ch, size_t offset, uint8_t *buffer, size_t size);
+
     void *context;
 };
 
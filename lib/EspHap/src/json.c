@@ -2,7 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include "json.h"
+#include "base64.h"
 
 #include "homekit_debug.h"
 
@@ -96,6 +98,38 @@ void json_write(json_stream *json, const char *format, ...) {
     }
 }
 
+void json_raw(json_stream *json, const uint8_t *data, size_t size) {
+    while (size) {
+        if (json->pos == json->size) {
+            json_flush(json);
+        }
+        size_t part = json->size - json->pos;
+        if (part > size)
+            part = size;
+        memcpy(json->buffer + json->pos, data, part);
+        json->pos += part;
+        data += part;
+        size -= part;
+    }
+}
+
+void json_object_resume(json_stream *json) {
+    json->state = JSON_STATE_OBJECT_VALUE;
+    json->nesting_idx = 0;
+    json->nesting[json->nesting_idx++] = JSON_NESTING_OBJECT;
+}
+
+void json_object_suspend(json_stream *json) {
+    json->nesting_idx = 0;
+    json->state = JSON_STATE_END;
+}
+
+void json_reset(json_stream *json) {
+    json->pos = 0;
+    json->state = JSON_STATE_START;
+    json->nesting_idx = 0;
+}
+
 void json_object_start(json_stream *json) {
     if (json->state == JSON_STATE_ERROR)
         return;
@@ -118,6 +152,15 @@ void json_object_start(json_stream *json) {
     }
 }
 
+void json_object_start_raw(json_stream *json, const uint8_t *members, size_t size) {
+    json_object_start(json);
+    if (json->state != JSON_STATE_OBJECT || !size)
+        return;
+
+    json_raw(json, members, size);
+    json->state = JSON_STATE_OBJECT_VALUE;
+}
+
 void json_object_end(json_stream *json) {
     if (json->state == JSON_STATE_ERROR)
         return;
@@ -273,18 +316,48 @@ void json_integer(json_stream *json, int x) {
 
 void json_float(json_stream *json, float x) {
     char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%1.6", x);
+    snprintf(buffer, sizeof(buffer), "%1.6g", x);
 
     _json_number(json, buffer);
 }
 
+// Quotes, backslashes and control characters are escaped, the latter as \u00XX
+// so no byte below 0x20 is ever part of the output
+static void json_write_escaped(json_stream *json, const char *x) {
+    static const char hex[] = "0123456789abcdef";
+
+    json_raw(json, (const uint8_t *)"\"", 1);
+    const char *start = x;
+    for (; *x; x++) {
+        unsigned char c = *x;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        json_raw(json, (const uint8_t *)start, x - start);
+        start = x + 1;
+
+        char escape[6] = { '\\', c, 0 };
+        size_t size = 2;
+        if (c < 0x20) {
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0xf];
+            size = 6;
+        }
+        json_raw(json, (const uint8_t *)escape, size);
+    }
+    json_raw(json, (const uint8_t *)start, x - start);
+    json_raw(json, (const uint8_t *)"\"", 1);
+}
+
 void json_string(json_stream *json, const char *x) {
     if (json->state == JSON_STATE_ERROR)
         return;
 
     void _do_write() {
-        // TODO: escape string
-        json_write(json, "\"%s\"", x);
+        json_write_escaped(json, x ? x : "");
     }
 
     switch (json->state) {
@@ -316,6 +389,50 @@ void json_string(json_stream *json, const char *x) {
     }
 }
 
+// Base64 string value encoded piece by piece, data is never held in full
+void json_base64(json_stream *json, json_data_source source, void *context) {
+    if (json->state == JSON_STATE_ERROR)
+        return;
+
+    void _do_write() {
+        uint8_t data[48]; // multiple of 3, no padding until the end
+        unsigned char encoded[65];
+
+        json_write(json, "\"");
+        size_t size;
+        do {
+            size = source(data, sizeof(data), context);
+            if (size) {
+                int encoded_size = base64_encode_(data, size, encoded);
+                encoded[encoded_size] = 0;
+                json_write(json, "%s", encoded);
+            }
+        } while (size == sizeof(data));
+        json_write(json, "\"");
+    }
+
+    switch (json->state) {
+        case JSON_STATE_START:
+            _do_write();
+            json->state = JSON_STATE_END;
+            break;
+        case JSON_STATE_ARRAY_ITEM:
+            json_write(json, ",");
+        case JSON_STATE_ARRAY:
+            _do_write();
+            json->state = JSON_STATE_ARRAY_ITEM;
+            break;
+        case JSON_STATE_OBJECT_KEY:
+            _do_write();
+            json->state = JSON_STATE_OBJECT_VALUE;
+            break;
+        default:
+            ERROR("Unexpected base64 value");
+            DEBUG_STATE(json);
+            json->state = JSON_STATE_ERROR;
+    }
+}
+
 void json_boolean(json_stream *json, bool x) {
     if (json->state == JSON_STATE_ERROR)
         return;
@@ -10,12 +10,25 @@ struct json_stream;
 typedef struct json_stream json_stream;
 
 typedef void (*json_flush_callback)(uint8_t *buffer, size_t size, void *context);
+// Fills buffer with next part of data, returns less than size only at the end
+typedef size_t (*json_data_source)(uint8_t *buffer, size_t size, void *context);
 
 json_stream *json_new(size_t buffer_size, json_flush_callback on_flush, void *context);
 void json_free(json_stream *json);
 
 void json_flush(json_stream *json);
 
+// Pre-rendered json written as is, state is not changed
+void json_raw(json_stream *json, const uint8_t *data, size_t size);
+// Continue inside an object whose start and members were written raw
+void json_object_resume(json_stream *json);
+// Leave such an object without writing its end, the end follows raw
+void json_object_suspend(json_stream *json);
+// Object start followed by pre-rendered members, more members may follow
+void json_object_start_raw(json_stream *json, const uint8_t *members, size_t size);
+// Drops unflushed output and starts a new document on the same buffer
+void json_reset(json_stream *json);
+
 void json_object_start(json_stream *json);
 void json_object_end(json_stream *json);
 
@@ -29,6 +42,7 @@ void json_uint32(json_stream *json, uint32_t x);
 void json_uint64(json_stream *json, uint64_t x);
 void json_float(json_stream *json, float x);
 void json_string(json_stream *json, const char *x);
+void json_base64(json_stream *json, json_data_source source, void *context);
 void json_boolean(json_stream *json, bool x);
 void json_null(json_stream *json);
 
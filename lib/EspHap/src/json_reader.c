@@ -0,0 +1,280 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_reader.h"
+
+#define JSON_READER_MAX_DEPTH 32 // one bit per level when skipping
+#define JSON_READER_MAX_NUMBER 32
+
+
+void json_reader_init(json_reader *reader, const char *data, size_t size) {
+    reader->pos = data;
+    reader->end = data + size;
+}
+
+static void json_reader_skip_whitespace(json_reader *reader) {
+    while (reader->pos < reader->end) {
+        char c = *reader->pos;
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            break;
+        reader->pos++;
+    }
+}
+
+bool json_reader_next(json_reader *reader, char c) {
+    json_reader_skip_whitespace(reader);
+    if (reader->pos < reader->end && *reader->pos == c) {
+        reader->pos++;
+        return true;
+    }
+    return false;
+}
+
+bool json_reader_at_end(json_reader *reader) {
+    json_reader_skip_whitespace(reader);
+    return reader->pos == reader->end || !*reader->pos;
+}
+
+bool json_reader_string(json_reader *reader, const char **string, size_t *size, bool *escaped) {
+    if (!json_reader_next(reader, '"'))
+        return false;
+
+    const char *start = reader->pos;
+    bool has_escape = false;
+    while (reader->pos < reader->end) {
+        char c = *reader->pos++;
+        if (c == '"') {
+            *string = start;
+            *size = reader->pos - 1 - start;
+            if (escaped)
+                *escaped = has_escape;
+            return true;
+        }
+        if ((unsigned char) c < 0x20)
+            return false;
+        if (c == '\\') {
+            if (reader->pos == reader->end)
+                return false;
+            reader->pos++;
+            has_escape = true;
+        }
+    }
+    return false;
+}
+
+bool json_reader_key(json_reader *reader, const char **key, size_t *size) {
+    return json_reader_string(reader, key, size, NULL) && json_reader_next(reader, ':');
+}
+
+static bool json_reader_literal(json_reader *reader, const char *literal) {
+    size_t size = strlen(literal);
+    if ((size_t) (reader->end - reader->pos) < size || strncmp(reader->pos, literal, size))
+        return false;
+    reader->pos += size;
+    return true;
+}
+
+static bool json_reader_number(json_reader *reader, double *number) {
+    const char *start = reader->pos;
+    while (reader->pos < reader->end) {
+        char c = *reader->pos;
+        if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        reader->pos++;
+    }
+
+    size_t size = reader->pos - start;
+    if (!size || size >= JSON_READER_MAX_NUMBER)
+        return false;
+
+    // input is not terminated, strtod works on a copy
+    char buffer[JSON_READER_MAX_NUMBER];
+    memcpy(buffer, start, size);
+    buffer[size] = 0;
+
+    char *number_end;
+    *number = strtod(buffer, &number_end);
+    return number_end == buffer + size;
+}
+
+static bool json_reader_skip_container(json_reader *reader) {
+    uint32_t arrays = 0; // bit set for array, clear for object
+    uint8_t depth = 0;
+
+    do {
+        json_reader_skip_whitespace(reader);
+        if (reader->pos == reader->end)
+            return false;
+
+        char c = *reader->pos;
+        if (c == '"') {
+            const char *string;
+            size_t size;
+            if (!json_reader_string(reader, &string, &size, NULL))
+                return false;
+            continue;
+        }
+
+        reader->pos++;
+        if (c == '{' || c == '[') {
+            if (depth == JSON_READER_MAX_DEPTH)
+                return false;
+            if (c == '[')
+                arrays |= (1UL << depth);
+            else
+                arrays &= ~(1UL << depth);
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (!depth)
+                return false;
+            depth--;
+            if (!(arrays & (1UL << depth)) != (c == '}'))
+                return false;
+        }
+    } while (depth);
+
+    return true;
+}
+
+bool json_reader_value(json_reader *reader, json_token *token) {
+    json_reader_skip_whitespace(reader);
+    if (reader->pos == reader->end)
+        return false;
+
+    token->number = 0;
+    token->string = NULL;
+    token->string_size = 0;
+    token->string_escaped = false;
+
+    switch (*reader->pos) {
+        case '"':
+            token->type = json_token_string;
+            return json_reader_string(reader, &token->string, &token->string_size,
+                                      &token->string_escaped);
+        case '{':
+        case '[':
+            token->type = json_token_container;
+            return json_reader_skip_container(reader);
+        case 't':
+            token->type = json_token_true;
+            token->number = 1;
+            return json_reader_literal(reader, "true");
+        case 'f':
+            token->type = json_token_false;
+            return json_reader_literal(reader, "false");
+        case 'n':
+            token->type = json_token_null;
+            return json_reader_literal(reader, "null");
+        default:
+            token->type = json_token_number;
+            return json_reader_number(reader, &token->number);
+    }
+}
+
+bool json_token_key_equals(const char *key, size_t size, const char *name) {
+    return strlen(name) == size && !strncmp(key, name, size);
+}
+
+static int json_hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool json_read_hex4(const char *s, const char *end, uint32_t *value) {
+    if (end - s < 4)
+        return false;
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = json_hex_digit(s[i]);
+        if (digit < 0)
+            return false;
+        *value = (*value << 4) | digit;
+    }
+    return true;
+}
+
+static char *json_write_utf8(char *out, uint32_t code) {
+    if (code < 0x80) {
+        *out++ = code;
+    } else if (code < 0x800) {
+        *out++ = 0xC0 | (code >> 6);
+        *out++ = 0x80 | (code & 0x3F);
+    } else if (code < 0x10000) {
+        *out++ = 0xE0 | (code >> 12);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    } else {
+        *out++ = 0xF0 | (code >> 18);
+        *out++ = 0x80 | ((code >> 12) & 0x3F);
+        *out++ = 0x80 | ((code >> 6) & 0x3F);
+        *out++ = 0x80 | (code & 0x3F);
+    }
+    return out;
+}
+
+char *json_token_strdup(const json_token *token) {
+    if (token->type != json_token_string)
+        return NULL;
+
+    // unescaped text is never longer than its escaped form
+    char *result = malloc(token->string_size + 1);
+    if (!result)
+        return NULL;
+
+    if (!token->string_escaped) {
+        memcpy(result, token->string, token->string_size);
+        result[token->string_size] = 0;
+        return result;
+    }
+
+    const char *s = token->string;
+    const char *end = s + token->string_size;
+    char *out = result;
+    while (s < end) {
+        char c = *s++;
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+
+        c = *s++;
+        switch (c) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!json_read_hex4(s, end, &code))
+                    goto error;
+                s += 4;
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - s < 6 || s[0] != '\\' || s[1] != 'u'
+                            || !json_read_hex4(s + 2, end, &low)
+                            || low < 0xDC00 || low > 0xDFFF)
+                        goto error;
+                    s += 6;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                out = json_write_utf8(out, code);
+                break;
+            }
+            default:
+                // \" \\ \/
+                *out++ = c;
+        }
+    }
+    *out = 0;
+    return result;
+
+error:
+    free(result);
+    return NULL;
+}
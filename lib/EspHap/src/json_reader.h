@@ -0,0 +1,54 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Pull tokenizer over a complete json text, no allocation and no copy.
+// Strings are returned as spans of the input, still escaped.
+
+typedef struct {
+    const char *pos;
+    const char *end;
+} json_reader;
+
+typedef enum {
+    json_token_none = 0, // not present
+    json_token_null,
+    json_token_true,
+    json_token_false,
+    json_token_number,
+    json_token_string,
+    json_token_container, // object or array, skipped
+} json_token_type;
+
+typedef struct {
+    json_token_type type;
+    double number; // also 1 for true and 0 for false
+    const char *string;
+    size_t string_size;
+    bool string_escaped;
+} json_token;
+
+void json_reader_init(json_reader *reader, const char *data, size_t size);
+
+// Consumes c if it is the next character after whitespace
+bool json_reader_next(json_reader *reader, char c);
+// Only whitespace left
+bool json_reader_at_end(json_reader *reader);
+
+bool json_reader_string(json_reader *reader, const char **string, size_t *size, bool *escaped);
+// Object key and the colon after it
+bool json_reader_key(json_reader *reader, const char **key, size_t *size);
+bool json_reader_value(json_reader *reader, json_token *token);
+
+bool json_token_key_equals(const char *key, size_t size, const char *name);
+// Unescaped copy of a string token, to be freed by caller
+char *json_token_strdup(const json_token *token);
+
+#ifdef __cplusplus
+}
+#endif
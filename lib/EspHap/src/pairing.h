@@ -14,6 +14,7 @@ typedef struct {
     char device_id[DEVICE_ID_SIZE + 1];
     ed25519_key device_key;
     pairing_permissions_t permissions;
+    const ge_p3 *device_point; // decoded device_key while cached, or NULL
 } pairing_t;
 
 #endif // __PAIRING_H__
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include "srp_math.h"
+
+#define LIMB_BITS SRP_MATH_LIMB_BITS
+#define LIMBS SRP_MATH_LIMBS
+#define WINDOW_SIZE (1 << (SRP_MATH_WINDOW - 1))
+
+
+int srp_num_from_bytes(srp_num_t *a, const uint8_t *data, size_t size) {
+    if (size > SRP_MATH_BYTES)
+        return -1;
+
+    memset(a, 0, sizeof(*a));
+    for (size_t k = 0; k < size; k++) {
+        size_t bit = k * 8;
+        a->limbs[bit / LIMB_BITS] |= (srp_limb_t) data[size - 1 - k] << (bit % LIMB_BITS);
+    }
+    return 0;
+}
+
+void srp_num_to_bytes(const srp_num_t *a, uint8_t *out) {
+    for (size_t k = 0; k < SRP_MATH_BYTES; k++) {
+        size_t bit = k * 8;
+        out[SRP_MATH_BYTES - 1 - k] = a->limbs[bit / LIMB_BITS] >> (bit % LIMB_BITS);
+    }
+}
+
+size_t srp_num_size(const srp_num_t *a) {
+    int i = LIMBS - 1;
+    while (i >= 0 && !a->limbs[i])
+        i--;
+    if (i < 0)
+        return 0;
+
+    size_t size = i * (LIMB_BITS / 8);
+    for (srp_limb_t top = a->limbs[i]; top; top >>= 8)
+        size++;
+    return size;
+}
+
+static int srp_limbs_cmp(const srp_limb_t *a, const srp_limb_t *b) {
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+// a -= b, returns the borrow
+static srp_limb_t srp_limbs_sub(srp_limb_t *a, const srp_limb_t *b) {
+    srp_limb_t borrow = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        srp_dlimb_t d = (srp_dlimb_t) a[i] - b[i] - borrow;
+        a[i] = (srp_limb_t) d;
+        borrow = (d >> LIMB_BITS) & 1;
+    }
+    return borrow;
+}
+
+
+int srp_mont_init(srp_mont_t *mont, const uint8_t *modulus, size_t size) {
+    if (srp_num_from_bytes(&mont->n, modulus, size))
+        return -1;
+
+    const srp_limb_t *n = mont->n.limbs;
+    if (!(n[0] & 1) || !(n[LIMBS - 1] >> (LIMB_BITS - 1)))
+        return -2;
+
+    // Newton iteration, each step doubles the correct low bits of n^-1
+    srp_limb_t inv = n[0];
+    for (int i = 0; i < 5; i++)
+        inv = (srp_limb_t) (inv * (2 - (srp_dlimb_t) n[0] * inv));
+    mont->n0 = -inv;
+
+    // R mod n, doubled SRP_MATH_BITS times gives R^2 mod n
+    srp_limb_t *r2 = mont->r2.limbs;
+    srp_mont_one(mont, &mont->r2);
+    for (int i = 0; i < SRP_MATH_BITS; i++) {
+        srp_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            srp_limb_t top = r2[j] >> (LIMB_BITS - 1);
+            r2[j] = (r2[j] << 1) | carry;
+            carry = top;
+        }
+        if (carry || srp_limbs_cmp(r2, n) >= 0)
+            srp_limbs_sub(r2, n);
+    }
+    return 0;
+}
+
+void srp_mont_mul(const srp_mont_t *mont, srp_num_t *out, const srp_num_t *a, const srp_num_t *b) {
+    const srp_limb_t *n = mont->n.limbs;
+    srp_limb_t t[LIMBS + 2];
+    memset(t, 0, sizeof(t));
+
+    // CIOS, multiply by one limb of b then shift one limb out with a multiple of n
+    for (int i = 0; i < LIMBS; i++) {
+        const srp_limb_t bi = b->limbs[i];
+        srp_dlimb_t c = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            c += (srp_dlimb_t) a->limbs[j] * bi + t[j];
+            t[j] = (srp_limb_t) c;
+            c >>= LIMB_BITS;
+        }
+        c += t[LIMBS];
+        t[LIMBS] = (srp_limb_t) c;
+        t[LIMBS + 1] = (srp_limb_t) (c >> LIMB_BITS);
+
+        const srp_limb_t m = (srp_limb_t) ((srp_dlimb_t) t[0] * mont->n0);
+        c = ((srp_dlimb_t) m * n[0] + t[0]) >> LIMB_BITS;
+        for (int j = 1; j < LIMBS; j++) {
+            c += (srp_dlimb_t) m * n[j] + t[j];
+            t[j - 1] = (srp_limb_t) c;
+            c >>= LIMB_BITS;
+        }
+        c += t[LIMBS];
+        t[LIMBS - 1] = (srp_limb_t) c;
+        t[LIMBS] = t[LIMBS + 1] + (srp_limb_t) (c >> LIMB_BITS);
+    }
+
+    if (t[LIMBS] || srp_limbs_cmp(t, n) >= 0)
+        srp_limbs_sub(t, n);
+    memcpy(out->limbs, t, sizeof(out->limbs));
+}
+
+void srp_mont_mul_digit(const srp_mont_t *mont, srp_num_t *a, srp_limb_t digit) {
+    srp_dlimb_t c = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        c += (srp_dlimb_t) a->limbs[i] * digit;
+        a->limbs[i] = (srp_limb_t) c;
+        c >>= LIMB_BITS;
+    }
+
+    // a < n, so at most digit - 1 subtractions
+    srp_limb_t carry = (srp_limb_t) c;
+    while (carry || srp_limbs_cmp(a->limbs, mont->n.limbs) >= 0)
+        carry -= srp_limbs_sub(a->limbs, mont->n.limbs);
+}
+
+void srp_mont_one(const srp_mont_t *mont, srp_num_t *a) {
+    // R - n, as the top bit of n is set this is below n
+    memset(a, 0, sizeof(*a));
+    srp_limbs_sub(a->limbs, mont->n.limbs);
+}
+
+void srp_mont_to(const srp_mont_t *mont, srp_num_t *a) {
+    srp_mont_mul(mont, a, a, &mont->r2);
+}
+
+void srp_mont_from(const srp_mont_t *mont, srp_num_t *a) {
+    srp_num_t one;
+    memset(&one, 0, sizeof(one));
+    one.limbs[0] = 1;
+    srp_mont_mul(mont, a, a, &one);
+}
+
+
+typedef struct {
+    srp_mont_t mont;
+    srp_num_t acc;
+    srp_num_t table[WINDOW_SIZE]; // base^1, base^3, base^5, ... in Montgomery form
+} srp_exptmod_t;
+
+static int exponent_bit(const uint8_t *exponent, size_t size, int bit) {
+    return (exponent[size - 1 - bit / 8] >> (bit % 8)) & 1;
+}
+
+int srp_exptmod(const uint8_t *base, size_t base_size,
+                const uint8_t *exponent, size_t exponent_size,
+                const uint8_t *modulus, size_t modulus_size,
+                uint8_t *out) {
+    while (exponent_size && !exponent[0]) {
+        exponent++;
+        exponent_size--;
+    }
+
+    // one allocation for the whole exponentiation, too large for the stack
+    srp_exptmod_t *e = malloc(sizeof(srp_exptmod_t));
+    if (!e)
+        return -3;
+
+    int r = srp_mont_init(&e->mont, modulus, modulus_size);
+    if (!r) r = srp_num_from_bytes(&e->table[0], base, base_size);
+    if (r) {
+        free(e);
+        return r;
+    }
+    const srp_mont_t *mont = &e->mont;
+
+    srp_mont_to(mont, &e->table[0]);
+    srp_mont_mul(mont, &e->acc, &e->table[0], &e->table[0]);
+    for (int k = 1; k < WINDOW_SIZE; k++)
+        srp_mont_mul(mont, &e->table[k], &e->table[k - 1], &e->acc);
+
+    srp_mont_one(mont, &e->acc);
+    int started = 0;
+    int bit = exponent_size * 8 - 1;
+    while (bit >= 0) {
+        if (!exponent_bit(exponent, exponent_size, bit)) {
+            if (started)
+                srp_mont_mul(mont, &e->acc, &e->acc, &e->acc);
+            bit--;
+            continue;
+        }
+
+        // longest window up to SRP_MATH_WINDOW bits that ends in a set bit
+        int low = bit - SRP_MATH_WINDOW + 1;
+        if (low < 0)
+            low = 0;
+        while (!exponent_bit(exponent, exponent_size, low))
+            low++;
+
+        int value = 0;
+        for (int k = bit; k >= low; k--) {
+            value = (value << 1) | exponent_bit(exponent, exponent_size, k);
+            if (started)
+                srp_mont_mul(mont, &e->acc, &e->acc, &e->acc);
+        }
+        if (started)
+            srp_mont_mul(mont, &e->acc, &e->acc, &e->table[value >> 1]);
+        else
+            e->acc = e->table[value >> 1];
+        started = 1;
+        bit = low - 1;
+    }
+
+    srp_mont_from(mont, &e->acc);
+
+    // output is as long as the modulus, left padded
+    uint8_t bytes[SRP_MATH_BYTES];
+    srp_num_to_bytes(&e->acc, bytes);
+    memcpy(out, bytes + SRP_MATH_BYTES - modulus_size, modulus_size);
+
+    memset(bytes, 0, sizeof(bytes));
+    memset(e, 0, sizeof(*e));
+    free(e);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed width Montgomery arithmetic for the 3072-bit SRP group.
+// Numbers are arrays of limbs, least significant first, no allocation per
+// operation. The modulus must be odd and exactly SRP_MATH_BITS long.
+
+#define SRP_MATH_BITS 3072
+#define SRP_MATH_BYTES (SRP_MATH_BITS / 8)
+
+#ifndef SRP_MATH_LIMB_BITS
+#define SRP_MATH_LIMB_BITS 16 // ESP8266 multiplies 16x16 in hardware, 32x32 to 64 is a libcall
+#endif
+
+#if SRP_MATH_LIMB_BITS == 16
+typedef uint16_t srp_limb_t;
+typedef uint32_t srp_dlimb_t;
+#else
+typedef uint32_t srp_limb_t;
+typedef uint64_t srp_dlimb_t;
+#endif
+
+#define SRP_MATH_LIMBS (SRP_MATH_BITS / SRP_MATH_LIMB_BITS)
+
+#ifndef SRP_MATH_WINDOW
+#define SRP_MATH_WINDOW 3 // sliding window bits, the table holds 2^(w-1) numbers
+#endif
+
+typedef struct {
+    srp_limb_t limbs[SRP_MATH_LIMBS];
+} srp_num_t;
+
+typedef struct {
+    srp_num_t n;
+    srp_num_t r2; // R^2 mod n, to convert into Montgomery form
+    srp_limb_t n0; // -n^-1 mod limb base
+} srp_mont_t;
+
+// Big endian input, at most SRP_MATH_BYTES. Returns 0 on success.
+int srp_num_from_bytes(srp_num_t *a, const uint8_t *data, size_t size);
+// SRP_MATH_BYTES big endian bytes, zero padded
+void srp_num_to_bytes(const srp_num_t *a, uint8_t *out);
+// Length without leading zero bytes
+size_t srp_num_size(const srp_num_t *a);
+
+int srp_mont_init(srp_mont_t *mont, const uint8_t *modulus, size_t size);
+
+// out = a * b / R mod n, out may be a or b
+void srp_mont_mul(const srp_mont_t *mont, srp_num_t *out, const srp_num_t *a, const srp_num_t *b);
+// a = a * digit mod n, stays in the same form
+void srp_mont_mul_digit(const srp_mont_t *mont, srp_num_t *a, srp_limb_t digit);
+// R mod n, one in Montgomery form
+void srp_mont_one(const srp_mont_t *mont, srp_num_t *a);
+void srp_mont_to(const srp_mont_t *mont, srp_num_t *a);
+void srp_mont_from(const srp_mont_t *mont, srp_num_t *a);
+
+// out = base ^ exponent mod modulus, all big endian, out is modulus_size long.
+// Returns 0 on success, negative on bad arguments or no memory.
+int srp_exptmod(const uint8_t *base, size_t base_size,
+                const uint8_t *exponent, size_t exponent_size,
+                const uint8_t *modulus, size_t modulus_size,
+                uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -23,6 +23,8 @@
 #define ACCESSORY_KEY_ADDR   (STORAGE_BASE_ADDR + ACCESSORY_KEY_OFFSET)
 #define PAIRINGS_ADDR        (STORAGE_BASE_ADDR + PAIRINGS_OFFSET)
 
+#define SRP_STATE_PATH       "/hapsrp.state"
+
 #define MAX_PAIRINGS 2
 
 #define ACCESSORY_KEY_SIZE  64
@@ -30,6 +32,7 @@
 #define STORAGE_DEBUG(message, ...) //printf("*** [Storage] %s: " message "\n", __func__, ##__VA_ARGS__)
 
 const char magic1[] = "HAP";
+const char magic_srp[] = "SRP";
 
 // TODO: figure out alignment issues
 typedef struct {
@@ -41,6 +44,46 @@ typedef struct {
     byte _reserved[7]; // align record to be 80 bytes
 } pairing_data_t;
 
+// Decoded device keys by pairing slot, so pair verify skips the point
+// decompression. Entries are checked against the stored key on every use.
+typedef struct {
+    bool valid;
+    byte device_public_key[32];
+    ge_p3 device_point;
+} pairing_key_cache_t;
+
+static pairing_key_cache_t pairing_key_cache[MAX_PAIRINGS];
+
+static const ge_p3 *pairing_key_cache_get(int idx, const pairing_data_t *data, const ed25519_key *device_key) {
+    pairing_key_cache_t *entry = &pairing_key_cache[idx];
+    if (entry->valid && !memcmp(entry->device_public_key, data->device_public_key, sizeof(entry->device_public_key)))
+        return &entry->device_point;
+
+    entry->valid = !crypto_ed25519_decode_public_key(device_key, &entry->device_point);
+    memcpy(entry->device_public_key, data->device_public_key, sizeof(entry->device_public_key));
+    return entry->valid ? &entry->device_point : NULL;
+}
+
+// Decodes the keys of all stored pairings, ahead of their next pair verify
+static void pairing_key_cache_refresh() {
+    pairing_data_t data;
+    ed25519_key device_key;
+    for (int i=0; i<MAX_PAIRINGS; i++) {
+        read_storage(PAIRINGS_ADDR + sizeof(data)*i, (byte *)&data, sizeof(data));
+        if (strncmp(data.magic, magic1, sizeof(data.magic))) {
+            pairing_key_cache[i].valid = false;
+            continue;
+        }
+
+        crypto_ed25519_init(&device_key);
+        if (crypto_ed25519_import_public_key(&device_key, data.device_public_key, sizeof(data.device_public_key))) {
+            pairing_key_cache[i].valid = false;
+            continue;
+        }
+        pairing_key_cache_get(i, &data, &device_key);
+    }
+}
+
 
 int homekit_storage_init() {
     INFO("Init Storage");
@@ -64,9 +107,11 @@ int homekit_storage_init() {
             return -1;
         }
 
+        pairing_key_cache_refresh();
         return 1;
     }
 
+    pairing_key_cache_refresh();
     return 0;
 }
 
@@ -147,6 +192,47 @@ int homekit_storage_load_accessory_key(ed25519_key *key) {
     return 0;
 }
 
+// The SRP state is larger than the whole pairing storage, it has a file of its own
+int homekit_storage_save_srp_state(const byte *state) {
+    byte *data = malloc(sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE);
+    if (!data)
+        return -1;
+
+    memcpy(data, magic_srp, sizeof(magic_srp));
+    memcpy(data + sizeof(magic_srp), state, CRYPTO_SRP_STATE_SIZE);
+    bool written = write_storage_file(SRP_STATE_PATH, data, sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE);
+
+    memset(data, 0, sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE);
+    free(data);
+    if (!written) {
+        ERROR("Failed to write SRP state file");
+        return -1;
+    }
+    return 0;
+}
+
+int homekit_storage_load_srp_state(byte *state) {
+    byte *data = malloc(sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE);
+    if (!data)
+        return -1;
+
+    int r = 0;
+    if (!read_storage_file(SRP_STATE_PATH, data, sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE)
+            || memcmp(data, magic_srp, sizeof(magic_srp)))
+        r = -1;
+    else
+        memcpy(state, data + sizeof(magic_srp), CRYPTO_SRP_STATE_SIZE);
+
+    memset(data, 0, sizeof(magic_srp) + CRYPTO_SRP_STATE_SIZE);
+    free(data);
+    return r;
+}
+
+void homekit_storage_forget_srp_state() {
+    // the verifier is as good as the setup code for an offline guess
+    remove_storage_file(SRP_STATE_PATH);
+}
+
 bool homekit_storage_can_add_pairing() {
     pairing_data_t data;
     for (int i=0; i<MAX_PAIRINGS; i++) {
@@ -157,9 +243,17 @@ bool homekit_storage_can_add_pairing() {
     return false;
 }
 
+// Magic, accessory id and key and the pairing records, no more. A read past
+// the end of the pairing storage returns 0xff only, a whole sector would.
+#define STORAGE_DATA_SIZE (PAIRINGS_OFFSET + sizeof(pairing_data_t)*MAX_PAIRINGS)
+
 static int compact_data() {
-    byte *data = malloc(SPI_FLASH_SECTOR_SIZE);
-    if (!read_storage(STORAGE_BASE_ADDR, data, SPI_FLASH_SECTOR_SIZE)) {
+    byte *data = malloc(STORAGE_DATA_SIZE);
+    if (!data) {
+        ERROR("Failed to compact HomeKit storage: out of memory");
+        return -1;
+    }
+    if (!read_storage(STORAGE_BASE_ADDR, data, STORAGE_DATA_SIZE)) {
         free(data);
         ERROR("Failed to compact HomeKit storage: sector data read error");
         return -1;
@@ -183,7 +277,8 @@ static int compact_data() {
         return 0;
     }
 
-    if (homekit_storage_reset()) {
+    // 1 is a freshly formatted storage
+    if (homekit_storage_reset() < 0) {
         ERROR("Failed to compact HomeKit storage: error resetting flash");
         free(data);
         return -1;
@@ -219,6 +314,17 @@ static int find_empty_block() {
     return -1;
 }
 
+static int find_pairing_block(const char *device_id) {
+    pairing_data_t data;
+    for (int i=0; i<MAX_PAIRINGS; i++) {
+        read_storage(PAIRINGS_ADDR + sizeof(data)*i, (byte *)&data, sizeof(data));
+        if (!strncmp(data.magic, magic1, sizeof(data.magic))
+                && !strncmp(data.device_id, device_id, sizeof(data.device_id)))
+            return i;
+    }
+    return -1;
+}
+
 int homekit_storage_add_pairing(const char *device_id, const ed25519_key *device_key, byte permissions) {
     int next_block_idx = find_empty_block();
     if (next_block_idx == -1) {
@@ -251,6 +357,7 @@ int homekit_storage_add_pairing(const char *device_id, const ed25519_key *device
         return -1;
     }
 
+    pairing_key_cache_refresh();
     return 0;
 }
 
@@ -267,9 +374,11 @@ int homekit_storage_update_pairing(const char *device_id, byte permissions) {
             if (next_block_idx == -1) {
                 compact_data();
                 next_block_idx = find_empty_block();
+                // compaction moves the records down, this one too
+                i = find_pairing_block(device_id);
             }
 
-            if (next_block_idx == -1) {
+            if (next_block_idx == -1 || i == -1) {
                 ERROR("Failed to write pairing info to HomeKit storage: max number of pairings");
                 return -2;
             }
@@ -287,6 +396,7 @@ int homekit_storage_update_pairing(const char *device_id, byte permissions) {
                 return -2;
             }
 
+            pairing_key_cache_refresh();
             return 0;
         }
     }
@@ -307,6 +417,7 @@ int homekit_storage_remove_pairing(const char *device_id) {
                 return -2;
             }
 
+            pairing_key_cache[i].valid = false;
             return 0;
         }
     }
@@ -332,6 +443,7 @@ int homekit_storage_find_pairing(const char *device_id, pairing_t *pairing) {
             strncpy(pairing->device_id, data.device_id, DEVICE_ID_SIZE);
             pairing->device_id[DEVICE_ID_SIZE] = 0;
             pairing->permissions = data.permissions;
+            pairing->device_point = pairing_key_cache_get(i, &data, &pairing->device_key);
 
             return 0;
         }
@@ -368,6 +480,7 @@ int homekit_storage_next_pairing(pairing_iterator_t *it, pairing_t *pairing) {
             strncpy(pairing->device_id, data.device_id, DEVICE_ID_SIZE);
             pairing->device_id[DEVICE_ID_SIZE] = 0;
             pairing->permissions = data.permissions;
+            pairing->device_point = pairing_key_cache_get(id, &data, &pairing->device_key);
 
             return 0;
         }
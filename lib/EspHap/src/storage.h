@@ -19,6 +19,11 @@ int homekit_storage_load_accessory_id(char *data);
 void homekit_storage_save_accessory_key(const ed25519_key *key);
 int homekit_storage_load_accessory_key(ed25519_key *key);
 
+// CRYPTO_SRP_STATE_SIZE bytes in a file, kept until pairing completes
+int homekit_storage_save_srp_state(const byte *state);
+int homekit_storage_load_srp_state(byte *state);
+void homekit_storage_forget_srp_state();
+
 bool homekit_storage_can_add_pairing();
 int homekit_storage_add_pairing(const char *device_id, const ed25519_key *device_key, byte permissions);
 int homekit_storage_update_pairing(const char *device_id, byte permissions);
@@ -38,6 +43,11 @@ extern bool read_storage(uint32 srcAddress, byte *desAddress,uint32 size);
 extern bool write_storage(uint32 desAddress, byte *srcAddress, uint32 size);
 extern bool reset_storage();
 
+// Whole file reads and writes, for records kept apart from the pairing storage
+extern bool read_storage_file(const char *path, byte *data, uint32 size);
+extern bool write_storage_file(const char *path, const byte *data, uint32 size);
+extern bool remove_storage_file(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
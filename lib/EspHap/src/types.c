@@ -5,13 +5,13 @@
 //=========================
 
 homekit_value_t HOMEKIT_DEFAULT_CPP() {
-	homekit_value_t homekit_value;
-	//homekit_value.is_null = false;//该值为默认，不用设置
+	// not null and not static, callers fill in the format and the value
+	homekit_value_t homekit_value = { 0 };
 	return homekit_value;
 }
 
 homekit_value_t HOMEKIT_NULL_CPP() {
-	homekit_value_t homekit_value;
+	homekit_value_t homekit_value = { 0 };
 	homekit_value.is_null = true;
 	return homekit_value;
 }
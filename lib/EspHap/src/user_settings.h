@@ -70,6 +70,19 @@ static inline int hwrand_generate_block(uint8_t *buf, size_t len) {
 //winsize = 5 & mp_exptmod_fast 最快，Pair Verify Step 2/2 = 10s左右
 //winsize = 6 heap不够
 
+//SRP math flavour, pick one with a build flag:
+//default: fixed width Montgomery code for the 3072-bit N in srp_math.c,
+//  see SrpExptMod in srp.c, 2.7KB heap per exponentiation (16-bit limbs)
+//  -DSRP_MATH_LIMB_BITS=32 halves the limb count, but 32x32 multiplies are
+//  a libcall on ESP8266, -DSRP_MATH_WINDOW=n trades table heap for speed
+//-DARDUINO_HOMEKIT_SRP_INTEGER_MATH: heap based mp_exptmod of integer.c,
+//  about 2x slower, heap high-water in pair setup M3 9.3KB instead of 6.4KB
+//tfm.c (USE_FAST_MATH) is not part of this tree, tfm.h alone does not build.
+//The time-sliced pre-init always steps srp_math, see crypto_srp_setup_step.
+#ifndef ARDUINO_HOMEKIT_SRP_INTEGER_MATH
+#define ESP_SRP_MATH
+#endif
+
 
 #define MP_16BIT //faster than 32bit in ESP8266
 
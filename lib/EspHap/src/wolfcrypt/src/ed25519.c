@@ -96,41 +96,18 @@ int wc_ed25519_make_key(WC_RNG* rng, int keySz, ed25519_key* key)
 
 #ifdef HAVE_ED25519_SIGN
 /*
-    in     contains the message to sign
-    inlen  is the length of the message to sign
-    out    is the buffer to write the signature
-    outLen [in/out] input size of out buf
-                     output gets set as the final length of out
-    key    is the ed25519 key to use when signing
+    key    is the ed25519 key to expand
+    az     receives the clamped secret scalar and the nonce prefix,
+           ED25519_PRV_KEY_SIZE bytes
     return 0 on success
  */
-int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
-                        word32 *outLen, ed25519_key* key)
+int wc_ed25519_expand_private(ed25519_key* key, byte* az)
 {
-#ifdef FREESCALE_LTC_ECC
-    byte   tempBuf[ED25519_PRV_KEY_SIZE];
-#else
-    ge_p3  R;
-#endif
-    byte   nonce[WC_SHA512_DIGEST_SIZE];
-    byte   hram[WC_SHA512_DIGEST_SIZE];
-    byte   az[ED25519_PRV_KEY_SIZE];
-    wc_Sha512 sha;
     int    ret;
 
-    /* sanity check on arguments */
-    if (in == NULL || out == NULL || outLen == NULL || key == NULL)
+    if (key == NULL || az == NULL)
         return BAD_FUNC_ARG;
 
-    /* check and set up out length */
-    if (*outLen < ED25519_SIG_SIZE) {
-        *outLen = ED25519_SIG_SIZE;
-        return BUFFER_E;
-    }
-    *outLen = ED25519_SIG_SIZE;
-
-    /* step 1: create nonce to use where nonce is r in
-       r = H(h_b, ... ,h_2b-1,M) */
     ret = wc_Sha512Hash(key->k, ED25519_KEY_SIZE, az);
     if (ret != 0)
         return ret;
@@ -140,6 +117,24 @@ int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
     az[31] &= 63; /* same than az[31] &= 127 because of az[31] |= 64 */
     az[31] |= 64;
 
+    return 0;
+}
+
+static int ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
+                        word32 *outLen, ed25519_key* key, const byte* az)
+{
+#ifdef FREESCALE_LTC_ECC
+    byte   tempBuf[ED25519_PRV_KEY_SIZE];
+#else
+    ge_p3  R;
+#endif
+    byte   nonce[WC_SHA512_DIGEST_SIZE];
+    byte   hram[WC_SHA512_DIGEST_SIZE];
+    wc_Sha512 sha;
+    int    ret;
+
+    /* step 1: create nonce to use where nonce is r in
+       r = H(h_b, ... ,h_2b-1,M) */
     ret = wc_InitSha512(&sha);
     if (ret != 0)
         return ret;
@@ -198,6 +193,68 @@ int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
     return ret;
 }
 
+static int ed25519_sign_check(const byte* in, byte* out, word32 *outLen,
+                        ed25519_key* key)
+{
+    /* sanity check on arguments */
+    if (in == NULL || out == NULL || outLen == NULL || key == NULL)
+        return BAD_FUNC_ARG;
+
+    /* check and set up out length */
+    if (*outLen < ED25519_SIG_SIZE) {
+        *outLen = ED25519_SIG_SIZE;
+        return BUFFER_E;
+    }
+    *outLen = ED25519_SIG_SIZE;
+
+    return 0;
+}
+
+/*
+    in     contains the message to sign
+    inlen  is the length of the message to sign
+    out    is the buffer to write the signature
+    outLen [in/out] input size of out buf
+                     output gets set as the final length of out
+    key    is the ed25519 key to use when signing
+    return 0 on success
+ */
+int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
+                        word32 *outLen, ed25519_key* key)
+{
+    byte   az[ED25519_PRV_KEY_SIZE];
+    int    ret;
+
+    ret = ed25519_sign_check(in, out, outLen, key);
+    if (ret != 0)
+        return ret;
+
+    ret = wc_ed25519_expand_private(key, az);
+    if (ret == 0)
+        ret = ed25519_sign_msg(in, inlen, out, outLen, key, az);
+
+    ForceZero(az, sizeof(az));
+    return ret;
+}
+
+/*
+   as wc_ed25519_sign_msg with az from wc_ed25519_expand_private of key,
+   skips hashing the private key
+*/
+int wc_ed25519_sign_msg_expanded(const byte* in, word32 inlen, byte* out,
+                        word32 *outLen, ed25519_key* key, const byte* az)
+{
+    int    ret;
+
+    ret = ed25519_sign_check(in, out, outLen, key);
+    if (ret != 0)
+        return ret;
+    if (az == NULL)
+        return BAD_FUNC_ARG;
+
+    return ed25519_sign_msg(in, inlen, out, outLen, key, az);
+}
+
 #endif /* HAVE_ED25519_SIGN */
 
 #ifdef HAVE_ED25519_VERIFY
@@ -210,13 +267,18 @@ int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
    res     will be 1 on successful verify and 0 on unsuccessful
    return  0 and res of 1 on success
 */
+#ifdef FREESCALE_LTC_ECC
 int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
                           word32 msglen, int* res, ed25519_key* key)
+#else
+static int ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
+                          word32 msglen, int* res, ed25519_key* key,
+                          const ge_p3* A)
+#endif
 {
     byte   rcheck[ED25519_KEY_SIZE];
     byte   h[WC_SHA512_DIGEST_SIZE];
 #ifndef FREESCALE_LTC_ECC
-    ge_p3  A;
     ge_p2  R;
 #endif
     int    ret;
@@ -233,12 +295,6 @@ int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
     if (siglen < ED25519_SIG_SIZE || (sig[ED25519_SIG_SIZE-1] & 224))
         return BAD_FUNC_ARG;
 
-    /* uncompress A (public key), test if valid, and negate it */
-#ifndef FREESCALE_LTC_ECC
-    if (ge_frombytes_negate_vartime(&A, key->p) != 0)
-        return BAD_FUNC_ARG;
-#endif
-
     /* find H(R,A,M) and store it as h */
     ret  = wc_InitSha512(&sha);
     if (ret != 0)
@@ -267,9 +323,9 @@ int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
        SB - H(R,A,M)A saving decompression of R
     */
 #ifdef ESP_GE_DOUBLE_SCALARMULT_VARTIME_LOWMEM
-    ret = ge_double_scalarmult_vartime_lowmem(&R, h, &A, sig + (ED25519_SIG_SIZE/2));
+    ret = ge_double_scalarmult_vartime_lowmem(&R, h, A, sig + (ED25519_SIG_SIZE/2));
 #else
-    ret = ge_double_scalarmult_vartime(&R, h, &A, sig + (ED25519_SIG_SIZE/2));
+    ret = ge_double_scalarmult_vartime(&R, h, A, sig + (ED25519_SIG_SIZE/2));
 #endif
     if (ret != 0)
         return ret;
@@ -288,6 +344,54 @@ int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
     return ret;
 }
 
+#ifndef FREESCALE_LTC_ECC
+/*
+   uncompress A (public key), test if valid, and negate it
+   A       receives the point in the form verify uses
+   return  0 on success
+*/
+int wc_ed25519_decode_public(ed25519_key* key, ge_p3* A)
+{
+    if (key == NULL || A == NULL)
+        return BAD_FUNC_ARG;
+
+    if (ge_frombytes_negate_vartime(A, key->p) != 0)
+        return BAD_FUNC_ARG;
+
+    return 0;
+}
+
+int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
+                          word32 msglen, int* res, ed25519_key* key)
+{
+    ge_p3  A;
+    int    ret;
+
+    if (res != NULL)
+        *res = 0;
+
+    ret = wc_ed25519_decode_public(key, &A);
+    if (ret != 0)
+        return ret;
+
+    return ed25519_verify_msg(sig, siglen, msg, msglen, res, key, &A);
+}
+
+/*
+   as wc_ed25519_verify_msg with A from wc_ed25519_decode_public of key,
+   skips the point decompression
+*/
+int wc_ed25519_verify_msg_decoded(const byte* sig, word32 siglen,
+                          const byte* msg, word32 msglen, int* res,
+                          ed25519_key* key, const ge_p3* A)
+{
+    if (A == NULL)
+        return BAD_FUNC_ARG;
+
+    return ed25519_verify_msg(sig, siglen, msg, msglen, res, key, A);
+}
+#endif /* FREESCALE_LTC_ECC */
+
 #endif /* HAVE_ED25519_VERIFY */
 
 
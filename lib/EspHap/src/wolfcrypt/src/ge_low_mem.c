@@ -40,9 +40,22 @@
     #include <wolfcrypt/src/misc.c>
 #endif
 
-void ed25519_smult(ge_p3 *r, const ge_p3 *a, const byte *e);
-void ed25519_add(ge_p3 *r, const ge_p3 *a, const ge_p3 *b);
-void ed25519_double(ge_p3 *r, const ge_p3 *a);
+#if defined(ESP_GE_DOUBLE_SCALARMULT_VARTIME_LOWMEM) && !defined(ED25519_SMALL)
+/* ge_p3 holds the fe limbs of ge_operations.c here, the code below works on
+   packed field bytes. ge_double_scalarmult_vartime_lowmem converts. */
+typedef struct {
+    byte X[F25519_SIZE];
+    byte Y[F25519_SIZE];
+    byte Z[F25519_SIZE];
+    byte T[F25519_SIZE];
+} ge_p3_lm;
+#else
+typedef ge_p3 ge_p3_lm;
+#endif
+
+void ed25519_smult(ge_p3_lm *r, const ge_p3_lm *a, const byte *e);
+void ed25519_add(ge_p3_lm *r, const ge_p3_lm *a, const ge_p3_lm *b);
+void ed25519_double(ge_p3_lm *r, const ge_p3_lm *a);
 
 
 static const byte ed25519_order[F25519_SIZE] = {
@@ -223,7 +236,7 @@ void sc_muladd(byte* out, const byte* a, const byte* b, const byte* c)
  * is the corresponding positive coordinate for the new curve equation.
  * t is x*y.
  */
-const ge_p3 ed25519_base = {
+const ge_p3_lm ed25519_base = {
     {
         0x1a, 0xd5, 0x25, 0x8f, 0x60, 0x2d, 0x56, 0xc9,
         0xb2, 0xa7, 0x25, 0x95, 0x60, 0xc7, 0x2c, 0x69,
@@ -247,7 +260,7 @@ const ge_p3 ed25519_base = {
 };
 
 
-const ge_p3 ed25519_neutral = {
+const ge_p3_lm ed25519_neutral = {
     {0},
     {1, 0},
     {1, 0},
@@ -273,8 +286,8 @@ static const byte ed25519_k[F25519_SIZE] = {
 };
 
 
-void ed25519_add(ge_p3 *r,
-         const ge_p3 *p1, const ge_p3 *p2)
+void ed25519_add(ge_p3_lm *r,
+         const ge_p3_lm *p1, const ge_p3_lm *p2)
 {
     /* Explicit formulas database: add-2008-hwcd-3
      *
@@ -349,7 +362,7 @@ void ed25519_add(ge_p3 *r,
 }
 
 
-void ed25519_double(ge_p3 *r, const ge_p3 *p)
+void ed25519_double(ge_p3_lm *r, const ge_p3_lm *p)
 {
     /* Explicit formulas database: dbl-2008-hwcd
      *
@@ -417,16 +430,16 @@ void ed25519_double(ge_p3 *r, const ge_p3 *p)
 }
 
 
-void ed25519_smult(ge_p3 *r_out, const ge_p3 *p, const byte *e)
+void ed25519_smult(ge_p3_lm *r_out, const ge_p3_lm *p, const byte *e)
 {
-    ge_p3 r;
+    ge_p3_lm r;
     int   i;
 
     XMEMCPY(&r, &ed25519_neutral, sizeof(r));
 
     for (i = 255; i >= 0; i--) {
         const byte bit = (e[i >> 3] >> (i & 7)) & 1;
-        ge_p3 s;
+        ge_p3_lm s;
 
         ed25519_double(&r, &r);
         ed25519_add(&s, &r, p);
@@ -546,10 +559,14 @@ int ge_double_scalarmult_vartime_lowmem(ge_p2* R, const unsigned char *h,
                                  const ge_p3 *inA,const unsigned char *sig)
 {
 	INFO("Call ge_double_scalarmult_vartime_lowmem in ge_low_mem.c");
-    ge_p3 p, A;
+    ge_p3_lm p, A;
     int ret = 0;
 
-    XMEMCPY(&A, inA, sizeof(ge_p3));
+    /* inA is in fe limbs, from ge_frombytes_negate_vartime of ge_operations.c */
+    fe_tobytes(A.X, inA->X);
+    fe_tobytes(A.Y, inA->Y);
+    fe_tobytes(A.Z, inA->Z);
+    fe_tobytes(A.T, inA->T);
 
     /* find SB */
     ed25519_smult(&p, &ed25519_base, sig);
@@ -560,9 +577,13 @@ int ge_double_scalarmult_vartime_lowmem(ge_p2* R, const unsigned char *h,
     /* SB + -H(R,A,M)A */
     ed25519_add(&A, &p, &A);
 
-    lm_copy(R->X, A.X);
-    lm_copy(R->Y, A.Y);
-    lm_copy(R->Z, A.Z);
+    /* back to limbs for ge_tobytes, which normalizes */
+    fe_normalize(A.X);
+    fe_normalize(A.Y);
+    fe_normalize(A.Z);
+    fe_frombytes(R->X, A.X);
+    fe_frombytes(R->Y, A.Y);
+    fe_frombytes(R->Z, A.Z);
 
     return ret;
 }
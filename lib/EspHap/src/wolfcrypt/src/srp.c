@@ -39,6 +39,50 @@
     #include <wolfcrypt/src/misc.c>
 #endif
 
+#ifdef ESP_SRP_MATH
+    #include "srp_math.h"
+#endif
+
+/** Y = G^X mod N, fixed width 3072-bit code for the HomeKit group. */
+static int SrpExptMod(mp_int* G, mp_int* X, mp_int* N, mp_int* Y)
+{
+#ifdef ESP_SRP_MATH
+    int r;
+    word32 gSz, xSz;
+    byte* buffer;
+
+    gSz = mp_unsigned_bin_size(G);
+    xSz = mp_unsigned_bin_size(X);
+
+    /* the client side base B - k * v can be negative */
+    if (mp_count_bits(N) != SRP_MATH_BITS || gSz > SRP_MATH_BYTES
+                                           || xSz > SRP_MATH_BYTES
+                                           || mp_isneg(G) || mp_isneg(X))
+        return mp_exptmod(G, X, N, Y);
+
+    buffer = (byte*)XMALLOC(3 * SRP_MATH_BYTES, NULL, DYNAMIC_TYPE_SRP);
+    if (buffer == NULL)
+        return MEMORY_E;
+
+    r = mp_to_unsigned_bin(N, buffer);
+    if (!r) r = mp_to_unsigned_bin(G, buffer + SRP_MATH_BYTES);
+    if (!r) r = mp_to_unsigned_bin(X, buffer + 2 * SRP_MATH_BYTES);
+    if (!r) r = srp_exptmod(buffer + SRP_MATH_BYTES, gSz,
+                            buffer + 2 * SRP_MATH_BYTES, xSz,
+                            buffer, SRP_MATH_BYTES, buffer + SRP_MATH_BYTES)
+                                                               ? MP_VAL : 0;
+    if (!r) r = mp_read_unsigned_bin(Y, buffer + SRP_MATH_BYTES,
+                                                               SRP_MATH_BYTES);
+
+    ForceZero(buffer, 3 * SRP_MATH_BYTES);
+    XFREE(buffer, NULL, DYNAMIC_TYPE_SRP);
+
+    return r;
+#else
+    return mp_exptmod(G, X, N, Y);
+#endif
+}
+
 /** Computes the session key using the Mask Generation Function 1. */
 static int wc_SrpSetKey(Srp* srp, byte* secret, word32 size);
 
@@ -437,7 +481,7 @@ int wc_SrpGetVerifier(Srp* srp, byte* verifier, word32* size)
         return MP_INIT_E;
 
     /* v = g ^ x % N */
-    if (!r) r = mp_exptmod(&srp->g, &srp->auth, &srp->N, &v);
+    if (!r) r = SrpExptMod(&srp->g, &srp->auth, &srp->N, &v);
     if (!r) r = *size < (word32)mp_unsigned_bin_size(&v) ? BUFFER_E : MP_OKAY;
     if (!r) r = mp_to_unsigned_bin(&v, verifier);
     if (!r) *size = mp_unsigned_bin_size(&v);
@@ -517,7 +561,7 @@ int wc_SrpGetPublic(Srp* srp, byte* pub, word32* size)
 
     /* client side: A = g ^ a % N */
     if (srp->side == SRP_CLIENT_SIDE) {
-        if (!r) r = mp_exptmod(&srp->g, &srp->priv, &srp->N, &pubkey);
+        if (!r) r = SrpExptMod(&srp->g, &srp->priv, &srp->N, &pubkey);
 
     /* server side: B = (k * v + (g ^ b % N)) % N */
     } else {
@@ -526,7 +570,7 @@ int wc_SrpGetPublic(Srp* srp, byte* pub, word32* size)
         if (mp_init_multi(&i, &j, 0, 0, 0, 0) == MP_OKAY) {
             if (!r) r = mp_read_unsigned_bin(&i, srp->k,SrpHashSize(srp->type));
             if (!r) r = mp_iszero(&i) == MP_YES ? SRP_BAD_KEY_E : 0;
-            if (!r) r = mp_exptmod(&srp->g, &srp->priv, &srp->N, &pubkey);
+            if (!r) r = SrpExptMod(&srp->g, &srp->priv, &srp->N, &pubkey);
             if (!r) r = mp_mulmod(&i, &srp->auth, &srp->N, &j);
             if (!r) r = mp_add(&j, &pubkey, &i);
             if (!r) r = mp_mod(&i, &srp->N, &pubkey);
@@ -646,7 +690,7 @@ int wc_SrpComputeKey(Srp* srp, byte* clientPubKey, word32 clientPubKeySz,
         /* temp1 = B - k * v; rejects k == 0, B == 0 and B >= N. */
         r = mp_read_unsigned_bin(&temp1, srp->k, digestSz);
         if (!r) r = mp_iszero(&temp1) == MP_YES ? SRP_BAD_KEY_E : 0;
-        if (!r) r = mp_exptmod(&srp->g, &srp->auth, &srp->N, &temp2);
+        if (!r) r = SrpExptMod(&srp->g, &srp->auth, &srp->N, &temp2);
         if (!r) r = mp_mulmod(&temp1, &temp2, &srp->N, &s);
         if (!r) r = mp_read_unsigned_bin(&temp2, serverPubKey, serverPubKeySz);
         if (!r) r = mp_iszero(&temp2) == MP_YES ? SRP_BAD_KEY_E : 0;
@@ -658,11 +702,11 @@ int wc_SrpComputeKey(Srp* srp, byte* clientPubKey, word32 clientPubKeySz,
         if (!r) r = mp_add(&srp->priv, &s, &temp2);
 
         /* secret = temp1 ^ temp2 % N */
-        if (!r) r = mp_exptmod(&temp1, &temp2, &srp->N, &s);
+        if (!r) r = SrpExptMod(&temp1, &temp2, &srp->N, &s);
 
     } else if (!r && srp->side == SRP_SERVER_SIDE) {
         /* temp1 = v ^ u % N */
-        r = mp_exptmod(&srp->auth, &u, &srp->N, &temp1);
+        r = SrpExptMod(&srp->auth, &u, &srp->N, &temp1);
 
         /* temp2 = A * temp1 % N; rejects A == 0, A >= N */
         if (!r) r = mp_read_unsigned_bin(&s, clientPubKey, clientPubKeySz);
@@ -677,7 +721,7 @@ int wc_SrpComputeKey(Srp* srp, byte* clientPubKey, word32 clientPubKeySz,
         if (!r) r = mp_cmp(&temp2, &s) == MP_EQ ? SRP_BAD_KEY_E : 0;
 
         /* secret = temp2 * b % N */
-        if (!r) r = mp_exptmod(&temp2, &srp->priv, &srp->N, &s);
+        if (!r) r = SrpExptMod(&temp2, &srp->priv, &srp->N, &s);
     }
 
     /* building session key from secret */
@@ -85,8 +85,21 @@ WOLFSSL_API
 int wc_ed25519_sign_msg(const byte* in, word32 inlen, byte* out,
                         word32 *outlen, ed25519_key* key);
 WOLFSSL_API
+int wc_ed25519_expand_private(ed25519_key* key, byte* az);
+WOLFSSL_API
+int wc_ed25519_sign_msg_expanded(const byte* in, word32 inlen, byte* out,
+                        word32 *outlen, ed25519_key* key, const byte* az);
+WOLFSSL_API
 int wc_ed25519_verify_msg(const byte* sig, word32 siglen, const byte* msg,
                           word32 msglen, int* stat, ed25519_key* key);
+#ifndef FREESCALE_LTC_ECC
+WOLFSSL_API
+int wc_ed25519_decode_public(ed25519_key* key, ge_p3* A);
+WOLFSSL_API
+int wc_ed25519_verify_msg_decoded(const byte* sig, word32 siglen,
+                          const byte* msg, word32 msglen, int* stat,
+                          ed25519_key* key, const ge_p3* A);
+#endif
 WOLFSSL_API
 int wc_ed25519_init(ed25519_key* key);
 WOLFSSL_API
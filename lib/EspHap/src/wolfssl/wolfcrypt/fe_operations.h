@@ -57,6 +57,14 @@ Bounds on each t[i] vary depending on context.
     WOLFSSL_LOCAL void lm_invert(byte*, const byte*);
     WOLFSSL_LOCAL void lm_mul(byte*,const byte*,const byte*);
 #endif
+#if defined(ESP_GE_DOUBLE_SCALARMULT_VARTIME_LOWMEM) && \
+    !defined(CURVE25519_SMALL) && !defined(ED25519_SMALL)
+    /* the part of fe_low_mem.c that ge_low_mem.c uses */
+    WOLFSSL_LOCAL void fe_normalize(byte *x);
+    WOLFSSL_LOCAL void fe_select(byte *dst, const byte *zero, const byte *one,
+                                 byte condition);
+    WOLFSSL_LOCAL void fe_mul__distinct(byte *r, const byte *a, const byte *b);
+#endif
 
 
 #if !defined(FREESCALE_LTC_ECC)
@@ -20,6 +20,13 @@ void WifiManager::begin()
 
     LOG_INFO(F("RFC name is ") << rfcName);
 
+    // ip string fits, so pointers handed out to c_str() stay valid
+    localIPString.reserve(16);
+    gotIPHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP &)
+                                           { connectionChanged = true; });
+    disconnectedHandler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected &)
+                                                         { connectionChanged = true; });
+
     WiFi.mode(WIFI_STA);
     WiFi.persistent(true);
 
@@ -45,6 +52,9 @@ void WifiManager::begin()
         // captive portal
         startCaptivePortal();
     }
+
+    connectionChanged = false;
+    updateConnectionState();
 }
 
 // Upgraded default waitForConnectResult function to incorporate WL_NO_SSID_AVAIL, fixes issue #122
@@ -181,20 +191,31 @@ bool WifiManager::isCaptivePortal()
     return inCaptivePortal;
 }
 
-// return current SSID
-IPAddress WifiManager::LocalIP()
+void WifiManager::updateConnectionState()
 {
-    return WiFi.localIP();
+    connected = WiFi.isConnected();
+    localIP = connected ? WiFi.localIP() : IPAddress();
+    localIPString = localIP.toString();
+    connectedSSID = WiFi.SSID();
+    rssi = connected ? WiFi.RSSI() : 0;
+    lastRssiCheck = millis();
 }
 
-String WifiManager::SSID()
+void WifiManager::checkRssi()
 {
-    return WiFi.SSID();
-}
+    const auto now = millis();
+    if (!connected || (now - lastRssiCheck < RssiPollInterval))
+    {
+        return;
+    }
+    lastRssiCheck = now;
 
-int8_t WifiManager::RSSI()
-{
-    return WiFi.RSSI();
+    const int8_t newRssi = WiFi.RSSI();
+    if ((newRssi / RssiBucketSize) != (rssi / RssiBucketSize))
+    {
+        rssi = newRssi;
+        rssiChangeCallback.callChangeListeners();
+    }
 }
 
 // captive portal loop
@@ -211,6 +232,23 @@ void WifiManager::loop()
         connectNewWifi(ssid, pass);
         reconnect = false;
     }
+
+    if (connectionChanged)
+    {
+        connectionChanged = false;
+        updateConnectionState();
+        if (connected)
+        {
+            LOG_INFO(F("WiFi connected with IP: ") << localIPString);
+        }
+        else
+        {
+            LOG_INFO(F("WiFi disconnected"));
+        }
+        connectionChangeCallback.callChangeListeners();
+    }
+
+    checkRssi();
 }
 
 String WifiManager::getRFC952Hostname(const String &name)
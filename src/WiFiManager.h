@@ -2,6 +2,7 @@
 #define WIFI_H
 
 #include <Arduino.h>
+#include <ESP8266WiFi.h>
 #include <DNSServer.h>
 #include <memory>
 
@@ -20,14 +21,50 @@ public:
         return rfcName;
     }
 
-    static IPAddress LocalIP();
-    static String SSID();
-    static int8_t RSSI();
+    // cached network state, refreshed from wifi events
+    const IPAddress &LocalIP() const
+    {
+        return localIP;
+    }
+    const String &LocalIPString() const
+    {
+        return localIPString;
+    }
+    const String &SSID() const
+    {
+        return connectedSSID;
+    }
+    int8_t RSSI() const
+    {
+        return rssi;
+    }
+    bool isConnected() const
+    {
+        return connected;
+    }
+
     void disconnect(bool disconnectWifi);
     static WifiManager instance;
 
+    changeCallBack connectionChangeCallback; // got IP or disconnected
+    changeCallBack rssiChangeCallback;       // RSSI moved to another bucket
+
 private:
     WifiManager() {}
+
+    static const uint32_t RssiPollInterval = 5000;
+    static const int8_t RssiBucketSize = 5; // dBm
+
+    WiFiEventHandler gotIPHandler;
+    WiFiEventHandler disconnectedHandler;
+    volatile bool connectionChanged{false}; // set from sdk event context
+
+    IPAddress localIP;
+    String localIPString;
+    String connectedSSID;
+    int8_t rssi{0};
+    bool connected{false};
+    unsigned long lastRssiCheck{0};
     DNSServer *dnsServer{nullptr};
     String ssid;
     String pass;
@@ -41,6 +78,8 @@ private:
     void stopCaptivePortal();
     void connectNewWifi(const String &newSSID, const String &newPass);
     int8_t waitForConnectResult(unsigned long timeoutLength);
+    void updateConnectionState();
+    void checkRssi();
 
     static String getRFC952Hostname(const String &name);
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+struct configData
+{
+    String hostName;
+    String webUserName;
+    String webPassword;
+    std::vector<uint8_t> homeKitPairData;
+    uint64_t reportSendInterval;
+    uint16_t wattageThreshold;
+    uint8_t wattagePercentThreshold;
+    uint16_t maxPower;
+    uint64_t maxPowerHold;
+    double voltageCalibrationRatio;
+    double currentCalibrationRatio;
+    double powerCalibrationRatio;
+
+    configData()
+    {
+        setDefaults();
+    }
+
+    // defaults come from the field table in configTable.cpp
+    void setDefaults();
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <base64.h> // from esphap
+
+#include <array>
+#include <initializer_list>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// How a change to a field takes effect
+enum class ConfigPersistence : uint8_t
+{
+    Live,           // used straight from config data
+    RebootRequired, // only read at startup
+    Internal,       // owned by device, never patched
+};
+
+template <class T>
+struct ConfigFieldTraits
+{
+    typedef T DefaultType;
+    typedef T BoundType;
+};
+
+template <>
+struct ConfigFieldTraits<String>
+{
+    typedef const char *DefaultType; // PROGMEM
+    typedef size_t BoundType;        // length
+};
+
+template <>
+struct ConfigFieldTraits<std::vector<uint8_t>>
+{
+    typedef const char *DefaultType; // unused, always empty
+    typedef size_t BoundType;        // decoded size
+};
+
+// One entry of the config schema, bound to its member at compile time
+template <class Data, class T, T Data::*Member>
+struct ConfigField
+{
+    typedef T ValueType;
+
+    const char *id; // PROGMEM, json key
+    typename ConfigFieldTraits<T>::DefaultType defaultValue;
+    typename ConfigFieldTraits<T>::BoundType minValue;
+    typename ConfigFieldTraits<T>::BoundType maxValue;
+    ConfigPersistence persistence;
+
+    static T &get(Data &data) { return data.*Member; }
+    static const T &get(const Data &data) { return data.*Member; }
+};
+
+namespace configFieldOps
+{
+    template <class T>
+    void setDefault(T &value, const T &defaultValue)
+    {
+        value = defaultValue;
+    }
+
+    inline void setDefault(String &value, const char *defaultValue)
+    {
+        value = FPSTR(defaultValue);
+    }
+
+    inline void setDefault(std::vector<uint8_t> &value, const char *)
+    {
+        value.clear();
+        value.shrink_to_fit();
+    }
+
+    template <class T>
+    bool fromJson(const JsonVariantConst &variant, T &value, const T &minValue, const T &maxValue)
+    {
+        if (!variant.is<T>())
+        {
+            return false;
+        }
+
+        const auto newValue = variant.as<T>();
+        if ((newValue < minValue) || (newValue > maxValue))
+        {
+            return false;
+        }
+        value = newValue;
+        return true;
+    }
+
+    inline bool fromJson(const JsonVariantConst &variant, String &value, size_t minLength, size_t maxLength)
+    {
+        if (!variant.is<const char *>())
+        {
+            return false;
+        }
+
+        const auto newValue = variant.as<const char *>();
+        const auto length = strlen(newValue);
+        if ((length < minLength) || (length > maxLength))
+        {
+            return false;
+        }
+        value = newValue;
+        return true;
+    }
+
+    inline bool fromJson(const JsonVariantConst &variant, std::vector<uint8_t> &value, size_t minSize, size_t maxSize)
+    {
+        if (!variant.is<const char *>())
+        {
+            return false;
+        }
+
+        const auto encoded = reinterpret_cast<const unsigned char *>(variant.as<const char *>());
+        const auto encodedLength = strlen(variant.as<const char *>());
+        const auto size = base64_decoded_size(encoded, encodedLength);
+        if ((size < minSize) || (size > maxSize))
+        {
+            return false;
+        }
+
+        value.resize(size);
+        base64_decode_(encoded, encodedLength, value.data());
+        value.shrink_to_fit();
+        return true;
+    }
+
+    template <class T>
+    void toJson(JsonVariant variant, const T &value)
+    {
+        variant.set(value);
+    }
+
+    // not copied, document must not outlive the config data
+    inline void toJson(JsonVariant variant, const String &value)
+    {
+        variant.set(value.c_str());
+    }
+
+    inline void toJson(JsonVariant variant, const std::vector<uint8_t> &value)
+    {
+        const auto requiredSize = base64_encoded_size(value.data(), value.size());
+        const auto encodedData = std::make_unique<unsigned char[]>(requiredSize + 1);
+        base64_encode_(value.data(), value.size(), encodedData.get());
+        encodedData[requiredSize] = 0;
+        variant.set(reinterpret_cast<char *>(encodedData.get())); // char* is copied
+    }
+}
+
+template <class Fields>
+constexpr size_t configFieldCount()
+{
+    return std::tuple_size<Fields>::value;
+}
+
+template <class Fields, class F, size_t... I>
+void forEachConfigField(const Fields &fields, F &&f, std::index_sequence<I...>)
+{
+    (void)std::initializer_list<int>{(f(std::get<I>(fields), I), 0)...};
+}
+
+// calls f(field, index) for every field in table order
+template <class Fields, class F>
+void forEachConfigField(const Fields &fields, F &&f)
+{
+    forEachConfigField(fields, std::forward<F>(f), std::make_index_sequence<configFieldCount<Fields>()>());
+}
+
+template <class Fields, size_t... I>
+constexpr std::array<const char *, sizeof...(I)> configFieldIds(const Fields &fields, std::index_sequence<I...>)
+{
+    return {{std::get<I>(fields).id...}};
+}
+
+// json keys of all fields in table order, resolved at compile time
+template <class Fields>
+constexpr std::array<const char *, configFieldCount<Fields>()> configFieldIds(const Fields &fields)
+{
+    return configFieldIds(fields, std::make_index_sequence<configFieldCount<Fields>()>());
+}
+
+template <class Fields, class F, size_t... I>
+void visitConfigField(const Fields &fields, size_t index, F &&f, std::index_sequence<I...>)
+{
+    (void)std::initializer_list<int>{((I == index) ? (f(std::get<I>(fields), I), 0) : 0)...};
+}
+
+// calls f(field, index) for the field at a runtime index
+template <class Fields, class F>
+void visitConfigField(const Fields &fields, size_t index, F &&f)
+{
+    visitConfigField(fields, index, std::forward<F>(f), std::make_index_sequence<configFieldCount<Fields>()>());
+}
@@ -7,6 +7,8 @@
 #include "logging.h"
 
 #include "configManager.h"
+#include "configTable.h"
+#include "fsAccounting.h"
 
 // Base address of USER RTC memory
 // https://github.com/esp8266/esp8266-wiki/wiki/Memory-Map#memmory-mapped-io-registers
@@ -16,23 +18,14 @@
 #define RTCMEM_BLOCKS 96u
 #define RTCMEM_MAGIC 0xA4535574 // Change this when modifying RtcmemData
 
+static const size_t ConfigJsonDocumentSize = 2048;
+static const size_t MaxConfigFileSize = 8 * 1024;
+
 static const char RtcConfigFilePath[] PROGMEM = "/rtc.bin";
 static const char ConfigFilePath[] PROGMEM = "/conf.json";
 static const char ConfigChecksumFilePath[] PROGMEM = "/confchksum.json";
-static const char HostNameId[] PROGMEM = "hostname";
-static const char WebUserNameId[] PROGMEM = "webusername";
-static const char WebPasswordId[] PROGMEM = "webpassword";
-static const char HomeKitPairDataId[] PROGMEM = "homekitpairdata";
-
-static const char MaxPowerId[] PROGMEM = "maxpower";
-static const char MaxPowerHoldId[] PROGMEM = "maxpowerhold";
-static const char ReportSendIntervalId[] PROGMEM = "reportsendinterval";
-static const char WattageThresholdId[] PROGMEM = "wattagethreshold";
-static const char WattagePercentThresholdId[] PROGMEM = "wattagepercentthreshold";
-static const char PowerPercentThresholdId[] PROGMEM = "powerpercentthreshold";
-static const char CurrentCalibrationRatioId[] PROGMEM = "currentcalibrationratio";
-static const char VoltageCalibrationRatioId[] PROGMEM = "voltagecalibrationratio";
-static const char PowerCalibrationRatioId[] PROGMEM = "powercalibrationratio";
+static const char ConfigRestoreFilePath[] PROGMEM = "/conf.tmp";
+static const char ConfigChecksumRestoreFilePath[] PROGMEM = "/confchksum.tmp";
 
 config __attribute__((init_priority(101))) config::instance;
 
@@ -49,7 +42,7 @@ String config::md5Hash(T &&...data)
 template <class... T>
 size_t config::writeToFile(const String &fileName, T &&...contents)
 {
-    File file = LittleFS.open(fileName, "w");
+    File file = fsAccounting::instance.open(fileName, "w");
     if (!file)
     {
         return 0;
@@ -70,6 +63,8 @@ void config::erase()
     LittleFS.remove(FPSTR(RtcConfigFilePath));
     LittleFS.remove(FPSTR(ConfigChecksumFilePath));
     LittleFS.remove(FPSTR(ConfigFilePath));
+    LittleFS.remove(FPSTR(ConfigRestoreFilePath));
+    LittleFS.remove(FPSTR(ConfigChecksumRestoreFilePath));
 }
 
 bool config::begin()
@@ -78,58 +73,25 @@ bool config::begin()
 
     rtcmemSetup();
 
-    const auto configData = readFile(FPSTR(ConfigFilePath));
+    const auto configData = readCheckedConfigFile();
 
     if (configData.isEmpty())
     {
-        LOG_INFO(F("No stored config found"));
         reset();
         return false;
     }
 
-    DynamicJsonDocument jsonDocument(2048);
+    DynamicJsonDocument jsonDocument(ConfigJsonDocumentSize);
     if (!deserializeToJson(configData.c_str(), jsonDocument))
     {
         reset();
         return false;
     }
 
-    // read checksum from file
-    const auto readChecksum = readFile(FPSTR(ConfigChecksumFilePath));
-    const auto checksum = md5Hash(configData);
-
-    if (!checksum.equalsIgnoreCase(readChecksum))
-    {
-        LOG_ERROR(F("Config data checksum mismatch"));
-        reset();
-        return false;
-    }
-
-    data.hostName = jsonDocument[FPSTR(HostNameId)].as<String>();
-    data.webUserName = jsonDocument[FPSTR(WebUserNameId)].as<String>();
-    data.webPassword = jsonDocument[FPSTR(WebPasswordId)].as<String>();
-
-    data.reportSendInterval = jsonDocument[FPSTR(ReportSendIntervalId)].as<uint64_t>();
-    data.wattageThreshold = jsonDocument[FPSTR(WattageThresholdId)].as<uint16_t>();
-    data.wattagePercentThreshold = jsonDocument[FPSTR(WattagePercentThresholdId)].as<uint8_t>();
-
-    data.maxPower = jsonDocument[FPSTR(MaxPowerId)].as<uint16_t>();
-    data.maxPowerHold = jsonDocument[FPSTR(MaxPowerHoldId)].as<uint16_t>();
-
-    data.voltageCalibrationRatio = jsonDocument[FPSTR(VoltageCalibrationRatioId)].as<float>();
-    data.currentCalibrationRatio = jsonDocument[FPSTR(CurrentCalibrationRatioId)].as<float>();
-    data.powerCalibrationRatio = jsonDocument[FPSTR(PowerCalibrationRatioId)].as<float>();
-
-    const auto encodedHomeKitData = jsonDocument[FPSTR(HomeKitPairDataId)].as<String>();
-
-    const auto size = base64_decoded_size(reinterpret_cast<const unsigned char *>(encodedHomeKitData.c_str()),
-                                          encodedHomeKitData.length());
-    data.homeKitPairData.resize(size);
-
-    base64_decode_(reinterpret_cast<const unsigned char *>(encodedHomeKitData.c_str()),
-                   encodedHomeKitData.length(), data.homeKitPairData.data());
-
-    data.homeKitPairData.shrink_to_fit();
+    // fields missing from file keep their defaults
+    data.setDefaults();
+    String error;
+    readFields(jsonDocument.as<JsonObjectConst>(), data, false, error);
 
     LOG_DEBUG(F("Loaded Config from file"));
 
@@ -146,28 +108,10 @@ void config::save()
 {
     LOG_INFO(F("Saving configuration"));
 
-    DynamicJsonDocument jsonDocument(2048);
-
-    jsonDocument[FPSTR(HostNameId)] = data.hostName.c_str();
-    jsonDocument[FPSTR(WebUserNameId)] = data.webUserName.c_str();
-    jsonDocument[FPSTR(WebPasswordId)] = data.webPassword.c_str();
-
-    const auto requiredSize = base64_encoded_size(data.homeKitPairData.data(), data.homeKitPairData.size());
-    const auto encodedData = std::make_unique<unsigned char[]>(requiredSize + 1);
-    base64_encode_(data.homeKitPairData.data(), data.homeKitPairData.size(), encodedData.get());
-
-    jsonDocument[FPSTR(HomeKitPairDataId)] = encodedData.get();
-    jsonDocument[FPSTR(ReportSendIntervalId)] = data.reportSendInterval;
+    DynamicJsonDocument jsonDocument(ConfigJsonDocumentSize);
 
-    jsonDocument[FPSTR(MaxPowerId)] = data.maxPower;
-    jsonDocument[FPSTR(MaxPowerHoldId)] = data.maxPowerHold;
-
-    jsonDocument[FPSTR(WattageThresholdId)] = data.wattageThreshold;
-    jsonDocument[FPSTR(WattagePercentThresholdId)] = data.wattagePercentThreshold;
-
-    jsonDocument[FPSTR(VoltageCalibrationRatioId)] = data.voltageCalibrationRatio;
-    jsonDocument[FPSTR(CurrentCalibrationRatioId)] = data.currentCalibrationRatio;
-    jsonDocument[FPSTR(PowerCalibrationRatioId)] = data.powerCalibrationRatio;
+    forEachConfigField(ConfigFields, [this, &jsonDocument](const auto &field, size_t)
+                       { configFieldOps::toJson(jsonDocument.getOrAddMember(FPSTR(field.id)), field.get(data)); });
 
     String json;
     serializeJson(jsonDocument, json);
@@ -208,7 +152,7 @@ void config::loop()
 
 String config::readFile(const String &fileName)
 {
-    File file = LittleFS.open(fileName, "r");
+    File file = fsAccounting::instance.open(fileName, "r");
     if (!file)
     {
         return String();
@@ -219,36 +163,309 @@ String config::readFile(const String &fileName)
     return json;
 }
 
-String config::getAllConfigAsJson()
+// Returns the config file content when it matches the checksum file, empty otherwise.
+// A restore renames the checksum file before the config file, so a power loss in
+// between leaves the new checksum next to the complete restore temp file.
+String config::readCheckedConfigFile()
+{
+    const auto checksum = readFile(FPSTR(ConfigChecksumFilePath));
+    const auto configData = readFile(FPSTR(ConfigFilePath));
+
+    if (!configData.isEmpty() && md5Hash(configData).equalsIgnoreCase(checksum))
+    {
+        LittleFS.remove(FPSTR(ConfigRestoreFilePath));
+        LittleFS.remove(FPSTR(ConfigChecksumRestoreFilePath));
+        return configData;
+    }
+
+    const auto restoredData = readFile(FPSTR(ConfigRestoreFilePath));
+    if (!restoredData.isEmpty() && md5Hash(restoredData).equalsIgnoreCase(checksum) &&
+        LittleFS.rename(FPSTR(ConfigRestoreFilePath), FPSTR(ConfigFilePath)))
+    {
+        LOG_WARNING(F("Finished interrupted config restore"));
+        return restoredData;
+    }
+    LittleFS.remove(FPSTR(ConfigRestoreFilePath));
+
+    if (configData.isEmpty())
+    {
+        LOG_INFO(F("No stored config found"));
+    }
+    else
+    {
+        LOG_ERROR(F("Config data checksum mismatch"));
+    }
+    return String();
+}
+
+File config::openConfigFile()
 {
-    loop(); // save if needed
-    return readFile(FPSTR(ConfigFilePath));
+    // whole file is streamed out by the caller, reads are counted as it goes
+    return fsAccounting::instance.open(FPSTR(ConfigFilePath), "r");
 }
 
-bool config::restoreAllConfigAsJson(const std::vector<uint8_t> &json, const String &hashMd5)
+String config::getConfigChecksum()
 {
-    DynamicJsonDocument jsonDocument(2048);
-    if (!deserializeToJson(json, jsonDocument))
+    return readFile(FPSTR(ConfigChecksumFilePath));
+}
+
+bool config::beginRestoreConfig(const void *owner)
+{
+    if (restoreState)
     {
+        LOG_ERROR(F("Another config restore is in progress"));
         return false;
     }
+    LittleFS.remove(FPSTR(ConfigChecksumRestoreFilePath));
 
-    const auto expectedMd5 = md5Hash(json.data(), json.size());
-    if (!expectedMd5.equalsIgnoreCase(hashMd5))
+    auto state = std::make_unique<RestoreState>();
+    state->owner = owner;
+    state->file = fsAccounting::instance.open(FPSTR(ConfigRestoreFilePath), "w");
+    if (!state->file)
     {
-        LOG_ERROR(F("Uploaded Md5 for config does not match. File md5:") << expectedMd5);
+        LOG_ERROR(F("Failed to open config restore file"));
         return false;
     }
 
-    if (writeToFile(FPSTR(ConfigFilePath), json.data(), json.size()) != json.size())
+    state->md5.begin();
+    state->validator.reset();
+    restoreState = std::move(state);
+    return true;
+}
+
+bool config::writeRestoreConfig(const void *owner, const uint8_t *data, size_t length)
+{
+    if (!isRestoreInProgress(owner))
     {
         return false;
     }
 
-    if (writeToFile(FPSTR(ConfigChecksumFilePath), hashMd5.c_str(), hashMd5.length()) != hashMd5.length())
+    restoreState->size += length;
+    if (restoreState->size > MaxConfigFileSize)
     {
+        LOG_ERROR(F("Uploaded config is larger than ") << MaxConfigFileSize << F(" bytes"));
+        discardRestoreConfig();
         return false;
     }
+
+    if (!restoreState->validator.add(data, length))
+    {
+        LOG_ERROR(F("Uploaded config is not valid json"));
+        discardRestoreConfig();
+        return false;
+    }
+
+    restoreState->md5.add(data, length);
+    const auto written = restoreState->file.write(data, length);
+    if (written != length)
+    {
+        LOG_ERROR(F("Failed to write config restore file"));
+        discardRestoreConfig();
+        return false;
+    }
+    return true;
+}
+
+bool config::endRestoreConfig(const void *owner, const String &hashMd5)
+{
+    if (!isRestoreInProgress(owner))
+    {
+        return false;
+    }
+
+    restoreState->file.close();
+    restoreState->md5.calculate();
+    const auto uploadedMd5 = restoreState->md5.toString();
+    const auto size = restoreState->size;
+
+    if (!restoreState->validator.isComplete())
+    {
+        LOG_ERROR(F("Uploaded config is incomplete json"));
+        discardRestoreConfig();
+        return false;
+    }
+
+    if (!uploadedMd5.equalsIgnoreCase(hashMd5))
+    {
+        LOG_ERROR(F("Uploaded Md5 for config does not match. File md5:") << uploadedMd5);
+        discardRestoreConfig();
+        return false;
+    }
+
+    // same document size as begin() so a restored file is always loadable
+    {
+        File file = fsAccounting::instance.open(FPSTR(ConfigRestoreFilePath), "r");
+        DynamicJsonDocument jsonDocument(ConfigJsonDocumentSize);
+        const auto error = file ? deserializeJson(jsonDocument, file) : DeserializationError(DeserializationError::InvalidInput);
+        file.close();
+        if (error)
+        {
+            LOG_ERROR(F("deserializeJson for restored config failed: ") << error.f_str());
+            discardRestoreConfig();
+            return false;
+        }
+    }
+
+    if (writeToFile(FPSTR(ConfigChecksumRestoreFilePath), uploadedMd5.c_str(), uploadedMd5.length()) != uploadedMd5.length())
+    {
+        discardRestoreConfig();
+        return false;
+    }
+
+    // checksum first, begin() finishes the config rename if power is lost in between
+    if (!LittleFS.rename(FPSTR(ConfigChecksumRestoreFilePath), FPSTR(ConfigChecksumFilePath)))
+    {
+        LOG_ERROR(F("Failed to replace config checksum file"));
+        discardRestoreConfig();
+        return false;
+    }
+    restoreState->checksumCommitted = true;
+
+    const bool renamed = LittleFS.rename(FPSTR(ConfigRestoreFilePath), FPSTR(ConfigFilePath));
+    discardRestoreConfig();
+    if (!renamed)
+    {
+        // the temp file now matches the checksum, kept for begin() to finish
+        LOG_ERROR(F("Failed to replace config file"));
+        return false;
+    }
+
+    LOG_INFO(F("Restored config of size ") << size);
+    return true;
+}
+
+void config::abortRestoreConfig(const void *owner)
+{
+    if (isRestoreInProgress(owner))
+    {
+        discardRestoreConfig();
+    }
+}
+
+// Ends the restore, its temp files are removed unless the checksum already names them
+void config::discardRestoreConfig()
+{
+    restoreState->file.close();
+    if (!restoreState->checksumCommitted)
+    {
+        LittleFS.remove(FPSTR(ConfigRestoreFilePath));
+        LittleFS.remove(FPSTR(ConfigChecksumRestoreFilePath));
+    }
+    restoreState.reset();
+}
+
+bool config::readFields(const JsonObjectConst &json, configData &target, bool fromPatch, String &error)
+{
+    size_t expectedIndex = 0;
+    for (const auto &pair : json)
+    {
+        const auto key = pair.key().c_str();
+
+        // saved files are in table order, so the next field is almost always the match
+        size_t index = ConfigFieldCount;
+        if ((expectedIndex < ConfigFieldCount) && (strcasecmp_P(key, ConfigFieldIds[expectedIndex]) == 0))
+        {
+            index = expectedIndex;
+        }
+        else
+        {
+            for (size_t i = 0; i < ConfigFieldCount; i++)
+            {
+                if (strcasecmp_P(key, ConfigFieldIds[i]) == 0)
+                {
+                    index = i;
+                    break;
+                }
+            }
+        }
+
+        if (index == ConfigFieldCount)
+        {
+            if (fromPatch)
+            {
+                error = String(F("Unknown config field ")) + key;
+                return false;
+            }
+            continue;
+        }
+        expectedIndex = index + 1;
+
+        bool valid = true;
+        visitConfigField(ConfigFields, index, [&](const auto &field, size_t)
+                         {
+                             if (fromPatch && (field.persistence == ConfigPersistence::Internal))
+                             {
+                                 valid = false;
+                             }
+                             else if (pair.value().isNull())
+                             {
+                                 // merge patch null means remove, which is back to default for us
+                                 configFieldOps::setDefault(field.get(target), field.defaultValue);
+                             }
+                             else
+                             {
+                                 valid = configFieldOps::fromJson(pair.value(), field.get(target), field.minValue, field.maxValue);
+                             } });
+
+        if (!valid)
+        {
+            error = String(F("Invalid value for ")) + key;
+            if (fromPatch)
+            {
+                return false;
+            }
+            LOG_ERROR(error); // keeps default
+        }
+    }
+    return true;
+}
+
+uint32_t config::diffFields(const configData &first, const configData &second)
+{
+    uint32_t changedMask = 0;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t index)
+                       {
+                           if (!(field.get(first) == field.get(second)))
+                           {
+                               changedMask |= (1UL << index);
+                           } });
+    return changedMask;
+}
+
+bool config::applyConfigPatch(const JsonObjectConst &patch,
+                              std::vector<const char *> &changedIds,
+                              std::vector<const char *> &restartRequiredIds,
+                              String &error)
+{
+    // validate everything on a copy so a bad field leaves memory untouched
+    configData newData = data;
+    if (!readFields(patch, newData, true, error))
+    {
+        LOG_ERROR(F("Config patch rejected: ") << error);
+        return false;
+    }
+
+    const auto changedMask = diffFields(data, newData);
+    if (!changedMask)
+    {
+        LOG_DEBUG(F("Config patch has no changes"));
+        return true;
+    }
+
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t index)
+                       {
+                           if (changedMask & (1UL << index))
+                           {
+                               changedIds.push_back(field.id);
+                               if (field.persistence == ConfigPersistence::RebootRequired)
+                               {
+                                   restartRequiredIds.push_back(field.id);
+                               }
+                               field.get(data) = field.get(newData);
+                           } });
+
+    LOG_INFO(F("Applied config patch with changes: ") << changedIds.size());
+    save(); // persists once and notifies change listeners
     return true;
 }
 
@@ -338,7 +555,7 @@ void config::tryWriteRtcMemoryToFlash()
 
 bool config::tryReadRtcMemoryFromFlash()
 {
-    File f = LittleFS.open(FPSTR(RtcConfigFilePath), "r");
+    File f = fsAccounting::instance.open(FPSTR(RtcConfigFilePath), "r");
     if (f)
     {
         RtcmemData copy;
@@ -2,6 +2,11 @@
 #include "changeCallBack.h"
 #include <ArduinoJson.h>
 #include <Energy.h>
+#include <FS.h>
+#include <MD5Builder.h>
+
+#include "configData.h"
+#include "jsonStreamValidator.h"
 
 #include <memory>
 
@@ -13,47 +18,6 @@ public:
     void save();
 };
 
-struct configData
-{
-    String hostName;
-    String webUserName;
-    String webPassword;
-    std::vector<uint8_t> homeKitPairData;
-    uint64_t reportSendInterval;
-    uint16_t wattageThreshold;
-    uint8_t wattagePercentThreshold;
-    uint16_t maxPower;
-    uint64_t maxPowerHold;
-    double voltageCalibrationRatio;
-    double currentCalibrationRatio;
-    double powerCalibrationRatio;
-
-    configData()
-    {
-        setDefaults();
-    }
-
-    void setDefaults()
-    {
-        const auto defaultUserIDPassword = F("admin");
-        hostName.clear();
-        webUserName = defaultUserIDPassword;
-        webPassword = defaultUserIDPassword;
-        homeKitPairData.resize(0);
-        reportSendInterval = 60 * 1000;
-        
-        wattageThreshold = 25;
-        wattagePercentThreshold = 5;
-        
-        maxPower = 0;
-        maxPowerHold = 10000;
-
-        voltageCalibrationRatio = 1.0;
-        currentCalibrationRatio = 1.0;
-        powerCalibrationRatio = 1.0;
-    }
-};
-
 class config : public changeCallBack
 {
 public:
@@ -66,7 +30,9 @@ public:
     void erase();
     static config instance;
 
-    String getAllConfigAsJson();
+    // persisted config, streamed as is for backup
+    File openConfigFile();
+    String getConfigChecksum();
 
     void setRelayState(bool state);
     bool getRelayState() const;
@@ -74,8 +40,20 @@ public:
     void setEnergyState(const Energy &state);
     Energy getEnergyState() const;
 
-    // does not restore to memory, needs reboot
-    bool restoreAllConfigAsJson(const std::vector<uint8_t> &json, const String &md5);
+    // streamed restore to a temp file, does not restore to memory, needs reboot;
+    // one at a time, owned by the upload that began it (any pointer identifying it)
+    bool beginRestoreConfig(const void *owner);
+    bool writeRestoreConfig(const void *owner, const uint8_t *data, size_t length);
+    bool endRestoreConfig(const void *owner, const String &md5);
+    void abortRestoreConfig(const void *owner);
+    bool isRestoreInProgress(const void *owner) const { return restoreState && restoreState->owner == owner; }
+
+    // applies a json merge patch (backup keys, matched ignoring case) to memory and saves once,
+    // ids are PROGMEM strings of changed fields and ones needing reboot
+    bool applyConfigPatch(const JsonObjectConst &patch,
+                          std::vector<const char *> &changedIds,
+                          std::vector<const char *> &restartRequiredIds,
+                          String &error);
 
 private:
     struct RtcmemEnergy
@@ -91,13 +69,28 @@ private:
         RtcmemEnergy energy;
     };
 
+    struct RestoreState
+    {
+        File file;
+        MD5Builder md5;
+        JsonStreamValidator validator;
+        size_t size{0};
+        const void *owner{nullptr};
+        // the new checksum is in place, the temp file must survive for begin()
+        bool checksumCommitted{false};
+    };
+
+    void discardRestoreConfig();
+
     bool requestSave{false};
+    std::unique_ptr<RestoreState> restoreState;
     volatile RtcmemData *Rtcmem;
     RtcmemData lastSavedToFlash;
     uint64_t lastRtcSavedToFash{0};
 
     config();
     static String readFile(const String &fileName);
+    static String readCheckedConfigFile();
 
     template <class... T>
     static String md5Hash(T &&...data);
@@ -108,6 +101,9 @@ private:
     template <class T>
     bool deserializeToJson(const T &data, DynamicJsonDocument &jsonDocument);
 
+    static bool readFields(const JsonObjectConst &json, configData &target, bool fromPatch, String &error);
+    static uint32_t diffFields(const configData &first, const configData &second);
+
     void rtcmemSetup();
     bool tryReadRtcMemoryFromFlash();
     void tryWriteRtcMemoryToFlash();
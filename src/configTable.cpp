@@ -0,0 +1,22 @@
+#include "configTable.h"
+
+const char HostNameId[] PROGMEM = "hostname";
+const char WebUserNameId[] PROGMEM = "webusername";
+const char WebPasswordId[] PROGMEM = "webpassword";
+const char HomeKitPairDataId[] PROGMEM = "homekitpairdata";
+const char MaxPowerId[] PROGMEM = "maxpower";
+const char MaxPowerHoldId[] PROGMEM = "maxpowerhold";
+const char ReportSendIntervalId[] PROGMEM = "reportsendinterval";
+const char WattageThresholdId[] PROGMEM = "wattagethreshold";
+const char WattagePercentThresholdId[] PROGMEM = "wattagepercentthreshold";
+const char CurrentCalibrationRatioId[] PROGMEM = "currentcalibrationratio";
+const char VoltageCalibrationRatioId[] PROGMEM = "voltagecalibrationratio";
+const char PowerCalibrationRatioId[] PROGMEM = "powercalibrationratio";
+const char EmptyDefault[] PROGMEM = "";
+const char DefaultUserIdPassword[] PROGMEM = "admin";
+
+void configData::setDefaults()
+{
+    forEachConfigField(ConfigFields, [this](const auto &field, size_t)
+                       { configFieldOps::setDefault(field.get(*this), field.defaultValue); });
+}
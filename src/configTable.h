@@ -0,0 +1,52 @@
+#pragma once
+
+#include "configData.h"
+#include "configFields.h"
+
+// json keys and string defaults of the fields, defined in configTable.cpp
+extern const char HostNameId[] PROGMEM;
+extern const char WebUserNameId[] PROGMEM;
+extern const char WebPasswordId[] PROGMEM;
+extern const char HomeKitPairDataId[] PROGMEM;
+extern const char MaxPowerId[] PROGMEM;
+extern const char MaxPowerHoldId[] PROGMEM;
+extern const char ReportSendIntervalId[] PROGMEM;
+extern const char WattageThresholdId[] PROGMEM;
+extern const char WattagePercentThresholdId[] PROGMEM;
+extern const char CurrentCalibrationRatioId[] PROGMEM;
+extern const char VoltageCalibrationRatioId[] PROGMEM;
+extern const char PowerCalibrationRatioId[] PROGMEM;
+extern const char EmptyDefault[] PROGMEM;
+extern const char DefaultUserIdPassword[] PROGMEM;
+
+// Every persisted field, saved in this order
+static constexpr auto ConfigFields = std::make_tuple(
+    ConfigField<configData, String, &configData::hostName>{
+        HostNameId, EmptyDefault, 0, 64, ConfigPersistence::RebootRequired},
+    ConfigField<configData, String, &configData::webUserName>{
+        WebUserNameId, DefaultUserIdPassword, 1, 64, ConfigPersistence::Live},
+    ConfigField<configData, String, &configData::webPassword>{
+        WebPasswordId, DefaultUserIdPassword, 1, 64, ConfigPersistence::Live},
+    ConfigField<configData, std::vector<uint8_t>, &configData::homeKitPairData>{
+        HomeKitPairDataId, nullptr, 0, 1024, ConfigPersistence::Internal},
+    ConfigField<configData, uint64_t, &configData::reportSendInterval>{
+        ReportSendIntervalId, 60 * 1000, 1000, 600000ULL * 1000, ConfigPersistence::Live},
+    ConfigField<configData, uint16_t, &configData::maxPower>{
+        MaxPowerId, 0, 0, UINT16_MAX, ConfigPersistence::Live},
+    ConfigField<configData, uint64_t, &configData::maxPowerHold>{
+        MaxPowerHoldId, 10000, 0, uint64_t(UINT16_MAX) * 1000, ConfigPersistence::Live},
+    ConfigField<configData, uint16_t, &configData::wattageThreshold>{
+        WattageThresholdId, 25, 0, UINT16_MAX, ConfigPersistence::Live},
+    ConfigField<configData, uint8_t, &configData::wattagePercentThreshold>{
+        WattagePercentThresholdId, 5, 0, 100, ConfigPersistence::Live},
+    ConfigField<configData, double, &configData::voltageCalibrationRatio>{
+        VoltageCalibrationRatioId, 1.0, 0.01, 100, ConfigPersistence::Live},
+    ConfigField<configData, double, &configData::currentCalibrationRatio>{
+        CurrentCalibrationRatioId, 1.0, 0.01, 100, ConfigPersistence::Live},
+    ConfigField<configData, double, &configData::powerCalibrationRatio>{
+        PowerCalibrationRatioId, 1.0, 0.01, 100, ConfigPersistence::Live});
+
+static constexpr size_t ConfigFieldCount = configFieldCount<std::remove_const<decltype(ConfigFields)>::type>();
+static_assert(ConfigFieldCount <= 32, "Config field dirty mask is 32 bits");
+
+static constexpr auto ConfigFieldIds = configFieldIds(ConfigFields);
@@ -0,0 +1,223 @@
+#include "eveHistory.h"
+#include "hardware.h"
+#include "logging.h"
+
+#include <algorithm>
+
+eveHistory eveHistory::instance;
+
+extern "C" homekit_characteristic_t chaHistoryStatus;
+extern "C" homekit_characteristic_t chaHistoryEntries;
+extern "C" homekit_characteristic_t chaHistoryRequest;
+extern "C" homekit_characteristic_t chaHistorySetTime;
+
+namespace
+{
+    void writeUInt16(uint8_t *buffer, uint16_t value)
+    {
+        buffer[0] = value & 0xFF;
+        buffer[1] = value >> 8;
+    }
+
+    void writeUInt32(uint8_t *buffer, uint32_t value)
+    {
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            buffer[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    uint32_t readUInt32(const uint8_t *buffer)
+    {
+        return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+    }
+
+    // copies the part of a record that falls in the requested window
+    size_t copyRecordPart(const uint8_t *record, size_t recordSize, size_t recordOffset,
+                          size_t offset, uint8_t *buffer, size_t size)
+    {
+        if ((offset >= recordOffset + recordSize) || (offset + size <= recordOffset))
+        {
+            return 0;
+        }
+        const size_t from = std::max(offset, recordOffset);
+        const size_t to = std::min(offset + size, recordOffset + recordSize);
+        memcpy(buffer + (from - offset), record + (from - recordOffset), to - from);
+        return to - from;
+    }
+}
+
+void eveHistory::begin()
+{
+    entryStart = lastSample = millis();
+
+    // hooks must be set before server init wraps setters
+    chaHistoryStatus.data_reader = readStatus;
+    chaHistoryEntries.data_reader = readEntries;
+    chaHistoryRequest.setter = onHistoryRequest;
+    chaHistorySetTime.setter = onSetTime;
+}
+
+void eveHistory::loop()
+{
+    const auto now = millis();
+    energySum += hardware::instance.getActivePower() * (now - lastSample);
+    lastSample = now;
+
+    const auto elapsed = now - entryStart;
+    if (elapsed >= EntryInterval * 1000)
+    {
+        const auto averagePower = energySum / elapsed;
+        lastEntry++;
+        ring[(lastEntry - 1) % MaxEntries] = static_cast<uint16_t>(std::min(std::max(averagePower * 10, 0.0), 65535.0));
+
+        entryStart = now;
+        energySum = 0;
+    }
+}
+
+uint32_t eveHistory::firstEntry() const
+{
+    return (lastEntry > MaxEntries) ? (lastEntry - MaxEntries) : 0;
+}
+
+// eve time when the ring started, entry n is n intervals later
+uint32_t eveHistory::refTime() const
+{
+    if (!clockTime)
+    {
+        return 0;
+    }
+    const auto now = millis();
+    const uint32_t nowTime = clockTime + (now - clockMillis) / 1000;
+    return nowTime - lastEntry * EntryInterval - (now - entryStart) / 1000;
+}
+
+void eveHistory::encodeStatus(uint8_t *buffer) const
+{
+    static const uint8_t PROGMEM signature[] = {0x04, 0x01, 0x02, 0x02, 0x02, 0x07, 0x02, 0x0f, 0x03};
+
+    memset(buffer, 0, StatusSize);
+    writeUInt32(buffer, lastEntry * EntryInterval);
+    writeUInt32(buffer + 8, refTime());
+    memcpy_P(buffer + 12, signature, sizeof(signature));
+    writeUInt16(buffer + 21, lastEntry - firstEntry());
+    writeUInt16(buffer + 23, MaxEntries);
+    writeUInt32(buffer + 25, firstEntry());
+    buffer[33] = 0x01;
+    buffer[34] = 0x01;
+}
+
+// oldest entry carries the reference time in place of its data
+bool eveHistory::isRefEntry(uint32_t entry) const
+{
+    return entry == firstEntry() + 1;
+}
+
+uint8_t eveHistory::encodeEntry(uint32_t entry, uint8_t *buffer) const
+{
+    if (isRefEntry(entry))
+    {
+        memset(buffer, 0, RefEntrySize);
+        buffer[0] = RefEntrySize;
+        writeUInt32(buffer + 1, entry);
+        buffer[5] = 0x01;
+        buffer[9] = 0x81;
+        writeUInt32(buffer + 10, refTime());
+        return RefEntrySize;
+    }
+
+    memset(buffer, 0, EntrySize);
+    buffer[0] = EntrySize;
+    writeUInt32(buffer + 1, entry);
+    writeUInt32(buffer + 5, entry * EntryInterval);
+    buffer[9] = 0x1f;
+    writeUInt16(buffer + 14, ring[(entry - 1) % MaxEntries]);
+    return EntrySize;
+}
+
+size_t eveHistory::batchSize() const
+{
+    if (!batchCount)
+    {
+        return 1; // single 0 byte ends the transfer
+    }
+    return batchCount * EntrySize + (isRefEntry(batchStart) ? (RefEntrySize - EntrySize) : 0);
+}
+
+size_t eveHistory::readStatus(const homekit_characteristic_t *, size_t offset, uint8_t *buffer, size_t size)
+{
+    uint8_t status[StatusSize];
+    instance.encodeStatus(status);
+    return copyRecordPart(status, StatusSize, 0, offset, buffer, size);
+}
+
+size_t eveHistory::readEntries(const homekit_characteristic_t *, size_t offset, uint8_t *buffer, size_t size)
+{
+    auto &self = instance;
+    if (offset == 0)
+    {
+        self.batchStart = std::max(self.nextReadEntry, self.firstEntry() + 1);
+        self.batchCount = (self.batchStart <= self.lastEntry) ? std::min<uint32_t>(EntriesPerRead, self.lastEntry - self.batchStart + 1) : 0;
+    }
+
+    const auto total = self.batchSize();
+    if (!self.batchCount)
+    {
+        if (offset == 0 && size)
+        {
+            buffer[0] = 0;
+            return 1;
+        }
+        return 0;
+    }
+
+    // skip to the entry holding offset, only the first record can differ in size
+    const size_t firstSize = self.isRefEntry(self.batchStart) ? RefEntrySize : EntrySize;
+    auto entry = self.batchStart;
+    size_t recordOffset = 0;
+    if (offset >= firstSize)
+    {
+        const auto skip = 1 + (offset - firstSize) / EntrySize;
+        entry += skip;
+        recordOffset = firstSize + (skip - 1) * EntrySize;
+    }
+
+    size_t copied = 0;
+    uint8_t record[RefEntrySize];
+    const auto endEntry = self.batchStart + self.batchCount;
+    for (; (entry < endEntry) && (recordOffset < offset + size); entry++)
+    {
+        const auto recordSize = self.encodeEntry(entry, record);
+        copied += copyRecordPart(record, recordSize, recordOffset, offset, buffer, size);
+        recordOffset += recordSize;
+    }
+
+    if (offset + copied >= total)
+    {
+        // whole batch sent, controller reads again for the next one
+        self.nextReadEntry = self.batchStart + self.batchCount;
+    }
+    return copied;
+}
+
+void eveHistory::onHistoryRequest(const homekit_value_t value)
+{
+    if (value.is_null || (value.data_size < 6))
+    {
+        return;
+    }
+    const auto entry = readUInt32(value.data_value + 2);
+    instance.nextReadEntry = entry ? entry : 1;
+    LOG_DEBUG(F("Eve history requested from entry ") << instance.nextReadEntry);
+}
+
+void eveHistory::onSetTime(const homekit_value_t value)
+{
+    if (value.is_null || (value.data_size < 4))
+    {
+        return;
+    }
+    instance.clockTime = readUInt32(value.data_value);
+    instance.clockMillis = millis();
+}
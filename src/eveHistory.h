@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <homekit/homekit.h>
+
+// Eve compatible energy history, 10 minute power averages kept in a ring
+// and encoded straight from it when a controller reads the entries
+class eveHistory
+{
+public:
+    void begin();
+    void loop();
+
+    static eveHistory instance;
+
+private:
+    static const uint16_t MaxEntries = 432;             // 3 days
+    static const uint32_t EntryInterval = 10 * 60;      // seconds
+    static const uint16_t EntriesPerRead = 144;         // a day per bulk read
+    static const uint8_t EntrySize = 20;
+    static const uint8_t RefEntrySize = 21;
+    static const uint8_t StatusSize = 35;
+
+    uint16_t ring[MaxEntries]{}; // average power * 10, entry n at (n - 1) % MaxEntries
+    uint32_t lastEntry{0};       // first entry is 1, 0 when empty
+    uint32_t entryStart{0};      // millis
+    uint32_t lastSample{0};      // millis
+    double energySum{0};         // W * ms in current entry
+
+    uint32_t nextReadEntry{1}; // set by controller through history request
+    uint32_t batchStart{0};
+    uint16_t batchCount{0};
+
+    uint32_t clockTime{0}; // seconds since 2001-01-01, 0 until controller sets it
+    uint32_t clockMillis{0};
+
+    eveHistory() {}
+
+    uint32_t firstEntry() const;
+    uint32_t refTime() const;
+    size_t batchSize() const;
+    bool isRefEntry(uint32_t entry) const;
+    void encodeStatus(uint8_t *buffer) const;
+    uint8_t encodeEntry(uint32_t entry, uint8_t *buffer) const;
+
+    static size_t readStatus(const homekit_characteristic_t *ch, size_t offset, uint8_t *buffer, size_t size);
+    static size_t readEntries(const homekit_characteristic_t *ch, size_t offset, uint8_t *buffer, size_t size);
+    static void onHistoryRequest(const homekit_value_t value);
+    static void onSetTime(const homekit_value_t value);
+};
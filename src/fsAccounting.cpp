@@ -0,0 +1,200 @@
+#include "fsAccounting.h"
+
+#include <FSImpl.h>
+#include <LittleFS.h>
+#include "logging.h"
+
+fsAccounting fsAccounting::instance;
+
+// The opened LittleFS file behind a File, counting what passes through it;
+// Stream reads (readString, readBytes, json parsing) all end in read()
+class fsAccounting::CountingFileImpl : public fs::FileImpl
+{
+public:
+    CountingFileImpl(File &&file, Entry *entry) : file(std::move(file)), entry(entry) {}
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        const auto written = file.write(buffer, size);
+        instance.countWrite(entry, written);
+        return written;
+    }
+
+    int read(uint8_t *buffer, size_t size) override
+    {
+        const int bytesRead = file.read(buffer, size);
+        if (bytesRead > 0)
+        {
+            instance.countRead(entry, bytesRead);
+        }
+        return bytesRead;
+    }
+
+    void flush() override { file.flush(); }
+    bool seek(uint32_t pos, fs::SeekMode mode) override { return file.seek(pos, mode); }
+    size_t position() const override { return file.position(); }
+    size_t size() const override { return file.size(); }
+    int availableForWrite() override { return file.availableForWrite(); }
+    bool truncate(uint32_t size) override { return file.truncate(size); }
+    void close() override { file.close(); }
+    const char *name() const override { return file.name(); }
+    const char *fullName() const override { return file.fullName(); }
+    bool isFile() const override { return file.isFile(); }
+    bool isDirectory() const override { return file.isDirectory(); }
+    time_t getLastWrite() override { return file.getLastWrite(); }
+    time_t getCreationTime() override { return file.getCreationTime(); }
+    void setTimeCallback(time_t (*cb)(void)) override { file.setTimeCallback(cb); }
+
+private:
+    mutable File file;
+    Entry *const entry; // null when the path table is full
+};
+
+File fsAccounting::open(const String &path, const char *mode)
+{
+    File file = LittleFS.open(path, mode);
+    if (!file)
+    {
+        return file;
+    }
+
+    auto entry = getEntry(path);
+    countOpen(entry, mode[0] != 'r');
+    return File(std::make_shared<CountingFileImpl>(std::move(file), entry), &LittleFS);
+}
+
+void fsAccounting::addOpen(const String &path, bool forWrite)
+{
+    countOpen(getEntry(path), forWrite);
+}
+
+void fsAccounting::addWrite(const String &path, size_t bytes)
+{
+    countWrite(getEntry(path), bytes);
+}
+
+void fsAccounting::countOpen(Entry *entry, bool forWrite)
+{
+    if (entry)
+    {
+        entry->opens++;
+        if (forWrite)
+        {
+            // copy on write fs, a rewritten file goes to fresh blocks
+            entry->eraseBlocks++;
+            entry->pendingBlockBytes = 0;
+        }
+    }
+}
+
+void fsAccounting::countRead(Entry *entry, size_t bytes)
+{
+    if (entry)
+    {
+        entry->bytesRead += bytes;
+    }
+}
+
+void fsAccounting::countWrite(Entry *entry, size_t bytes)
+{
+    if (!entry)
+    {
+        return;
+    }
+
+    advanceBuckets();
+    entry->bytesWritten += bytes;
+    entry->rateBuckets[currentBucket] += bytes;
+
+    entry->pendingBlockBytes += bytes;
+    while (entry->pendingBlockBytes > BlockSize)
+    {
+        entry->eraseBlocks++;
+        entry->pendingBlockBytes -= BlockSize;
+    }
+
+    const auto lastHour = writtenLastHour(*entry);
+    if (lastHour > FS_WRITE_BUDGET_PER_HOUR)
+    {
+        if (!entry->overBudget)
+        {
+            entry->overBudget = true;
+            LOG_WARNING(F("Flash writes for ") << entry->path << F(" over budget: ") << lastHour << F(" bytes in last hour"));
+        }
+    }
+    else
+    {
+        entry->overBudget = false;
+    }
+}
+
+void fsAccounting::forEach(std::function<void(const Stats &)> callback)
+{
+    advanceBuckets();
+    for (uint8_t i = 0; i < entriesCount; i++)
+    {
+        Stats stats;
+        stats.path = entries[i].path;
+        stats.opens = entries[i].opens;
+        stats.bytesRead = entries[i].bytesRead;
+        stats.bytesWritten = entries[i].bytesWritten;
+        stats.eraseBlocks = entries[i].eraseBlocks;
+        stats.bytesWrittenLastHour = writtenLastHour(entries[i]);
+        callback(stats);
+    }
+}
+
+fsAccounting::Entry *fsAccounting::getEntry(const String &path)
+{
+    advanceBuckets();
+
+    for (uint8_t i = 0; i < entriesCount; i++)
+    {
+        if (entries[i].path == path)
+        {
+            return &entries[i];
+        }
+    }
+
+    if (entriesCount >= MaxPaths)
+    {
+        LOG_DEBUG(F("No space to account flash I/O for ") << path);
+        return nullptr;
+    }
+
+    auto &entry = entries[entriesCount++];
+    entry.path = path;
+    return &entry;
+}
+
+void fsAccounting::advanceBuckets()
+{
+    const auto now = millis();
+    uint8_t steps = 0;
+    while ((now - currentBucketStart >= RateBucketInterval) && (steps < RateBuckets))
+    {
+        currentBucket = (currentBucket + 1) % RateBuckets;
+        currentBucketStart += RateBucketInterval;
+        for (uint8_t i = 0; i < entriesCount; i++)
+        {
+            entries[i].rateBuckets[currentBucket] = 0;
+        }
+        steps++;
+    }
+
+    if (now - currentBucketStart >= RateBucketInterval)
+    {
+        // idle for more than an hour, all buckets are already clear
+        currentBucketStart = now;
+    }
+}
+
+uint32_t fsAccounting::writtenLastHour(const Entry &entry)
+{
+    uint32_t total = 0;
+    for (auto &&bytes : entry.rateBuckets)
+    {
+        total += bytes;
+    }
+    return total;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+
+#ifndef FS_WRITE_BUDGET_PER_HOUR
+#define FS_WRITE_BUDGET_PER_HOUR (16 * 1024) // bytes per path before warning
+#endif
+
+// Counts flash I/O per path so wear of each feature can be seen. Every read
+// and write of a file opened here is counted by the file itself; addOpen()
+// and addWrite() are only for flash written without a File (firmware update).
+class fsAccounting
+{
+public:
+    struct Stats
+    {
+        String path;
+        uint32_t opens{0};
+        uint32_t bytesRead{0};
+        uint32_t bytesWritten{0};
+        uint32_t eraseBlocks{0}; // estimate
+        uint32_t bytesWrittenLastHour{0};
+    };
+
+    // LittleFS open which is counted, write modes start a new block; the
+    // returned file counts the bytes read and written through it
+    File open(const String &path, const char *mode);
+
+    void addOpen(const String &path, bool forWrite);
+    void addWrite(const String &path, size_t bytes);
+
+    void forEach(std::function<void(const Stats &)> callback);
+
+    static fsAccounting instance;
+
+private:
+    class CountingFileImpl;
+
+    static const uint8_t MaxPaths = 8;
+    static const uint8_t RateBuckets = 6;
+    static const uint32_t RateBucketInterval = 10 * 60 * 1000; // 10 mins, buckets cover 1 hr
+    static const uint32_t BlockSize = 4096;
+
+    struct Entry
+    {
+        String path;
+        uint32_t opens;
+        uint32_t bytesRead;
+        uint32_t bytesWritten;
+        uint32_t eraseBlocks;
+        uint32_t pendingBlockBytes;
+        uint32_t rateBuckets[RateBuckets];
+        bool overBudget;
+    };
+
+    Entry entries[MaxPaths]{};
+    uint8_t entriesCount{0};
+    uint8_t currentBucket{0};
+    uint32_t currentBucketStart{0};
+
+    fsAccounting() {}
+    Entry *getEntry(const String &path);
+    void countOpen(Entry *entry, bool forWrite);
+    void countRead(Entry *entry, size_t bytes);
+    void countWrite(Entry *entry, size_t bytes);
+    void advanceBuckets();
+    static uint32_t writtenLastHour(const Entry &entry);
+};
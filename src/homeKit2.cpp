@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <LittleFS.h>
 
 #include "homeKit2.h"
 #include "configManager.h"
@@ -6,6 +7,7 @@
 #include "hardware.h"
 #include "logging.h"
 #include "homekit2helper.h"
+#include "fsAccounting.h"
 
 #include <math.h>
 #include <homekit/homekit.h>
@@ -14,6 +16,46 @@
 
 homeKit2 homeKit2::instance;
 
+namespace
+{
+    // When a measured value is worth a notification. A change is sent when it
+    // crosses either threshold, smaller changes wait for the report interval.
+    struct reportPolicy
+    {
+        double absoluteThreshold; // 0 disables
+        uint8_t percentThreshold; // 0 disables
+
+        bool shouldReport(double reported, double current, bool intervalElapsed) const
+        {
+            if (isnan(reported) || isnan(current))
+            {
+                return intervalElapsed || (isnan(reported) != isnan(current));
+            }
+
+            const auto change = std::abs(current - reported);
+            if (change == 0)
+            {
+                return false;
+            }
+
+            return intervalElapsed ||
+                   ((absoluteThreshold > 0) && (change >= absoluteThreshold)) ||
+                   ((percentThreshold > 0) && (change * 100 >= std::abs(reported) * percentThreshold));
+        }
+    };
+
+    template <size_t N>
+    void addIfReportable(chaNotifyBatch<N> &batch, homekit_characteristic_t &cha, double value,
+                         const reportPolicy &policy, bool intervalElapsed)
+    {
+        const double reported = cha.value.is_null ? NAN : cha.value.float_value;
+        if (policy.shouldReport(reported, value, intervalElapsed))
+        {
+            batch.template add<double>(cha, std::move(value));
+        }
+    }
+}
+
 extern "C" homekit_server_config_t config;
 
 extern "C" homekit_characteristic_t chaName;
@@ -44,11 +86,15 @@ void homeKit2::begin()
     serialNumber = String(ESP.getChipId(), HEX);
     serialNumber.toUpperCase();
 
-    localIP = WifiManager::instance.LocalIP().toString();
-
     config::instance.addConfigSaveCallback(std::bind(&homeKit2::onConfigChange, this));
     hardware::instance.relayChangeCallback.addConfigSaveCallback(std::bind(&homeKit2::notifyRelaychange, this));
     hardware::instance.activePowerChangeCallback.addConfigSaveCallback(std::bind(&homeKit2::checkPowerChanged, this));
+    WifiManager::instance.connectionChangeCallback.addConfigSaveCallback([this]
+                                                                       {
+                                                                           notifyIPAddressChange();
+                                                                           notifyWifiRssiChange();
+                                                                       });
+    WifiManager::instance.rssiChangeCallback.addConfigSaveCallback(std::bind(&homeKit2::notifyWifiRssiChange, this));
 
     chaReportSendInterval.setter = onReportSendIntervalChange;
     chaOutlet.setter = onRelayChange;
@@ -65,7 +111,7 @@ void homeKit2::begin()
     updateChaValue(chaReportSendWattsPercentage, config::instance.data.wattagePercentThreshold);
     updateChaValue(chaMaxPower, config::instance.data.maxPower);
     updateChaValue<uint16_t>(chaMaxPowerHold, config::instance.data.maxPowerHold / 1000);
-    updateChaValue(chaWifiIPAddress, localIP.c_str());
+    updateChaValue(chaWifiIPAddress, WifiManager::instance.LocalIPString().c_str());
     updateChaValue<int>(chaWifiRssi, WifiManager::instance.RSSI());
     updateChaValue(chaOutlet, hardware::instance.isRelayOn());
     updateChaValue(chaOutletInUse, hardware::instance.anyPower());
@@ -87,7 +133,7 @@ void homeKit2::begin()
     notifyWifiRssiChange();
     notifyRelaychange();
     notifyOutletInUse();
-    notifyPowerReport();
+    notifyPowerReport(true);
 }
 
 void homeKit2::onConfigChange()
@@ -126,8 +172,8 @@ void homeKit2::notifyConfigValueChanges()
 
 void homeKit2::notifyIPAddressChange()
 {
-    localIP = WifiManager::instance.LocalIP().toString();
-    updateChaValue(chaWifiIPAddress, localIP.c_str());
+    // cached string keeps its buffer, so the characteristic can point at it
+    updateChaValue(chaWifiIPAddress, WifiManager::instance.LocalIPString().c_str());
     homekit_characteristic_notify(&chaWifiIPAddress, chaWifiIPAddress.value);
 }
 
@@ -139,23 +185,9 @@ void homeKit2::notifyWifiRssiChange()
 void homeKit2::loop()
 {
     const auto now = millis();
-    if ((now - lastCheckedForNonEvents > config::instance.data.reportSendInterval))
-    {
-        if (localIP != WifiManager::instance.LocalIP().toString())
-        {
-            notifyIPAddressChange();
-        }
-        const auto delta = std::abs(chaWifiRssi.value.int_value - WifiManager::instance.RSSI());
-        if (delta > 2)
-        {
-            notifyWifiRssiChange();
-        }
-        lastCheckedForNonEvents = now;
-    }
-
     if (now - lastPowerReport > config::instance.data.reportSendInterval)
     {
-        notifyPowerReport();
+        notifyPowerReport(true);
     }
 
     arduino_homekit_loop();
@@ -243,18 +275,7 @@ void homeKit2::notifyRelaychange()
 void homeKit2::checkPowerChanged()
 {
     notifyOutletInUse();
-
-    const auto prevValue = chaActivePower.value.float_value;
-    const auto powerNow = hardware::instance.getActivePower();
-
-    const auto changeInPower = std::abs(prevValue - powerNow);
-    const bool shouldSend = (changeInPower >= config::instance.data.wattageThreshold) ||
-                            (changeInPower * 100 >= prevValue * config::instance.data.wattageThreshold);
-
-    if (shouldSend)
-    {
-        notifyPowerReport();
-    }
+    notifyPowerReport(false);
 }
 
 void homeKit2::notifyOutletInUse()
@@ -263,14 +284,25 @@ void homeKit2::notifyOutletInUse()
     notifyChaValue(chaOutletInUse, currentOutletInUse);
 }
 
-void homeKit2::notifyPowerReport()
+void homeKit2::notifyPowerReport(bool intervalElapsed)
 {
-    lastPowerReport = millis();
-    notifyChaValue<double>(chaVoltage, hardware::instance.getVoltage());
-    notifyChaValue<double>(chaCurrent, hardware::instance.getCurrent());
-    notifyChaValue<double>(chaActivePower, hardware::instance.getActivePower());
-    notifyChaValue<double>(chaApparantPower, hardware::instance.getApparentPower());
-    notifyChaValue<double>(chaEnergy, hardware::instance.getEnergy());
+    const auto &data = config::instance.data;
+    const reportPolicy powerPolicy{static_cast<double>(data.wattageThreshold), data.wattagePercentThreshold};
+    const reportPolicy relativePolicy{0, data.wattagePercentThreshold};
+    const reportPolicy intervalPolicy{0, 0};
+
+    if (intervalElapsed)
+    {
+        lastPowerReport = millis();
+    }
+
+    chaNotifyBatch<5> batch;
+    addIfReportable(batch, chaVoltage, hardware::instance.getVoltage(), relativePolicy, intervalElapsed);
+    addIfReportable(batch, chaCurrent, hardware::instance.getCurrent(), relativePolicy, intervalElapsed);
+    addIfReportable(batch, chaActivePower, hardware::instance.getActivePower(), powerPolicy, intervalElapsed);
+    addIfReportable(batch, chaApparantPower, hardware::instance.getApparentPower(), powerPolicy, intervalElapsed);
+    addIfReportable(batch, chaEnergy, hardware::instance.getEnergy(), intervalPolicy, intervalElapsed);
+    batch.notify();
 }
 
 int homeKit2::getConnectedClientsCount()
@@ -310,9 +342,48 @@ bool write_storage(uint32 desAddress, byte *srcAddress, uint32 size)
     return true;
 }
 
+File homekit_file_open(const char *path, const char *mode)
+{
+    return fsAccounting::instance.open(path, mode);
+}
+
 bool reset_storage()
 {
     config::instance.data.homeKitPairData.resize(0);
     config::instance.save();
     return true;
 }
+
+bool read_storage_file(const char *path, byte *data, uint32 size)
+{
+    File file = fsAccounting::instance.open(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    const size_t bytesRead = file.read(data, size);
+    return file.size() == size && bytesRead == size;
+}
+
+bool write_storage_file(const char *path, const byte *data, uint32 size)
+{
+    LOG_TRACE(F("Writing HomeKit file ") << path << F(" size ") << size);
+    File file = fsAccounting::instance.open(path, "w");
+    if (!file)
+    {
+        return false;
+    }
+    const size_t bytesWritten = file.write(data, size);
+    file.close();
+    if (bytesWritten != size)
+    {
+        LittleFS.remove(path);
+        return false;
+    }
+    return true;
+}
+
+bool remove_storage_file(const char *path)
+{
+    return !LittleFS.exists(path) || LittleFS.remove(path);
+}
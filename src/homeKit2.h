@@ -44,15 +44,13 @@ private:
     void notifyRelaychange();
     void notifyOutletInUse();
 
-    void notifyPowerReport();
+    void notifyPowerReport(bool intervalElapsed);
 
     void checkPowerChanged();
 
     String accessoryName;
     String password;
     String serialNumber;
-    String localIP;
 
-    uint64_t lastCheckedForNonEvents{0};
     uint64_t lastPowerReport{0};
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <homekit/homekit.h>
+#include <arduino_homekit_server.h>
 #include <math.h>
 
 template <class T>
@@ -80,6 +81,37 @@ void notifyChaValue(homekit_characteristic_t &cha, T &&value)
     }
 }
 
+// Collects changed values so they can be sent in one notify
+template <size_t N>
+class chaNotifyBatch
+{
+public:
+    template <class T>
+    void add(homekit_characteristic_t &cha, T &&value)
+    {
+        const auto prevValue = updateChaValue(cha, std::forward<T>(value));
+        if ((value != prevValue) && (count < N))
+        {
+            changes[count].characteristic = &cha;
+            changes[count].value = cha.value;
+            count++;
+        }
+    }
+
+    void notify()
+    {
+        if (count)
+        {
+            homekit_characteristics_notify(changes, count);
+            count = 0;
+        }
+    }
+
+private:
+    homekit_characteristic_change_t changes[N];
+    size_t count{0};
+};
+
 void updateChaValue(homekit_characteristic_t &cha, const char *value)
 {
     if (value)
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Structural json check that can be fed in chunks with fixed state.
+// Validates nesting, strings and the single root object; scalar values are
+// only checked for allowed characters, full parse is left to ArduinoJson.
+class JsonStreamValidator
+{
+public:
+    void reset()
+    {
+        containerStack = 0;
+        depth = 0;
+        inString = false;
+        escape = false;
+        rootStarted = false;
+        rootClosed = false;
+        failed = false;
+    }
+
+    bool add(const uint8_t *data, size_t length)
+    {
+        for (size_t i = 0; (i < length) && !failed; i++)
+        {
+            failed = !addChar(static_cast<char>(data[i]));
+        }
+        return !failed;
+    }
+
+    bool isComplete() const
+    {
+        return !failed && rootClosed;
+    }
+
+private:
+    static const uint8_t MaxDepth = 32; // one bit per level in containerStack
+
+    uint32_t containerStack{0}; // bit set for array, clear for object
+    uint8_t depth{0};
+    bool inString{false};
+    bool escape{false};
+    bool rootStarted{false};
+    bool rootClosed{false};
+    bool failed{false};
+
+    bool addChar(char c)
+    {
+        if (inString)
+        {
+            if (escape)
+            {
+                escape = false;
+            }
+            else if (c == '\\')
+            {
+                escape = true;
+            }
+            else if (c == '"')
+            {
+                inString = false;
+            }
+            else if (static_cast<uint8_t>(c) < 0x20)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        if (isspace(c))
+        {
+            return true;
+        }
+
+        if (rootClosed)
+        {
+            return false;
+        }
+
+        if (!rootStarted)
+        {
+            // config is always an object
+            if (c != '{')
+            {
+                return false;
+            }
+            rootStarted = true;
+        }
+
+        switch (c)
+        {
+        case '{':
+        case '[':
+            if (depth >= MaxDepth)
+            {
+                return false;
+            }
+            if (c == '[')
+            {
+                containerStack |= (1UL << depth);
+            }
+            else
+            {
+                containerStack &= ~(1UL << depth);
+            }
+            depth++;
+            return true;
+
+        case '}':
+        case ']':
+        {
+            if (depth == 0)
+            {
+                return false;
+            }
+            depth--;
+            const bool isArray = containerStack & (1UL << depth);
+            if (isArray != (c == ']'))
+            {
+                return false;
+            }
+            rootClosed = (depth == 0);
+            return true;
+        }
+
+        case '"':
+            inString = true;
+            return true;
+
+        default:
+            return isalnum(c) || (c == ',') || (c == ':') || (c == '.') || (c == '-') || (c == '+');
+        }
+    }
+};
@@ -6,6 +6,7 @@
 #include "operations.h"
 #include "hardware.h"
 #include "homeKit2.h"
+#include "eveHistory.h"
 #include "logging.h"
 
 void setup(void)
@@ -17,6 +18,7 @@ void setup(void)
 	hardware::instance.begin();
 	WifiManager::instance.begin(); // 3
 	WebServer::instance.begin(); // 4
+	eveHistory::instance.begin(); // before homekit init
 	homeKit2::instance.begin(); // 5
 
 	hardware::instance.setLedDefaultState();
@@ -28,6 +30,7 @@ void loop(void)
 	config::instance.loop();
 	WifiManager::instance.loop();
 	homeKit2::instance.loop();
+	eveHistory::instance.loop();
 	hardware::instance.loop();
 	operations::instance.loop(); // this can restart etc so last
 }
@@ -155,6 +155,44 @@
     .value = HOMEKIT_FLOAT_(_value),                                             \
     ##__VA_ARGS__
 
+#define HOMEKIT_SERVICE_CUSTOM_HISTORY HOMEKIT_ELGATO_UUID("E863F007")
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_STATUS HOMEKIT_ELGATO_UUID("E863F116")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_HISTORY_STATUS(...)                \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_STATUS,                        \
+    .description = "History Status",                                             \
+    .format = homekit_format_data,                                               \
+    .permissions = homekit_permissions_paired_read | homekit_permissions_hidden, \
+    .value = HOMEKIT_DATA_(NULL, 0),                                             \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_ENTRIES HOMEKIT_ELGATO_UUID("E863F117")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_HISTORY_ENTRIES(...)               \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_ENTRIES,                       \
+    .description = "History Entries",                                            \
+    .format = homekit_format_data,                                               \
+    .permissions = homekit_permissions_paired_read | homekit_permissions_hidden, \
+    .value = HOMEKIT_DATA_(NULL, 0),                                             \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_REQUEST HOMEKIT_ELGATO_UUID("E863F11C")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_HISTORY_REQUEST(...)                \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_REQUEST,                        \
+    .description = "History Request",                                             \
+    .format = homekit_format_data,                                                \
+    .permissions = homekit_permissions_paired_write | homekit_permissions_hidden, \
+    .value = HOMEKIT_DATA_(NULL, 0),                                              \
+    ##__VA_ARGS__
+
+#define HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_SET_TIME HOMEKIT_ELGATO_UUID("E863F121")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_CUSTOM_HISTORY_SET_TIME(...)               \
+    .type = HOMEKIT_CHARACTERISTIC_CUSTOM_HISTORY_SET_TIME,                       \
+    .description = "History Set Time",                                            \
+    .format = homekit_format_data,                                                \
+    .permissions = homekit_permissions_paired_write | homekit_permissions_hidden, \
+    .value = HOMEKIT_DATA_(NULL, 0),                                              \
+    ##__VA_ARGS__
+
 homekit_characteristic_t chaName = HOMEKIT_CHARACTERISTIC_(NAME, "Sonoff S31", .id=100);
 homekit_characteristic_t chaSerial = HOMEKIT_CHARACTERISTIC_(SERIAL_NUMBER, NULL, .id=102);
 
@@ -176,6 +214,11 @@ homekit_characteristic_t chaReportSendWattsPercentage = HOMEKIT_CHARACTERISTIC_(
 homekit_characteristic_t chaMaxPower = HOMEKIT_CHARACTERISTIC_(CUSTOM_MAX_POWER, 0, .id = 503);
 homekit_characteristic_t chaMaxPowerHold = HOMEKIT_CHARACTERISTIC_(CUSTOM_MAX_POWER_HOLD, 0, .id = 504);
 
+homekit_characteristic_t chaHistoryStatus = HOMEKIT_CHARACTERISTIC_(CUSTOM_HISTORY_STATUS, .id = 601);
+homekit_characteristic_t chaHistoryEntries = HOMEKIT_CHARACTERISTIC_(CUSTOM_HISTORY_ENTRIES, .id = 602);
+homekit_characteristic_t chaHistoryRequest = HOMEKIT_CHARACTERISTIC_(CUSTOM_HISTORY_REQUEST, .id = 603);
+homekit_characteristic_t chaHistorySetTime = HOMEKIT_CHARACTERISTIC_(CUSTOM_HISTORY_SET_TIME, .id = 604);
+
 homekit_accessory_t *accessories[] = {
     HOMEKIT_ACCESSORY(.id=1, .category=homekit_accessory_category_sensor, .services=(homekit_service_t*[]) {
         HOMEKIT_SERVICE(ACCESSORY_INFORMATION, .id=1, .characteristics=(homekit_characteristic_t*[]) {
@@ -215,6 +258,14 @@ homekit_accessory_t *accessories[] = {
             &chaMaxPowerHold,
             NULL
         }),
+
+        HOMEKIT_SERVICE(CUSTOM_HISTORY, .id=6, .characteristics=(homekit_characteristic_t*[]) {
+            &chaHistoryStatus,
+            &chaHistoryEntries,
+            &chaHistoryRequest,
+            &chaHistorySetTime,
+            NULL
+        }),
         NULL
     }),
     NULL
@@ -16,8 +16,11 @@
 
 #include "WiFiManager.h"
 #include "configManager.h"
+#include "fsAccounting.h"
 #include "logging.h"
 
+static const char FirmwareAccountingPath[] PROGMEM = "firmware";
+
 operations operations::instance;
 
 void operations::factoryReset()
@@ -76,6 +79,7 @@ bool operations::startUpdate(size_t length, const String &md5, String &error)
 
 	if (Update.begin(maxSketchSpace))
 	{
+		fsAccounting::instance.addOpen(FPSTR(FirmwareAccountingPath), true);
 		LOG_DEBUG(F("Update begin successfull"));
 		return true;
 	}
@@ -94,6 +98,7 @@ bool operations::writeUpdate(const uint8_t *data, size_t length, String &error)
 									  << F(" progress:") << Update.progress()
 									  << F(" remaining:") << Update.remaining());
 	const auto written = Update.write(const_cast<uint8_t *>(data), length);
+	fsAccounting::instance.addWrite(FPSTR(FirmwareAccountingPath), written);
 	if (written == length)
 	{
 		LOG_DEBUG(F("Update write successful"));
@@ -8,6 +8,7 @@
 
 #include "WiFiManager.h"
 #include "configManager.h"
+#include "fsAccounting.h"
 #include "operations.h"
 #include "hardware.h"
 #include "homeKit2.h"
@@ -50,6 +51,8 @@ static const char MdbCssUrl[] PROGMEM = "/css/mdb.min.css";
 static const char MD5Header[] PROGMEM = "md5";
 static const char CacheControlHeader[] PROGMEM = "Cache-Control";
 static const char CookieHeader[] PROGMEM = "Cookie";
+static const char ETagHeader[] PROGMEM = "ETag";
+static const char IfNoneMatchHeader[] PROGMEM = "If-None-Match";
 
 const static StaticFilesMap staticFilesMap[] PROGMEM = {
 	{IndexUrl, index_html_gz, index_html_gz_len, HtmlMediaType, true},
@@ -137,6 +140,10 @@ void WebServer::serverRouting()
 	relayUpdateHandler->setMethod(HTTP_PUT);
 	httpServer.addHandler(relayUpdateHandler);
 
+	auto configPatchHandler = new AsyncCallbackJsonWebHandler("/api/config/patch", configPatch, 1024);
+	configPatchHandler->setMethod(HTTP_PATCH);
+	httpServer.addHandler(configPatchHandler);
+
 	httpServer.onNotFound(handleFileRead);
 }
 
@@ -177,7 +184,7 @@ void WebServer::wifiGet(AsyncWebServerRequest *request)
 	auto jsonBuffer = response->getRoot();
 
 	jsonBuffer[F("captivePortal")] = WifiManager::instance.isCaptivePortal();
-	jsonBuffer[F("ssid")] = WifiManager::SSID();
+	jsonBuffer[F("ssid")] = WifiManager::instance.SSID();
 
 	response->setLength();
 	request->send(response);
@@ -231,6 +238,49 @@ void WebServer::relayUpdate(AsyncWebServerRequest *request, JsonVariant &json)
 	}
 }
 
+void WebServer::configPatch(AsyncWebServerRequest *request, JsonVariant &json)
+{
+	LOG_INFO(F("Config Patch"));
+
+	if (!manageSecurity(request))
+	{
+		return;
+	}
+
+	if (!json.is<JsonObject>())
+	{
+		handleError(request, F("Json object expected"), 400);
+		return;
+	}
+
+	std::vector<const char *> changedIds;
+	std::vector<const char *> restartRequiredIds;
+	String error;
+	if (!config::instance.applyConfigPatch(json.as<JsonObject>(), changedIds, restartRequiredIds, error))
+	{
+		handleError(request, error, 400);
+		return;
+	}
+
+	auto response = new AsyncJsonResponse(false, 512);
+	auto root = response->getRoot();
+
+	auto changed = root.createNestedArray(F("changed"));
+	for (auto &&id : changedIds)
+	{
+		changed.add(FPSTR(id));
+	}
+
+	auto restartRequired = root.createNestedArray(F("restartRequired"));
+	for (auto &&id : restartRequiredIds)
+	{
+		restartRequired.add(FPSTR(id));
+	}
+
+	response->setLength();
+	request->send(response);
+}
+
 template <class Array, class K, class T>
 void WebServer::addKeyValueObject(Array &array, const K &key, const T &value)
 {
@@ -263,13 +313,13 @@ void WebServer::informationGet(AsyncWebServerRequest *request)
 	const auto maxFreeHeapSize = ESP.getMaxFreeBlockSize() / 1024;
 	const auto freeHeap = ESP.getFreeHeap() / 1024;
 
-	auto response = new AsyncJsonResponse(true, 1024);
+	auto response = new AsyncJsonResponse(true, 2048);
 	auto arr = response->getRoot();
 
 	addKeyValueObject(arr, F("Version"), VERSION);
 	addKeyValueObject(arr, F("Uptime"), GetUptime());
-	addKeyValueObject(arr, F("AP SSID"), WiFi.SSID());
-	addKeyValueObject(arr, F("AP Signal Strength"), WiFi.RSSI());
+	addKeyValueObject(arr, F("AP SSID"), WifiManager::instance.SSID());
+	addKeyValueObject(arr, F("AP Signal Strength"), WifiManager::instance.RSSI());
 	addKeyValueObject(arr, F("Mac Address"), WiFi.softAPmacAddress());
 
 	addKeyValueObject(arr, F("Reset Reason"), ESP.getResetReason());
@@ -284,6 +334,15 @@ void WebServer::informationGet(AsyncWebServerRequest *request)
 	addKeyValueObject(arr, F("Filesystem Total Size (KB)"), fsInfo.totalBytes / 1024);
 	addKeyValueObject(arr, F("Filesystem Free Size (KB)"), (fsInfo.totalBytes - fsInfo.usedBytes) / 1024);
 
+	fsAccounting::instance.forEach([&arr](const fsAccounting::Stats &stats)
+								   {
+									   StreamString value;
+									   value.printf_P(PSTR("%u B/hr, written %u B, read %u B, opens %u, erases ~%u"),
+													  stats.bytesWrittenLastHour, stats.bytesWritten, stats.bytesRead,
+													  stats.opens, stats.eraseBlocks);
+									   const String key = String(F("Flash I/O ")) + stats.path;
+									   addKeyValueObject(arr, key, String(value)); });
+
 	response->setLength();
 	request->send(response);
 }
@@ -317,13 +376,33 @@ void WebServer::homekitGet(AsyncWebServerRequest *request)
 
 void WebServer::configGet(AsyncWebServerRequest *request)
 {
-	LOG_DEBUG(F("/api/information/get"));
+	LOG_DEBUG(F("/api/config/get"));
 	if (!manageSecurity(request))
 	{
 		return;
 	}
-	const auto json = config::instance.getAllConfigAsJson();
-	request->send(200, FPSTR(JsonMediaType), json);
+
+	// checksum file is the md5 of the config file, so it doubles as etag
+	const String etag = String('"') + config::instance.getConfigChecksum() + '"';
+	if (request->hasHeader(FPSTR(IfNoneMatchHeader)) &&
+		request->header(FPSTR(IfNoneMatchHeader)) == etag)
+	{
+		request->send(304);
+		return;
+	}
+
+	auto file = config::instance.openConfigFile();
+	if (!file)
+	{
+		handleError(request, F("Config not found"), 404);
+		return;
+	}
+
+	// streams from file in tcp window sized chunks with content length set
+	auto response = request->beginResponse(file, file.name(), FPSTR(JsonMediaType));
+	response->addHeader(FPSTR(ETagHeader), etag);
+	response->addHeader(FPSTR(CacheControlHeader), F("no-cache"));
+	request->send(response);
 }
 
 template <class V, class T>
@@ -467,9 +546,14 @@ void WebServer::otherSettingsUpdate(AsyncWebServerRequest *request)
 		return;
 	}
 
+	// form names match config field ids ignoring case, times are in seconds here.
+	// Zero or negative intervals and ratios are ignored as before, any other
+	// out of range value fails the update with the field named in the error.
+	DynamicJsonDocument patch(512);
+
 	if (request->hasArg(hostName))
 	{
-		config::instance.data.hostName = request->arg(hostName);
+		patch[hostName] = request->arg(hostName);
 	}
 
 	if (request->hasArg(reportSendInterval))
@@ -477,28 +561,28 @@ void WebServer::otherSettingsUpdate(AsyncWebServerRequest *request)
 		const auto value = request->arg(reportSendInterval).toInt();
 		if (value > 0)
 		{
-			config::instance.data.reportSendInterval = value * 1000;
+			patch[reportSendInterval] = value * 1000;
 		}
 	}
 
 	if (request->hasArg(wattagethreshold))
 	{
-		config::instance.data.wattageThreshold = request->arg(wattagethreshold).toInt();
+		patch[wattagethreshold] = request->arg(wattagethreshold).toInt();
 	}
 
 	if (request->hasArg(wattagepercenthreshold))
 	{
-		config::instance.data.wattagePercentThreshold = request->arg(wattagepercenthreshold).toInt();
+		patch[wattagepercenthreshold] = request->arg(wattagepercenthreshold).toInt();
 	}
 
 	if (request->hasArg(maxpower))
 	{
-		config::instance.data.maxPower = request->arg(maxpower).toInt();
+		patch[maxpower] = request->arg(maxpower).toInt();
 	}
 
 	if (request->hasArg(maxpowerhold))
 	{
-		config::instance.data.maxPowerHold = request->arg(maxpowerhold).toInt() * 1000;
+		patch[maxpowerhold] = request->arg(maxpowerhold).toInt() * 1000;
 	}
 
 	if (request->hasArg(voltageCalibrationRatio))
@@ -506,7 +590,7 @@ void WebServer::otherSettingsUpdate(AsyncWebServerRequest *request)
 		const auto value = request->arg(voltageCalibrationRatio).toDouble();
 		if (value > 0)
 		{
-			config::instance.data.voltageCalibrationRatio = value;
+			patch[voltageCalibrationRatio] = value;
 		}
 	}
 
@@ -515,7 +599,7 @@ void WebServer::otherSettingsUpdate(AsyncWebServerRequest *request)
 		const auto value = request->arg(currentCalibrationRatio).toDouble();
 		if (value > 0)
 		{
-			config::instance.data.currentCalibrationRatio = value;
+			patch[currentCalibrationRatio] = value;
 		}
 	}
 
@@ -524,11 +608,19 @@ void WebServer::otherSettingsUpdate(AsyncWebServerRequest *request)
 		const auto value = request->arg(powerCalibrationRatio).toDouble();
 		if (value > 0)
 		{
-			config::instance.data.powerCalibrationRatio = value;
+			patch[powerCalibrationRatio] = value;
 		}
 	}
 
-	config::instance.save();
+	std::vector<const char *> changedIds;
+	std::vector<const char *> restartRequiredIds;
+	String error;
+	if (!config::instance.applyConfigPatch(patch.as<JsonObjectConst>(), changedIds, restartRequiredIds, error))
+	{
+		handleError(request, error, 400);
+		return;
+	}
+
 	redirectToRoot(request);
 }
 
@@ -778,37 +870,46 @@ void WebServer::restoreConfigurationUpload(AsyncWebServerRequest *request,
 		return;
 	}
 
-	String error;
 	if (!index)
 	{
-		WebServer::instance.restoreConfigData = std::make_unique<std::vector<uint8_t>>();
-	}
-
-	for (size_t i = 0; i < len; i++)
-	{
-		WebServer::instance.restoreConfigData->push_back(data[i]);
-	}
-
-	if (final)
-	{
-		String md5;
-		if (request->hasHeader(FPSTR(MD5Header)))
+		if (!config::instance.beginRestoreConfig(request))
 		{
-			md5 = request->getHeader(FPSTR(MD5Header))->value();
+			handleError(request, F("Restore Failed"), 500);
+			return;
 		}
+		request->onDisconnect([request] { handleEarlyRestoreDisconnect(request); });
+	}
 
-		LOG_DEBUG(F("Expected MD5:") << md5);
-
-		if (md5.length() != 32)
+	if (config::instance.isRestoreInProgress(request))
+	{
+		if (!config::instance.writeRestoreConfig(request, data, len))
 		{
-			handleError(request, F("MD5 parameter invalid. Check file exists."), 500);
+			handleError(request, F("Restore Failed"), 500);
 			return;
 		}
 
-		if (!config::instance.restoreAllConfigAsJson(*WebServer::instance.restoreConfigData, md5))
+		if (final)
 		{
-			handleError(request, F("Restore Failed"), 500);
-			return;
+			String md5;
+			if (request->hasHeader(FPSTR(MD5Header)))
+			{
+				md5 = request->getHeader(FPSTR(MD5Header))->value();
+			}
+
+			LOG_DEBUG(F("Expected MD5:") << md5);
+
+			if (md5.length() != 32)
+			{
+				config::instance.abortRestoreConfig(request);
+				handleError(request, F("MD5 parameter invalid. Check file exists."), 500);
+				return;
+			}
+
+			if (!config::instance.endRestoreConfig(request, md5))
+			{
+				handleError(request, F("Restore Failed"), 500);
+				return;
+			}
 		}
 	}
 }
@@ -831,6 +932,12 @@ void WebServer::handleEarlyUpdateDisconnect()
 	operations::instance.abortUpdate();
 }
 
+void WebServer::handleEarlyRestoreDisconnect(AsyncWebServerRequest *request)
+{
+	// a no-op once the restore has ended, and for an upload that did not own it
+	config::instance.abortRestoreConfig(request);
+}
+
 void WebServer::notifyRelayChange()
 {
 	if (events.count())
@@ -42,6 +42,7 @@ private:
                                            bool final);
 
     static void handleEarlyUpdateDisconnect();
+    static void handleEarlyRestoreDisconnect(AsyncWebServerRequest *request);
 
     // ajax
     static void wifiGet(AsyncWebServerRequest *request);
@@ -49,6 +50,7 @@ private:
     static void homekitGet(AsyncWebServerRequest *request);
     static void configGet(AsyncWebServerRequest *request);
     static void relayUpdate(AsyncWebServerRequest *request, JsonVariant &json);
+    static void configPatch(AsyncWebServerRequest *request, JsonVariant &json);
 
     // helpers
     static bool isAuthenticated(AsyncWebServerRequest *request);
@@ -77,5 +79,4 @@ private:
     AsyncWebServer httpServer{80};
     AsyncEventSource events{"/events"};
     AsyncEventSource logging{"/logs"};
-    std::unique_ptr<std::vector<uint8_t>> restoreConfigData;
 };
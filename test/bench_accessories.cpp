@@ -0,0 +1,65 @@
+// GET /accessories streamed from the cache against the full render, time per
+// request and the heap the server takes while answering it. Times are round
+// trips over an encrypted session, the controller decrypt included.
+
+#include <string>
+
+#include "arduino_homekit_server.h"
+#include "LittleFS.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define CACHE_PATH "/hapacc.cache"
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define REQUESTS 500
+
+bool accessories_cache_prepare(homekit_server_t *server);
+
+static controller_t controller;
+
+// Seconds per request and the highest heap peak of one
+static double run(size_t *heap, size_t *size) {
+    controller_response_t response;
+    int failures = 0;
+    *heap = 0;
+    double started = host_seconds();
+    for (int i = 0; i < REQUESTS; i++) {
+        host_heap_reset();
+        failures += controller_request(&controller, "GET", "/accessories", "", &response) != 0
+                || response.status != 200;
+        if (host_heap_peak() > *heap)
+            *heap = host_heap_peak();
+    }
+    double seconds = (host_seconds() - started) / REQUESTS;
+    *size = response.body.size();
+    CHECK_EQ(failures, 0);
+    return seconds;
+}
+
+int main() {
+    size_t cached_heap, cached_size, uncached_heap, uncached_size;
+
+    host_random_seed(36);
+    host_fs_clear();
+    controller_provision(&controller, DEVICE_ID);
+    arduino_homekit_setup(&accessory_config);
+    controller_connect(&controller);
+    CHECK_EQ(controller_pair_verify(&controller), 0);
+
+    double cached = run(&cached_heap, &cached_size);
+    LittleFS.remove(CACHE_PATH);
+    double uncached = run(&uncached_heap, &uncached_size);
+    CHECK(accessories_cache_prepare(arduino_homekit_get_running_server()));
+
+    printf("%-10s %7.1f us per request  heap peak %5zu B  body %zu B\n", "cached",
+           cached * 1e6, cached_heap, cached_size);
+    printf("%-10s %7.1f us per request  heap peak %5zu B  body %zu B\n", "uncached",
+           uncached * 1e6, uncached_heap, uncached_size);
+    CHECK_EQ(cached_size, uncached_size);
+
+    controller_disconnect(&controller);
+    return check_result();
+}
@@ -0,0 +1,70 @@
+// Session frame throughput of the single pass ChaCha20-Poly1305 against the
+// wolfcrypt two pass code, 1024-byte HAP frames with their 2-byte aad.
+// A host cache holds the whole frame, so both run at about the same speed
+// here; the single pass pays off where a frame does not stay in cache.
+
+#include <string.h>
+
+#include "user_settings.h"
+#include <wolfssl/wolfcrypt/chacha20_poly1305.h>
+
+#include "check.h"
+#include "host.h"
+
+int crypto_chacha20poly1305_encrypt(
+    const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
+    const byte *message, size_t message_size,
+    byte *encrypted, size_t *encrypted_size);
+int crypto_chacha20poly1305_decrypt(
+    const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
+    const byte *message, size_t message_size,
+    byte *decrypted, size_t *decrypted_size);
+
+#define FRAMES 5000
+#define FRAME_SIZE 1024
+
+static void print_rate(const char *name, double seconds) {
+    printf("%-22s %8.1f MB/s\n", name, FRAMES * (FRAME_SIZE / 1048576.0) / seconds);
+}
+
+int main() {
+    byte key[32] = {1}, nonce[12] = {0}, aad[2] = {0x00, 0x04};
+    static byte message[FRAME_SIZE], encrypted[FRAME_SIZE + 16], decrypted[FRAME_SIZE];
+    size_t size;
+    int failures = 0;
+
+    for (size_t i = 0; i < sizeof(message); i++)
+        message[i] = i * 7;
+
+    double started = host_seconds();
+    for (int i = 0; i < FRAMES; i++) {
+        size = sizeof(encrypted);
+        failures += crypto_chacha20poly1305_encrypt(key, nonce, aad, sizeof(aad), message, sizeof(message),
+                                                    encrypted, &size) != 0;
+    }
+    print_rate("encrypt single pass", host_seconds() - started);
+
+    started = host_seconds();
+    for (int i = 0; i < FRAMES; i++)
+        failures += wc_ChaCha20Poly1305_Encrypt(key, nonce, aad, sizeof(aad), message, sizeof(message),
+                                                encrypted, encrypted + FRAME_SIZE) != 0;
+    print_rate("encrypt wolfcrypt", host_seconds() - started);
+
+    started = host_seconds();
+    for (int i = 0; i < FRAMES; i++) {
+        size = sizeof(decrypted);
+        failures += crypto_chacha20poly1305_decrypt(key, nonce, aad, sizeof(aad), encrypted, sizeof(encrypted),
+                                                    decrypted, &size) != 0;
+    }
+    print_rate("decrypt single pass", host_seconds() - started);
+
+    started = host_seconds();
+    for (int i = 0; i < FRAMES; i++)
+        failures += wc_ChaCha20Poly1305_Decrypt(key, nonce, aad, sizeof(aad), encrypted, FRAME_SIZE,
+                                                encrypted + FRAME_SIZE, decrypted) != 0;
+    print_rate("decrypt wolfcrypt", host_seconds() - started);
+
+    CHECK_EQ(failures, 0);
+    CHECK_MEM(decrypted, message, sizeof(message));
+    return check_result();
+}
@@ -0,0 +1,67 @@
+// Signature check of pair verify M3, with the controller key decoded on every
+// verify as before and with the point storage.c keeps decoded. The double
+// scalar multiplication of the low memory verify is most of the time, the
+// saving is the decode alone.
+
+#include <string.h>
+
+#include "crypto.h"
+#include "storage.h"
+#include "port.h"
+#include "check.h"
+#include "host.h"
+
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define VERIFIES 200
+
+static void print_time(const char *name, double seconds) {
+    printf("%-24s %8.1f us\n", name, seconds * 1e6 / VERIFIES);
+}
+
+int main() {
+    // curve keys and the ids of both sides, as signed by a controller
+    byte message[32 + 36 + 32], signature[64];
+    size_t signature_size = sizeof(signature);
+    ed25519_key controller;
+    pairing_t pairing;
+    int failures = 0;
+
+    host_random_seed(43);
+    homekit_random_fill(message, sizeof(message));
+    crypto_ed25519_init(&controller);
+    CHECK_EQ(crypto_ed25519_generate(&controller), 0);
+    CHECK_EQ(crypto_ed25519_sign(&controller, message, sizeof(message), signature, &signature_size), 0);
+
+    host_storage_clear();
+    homekit_storage_init();
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_ID, &controller, pairing_permissions_admin), 0);
+
+    double started = host_seconds();
+    for (int i = 0; i < VERIFIES; i++) {
+        failures += homekit_storage_find_pairing(DEVICE_ID, &pairing) != 0;
+        failures += crypto_ed25519_verify(&pairing.device_key, message, sizeof(message),
+                                          signature, sizeof(signature)) != 0;
+    }
+    double decoding = host_seconds() - started;
+    print_time("find and verify", decoding);
+
+    started = host_seconds();
+    for (int i = 0; i < VERIFIES; i++) {
+        failures += homekit_storage_find_pairing(DEVICE_ID, &pairing) != 0;
+        failures += crypto_ed25519_verify_decoded(&pairing.device_key, pairing.device_point, message,
+                                                  sizeof(message), signature, sizeof(signature)) != 0;
+    }
+    double cached = host_seconds() - started;
+    print_time("find and verify decoded", cached);
+
+    started = host_seconds();
+    for (int i = 0; i < VERIFIES; i++) {
+        ge_p3 point;
+        failures += crypto_ed25519_decode_public_key(&controller, &point) != 0;
+    }
+    print_time("decode alone", host_seconds() - started);
+    printf("speed-up %.2fx\n", decoding / cached);
+
+    CHECK_EQ(failures, 0);
+    return check_result();
+}
@@ -0,0 +1,119 @@
+// Events to every client the server takes, each watching the same
+// characteristics that change several times between two loops. Times the
+// notify calls, which only fill the event slots, apart from the loop that
+// sends one coalesced EVENT per client, and the heap notifying takes.
+
+#include <string>
+
+#include "arduino_homekit_server.h"
+#include "cJSON.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define CLIENTS 8 // HOMEKIT_MAX_CLIENTS
+#define WATCHED 64
+#define CHANGES 4 // per characteristic between two loops
+#define ROUNDS 200
+#define SUBSCRIBE_BATCH 16 // HOMEKIT_MAX_CHARACTERISTIC_UPDATES
+
+static homekit_server_config_t *config;
+static controller_t controllers[CLIENTS];
+static homekit_characteristic_t *watched[WATCHED];
+
+static void subscribe(controller_t *controller) {
+    for (int first = 0; first < WATCHED; first += SUBSCRIBE_BATCH) {
+        std::string body = "{\"characteristics\":[";
+        for (int i = first; i < first + SUBSCRIBE_BATCH; i++) {
+            body += (i > first ? ",{\"aid\":1,\"iid\":" : "{\"aid\":1,\"iid\":")
+                    + std::to_string(ACCESSORY_WIDE_FIRST_IID + 1 + i) + ",\"ev\":true}";
+        }
+        body += "]}";
+        controller_response_t response;
+        CHECK_EQ(controller_request(controller, "PUT", "/characteristics", body, &response), 0);
+        CHECK_EQ(response.status, 204);
+    }
+}
+
+// Values in an EVENT that carry the round's last change
+static int fresh_values(const std::string &body, uint16_t last) {
+    int count = 0;
+    cJSON *root = cJSON_Parse(body.c_str());
+    cJSON *item;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "characteristics")) {
+        count += cJSON_GetObjectItem(item, "value")->valueint == last;
+    }
+    cJSON_Delete(root);
+    return count;
+}
+
+int main() {
+    host_random_seed(35);
+    host_fs_clear();
+    config = accessory_config_wide(WATCHED);
+    controller_provision(&controllers[0], "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F");
+    controller_add(&controllers[1], "0A1B2C3D-4E5F-4061-8273-8495A6B7C8D9");
+    // storage keeps two pairings, the other connections are theirs too
+    for (int i = 2; i < CLIENTS; i++)
+        controllers[i] = controllers[i % 2];
+    arduino_homekit_setup(config);
+    for (int i = 0; i < CLIENTS; i++) {
+        controller_connect(&controllers[i]);
+        CHECK_EQ(controller_pair_verify(&controllers[i]), 0);
+        subscribe(&controllers[i]);
+    }
+    CHECK_EQ(arduino_homekit_connected_clients_count(), CLIENTS);
+    for (int i = 0; i < WATCHED; i++)
+        watched[i] = homekit_characteristic_by_aid_and_iid(config->accessories, 1,
+                                                           ACCESSORY_WIDE_FIRST_IID + 1 + i);
+
+    double notify_seconds = 0, loop_seconds = 0;
+    size_t heap = 0;
+    long events = 0, values = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        uint16_t last = 0;
+        host_heap_reset();
+        double started = host_seconds();
+        for (int change = 0; change < CHANGES; change++) {
+            last = round * CHANGES + change;
+            for (int i = 0; i < WATCHED; i++) {
+                watched[i]->value = HOMEKIT_UINT16(last);
+                homekit_characteristic_notify(watched[i], watched[i]->value);
+            }
+        }
+        notify_seconds += host_seconds() - started;
+        if (host_heap_peak() > heap)
+            heap = host_heap_peak();
+
+        // a second between rounds keeps the rate limit out of the way
+        host_time_advance(1000);
+        started = host_seconds();
+        arduino_homekit_loop();
+        loop_seconds += host_seconds() - started;
+
+        for (int i = 0; i < CLIENTS; i++) {
+            std::string body;
+            while (controller_event(&controllers[i], &body)) {
+                events++;
+                values += fresh_values(body, last);
+            }
+        }
+    }
+
+    const long notifies = (long) ROUNDS * CHANGES * WATCHED;
+    printf("%d clients, %d characteristics, %d changes each per loop\n", CLIENTS, WATCHED, CHANGES);
+    printf("%-8s %7.2f us per change  heap peak %zu B\n", "notify", notify_seconds / notifies * 1e6,
+           heap);
+    printf("%-8s %7.1f us per loop    %ld EVENTs, %ld values\n", "loop", loop_seconds / ROUNDS * 1e6,
+           events, values);
+    CHECK_EQ(events, (long) ROUNDS * CLIENTS);
+    CHECK_EQ(values, (long) ROUNDS * CLIENTS * WATCHED);
+    // numeric values are kept in the slots, notifying allocates nothing
+    CHECK_EQ(heap, 0);
+
+    for (int i = 0; i < CLIENTS; i++)
+        controller_disconnect(&controllers[i]);
+    return check_result();
+}
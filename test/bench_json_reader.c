@@ -0,0 +1,83 @@
+// PUT /characteristics bodies through the pull tokenizer against the cJSON
+// document it replaced: time per body and heap the parse takes
+
+#include <string.h>
+
+#include "json_reader.h"
+#include "cJSON.h"
+#include "check.h"
+#include "host.h"
+
+#define BODIES 20000
+
+static const char body[] =
+    "{\"characteristics\":["
+    "{\"aid\":1,\"iid\":9,\"value\":true},"
+    "{\"aid\":1,\"iid\":10,\"value\":75},"
+    "{\"aid\":1,\"iid\":11,\"value\":21.5},"
+    "{\"aid\":2,\"iid\":9,\"ev\":true}"
+    "]}";
+
+static int read_body(const char *data, size_t size, double *sum) {
+    json_reader reader;
+    json_reader_init(&reader, data, size);
+    const char *key;
+    size_t key_size;
+    int count = 0;
+
+    if (!json_reader_next(&reader, '{') || !json_reader_key(&reader, &key, &key_size)
+            || !json_reader_next(&reader, '['))
+        return -1;
+    do {
+        if (!json_reader_next(&reader, '{'))
+            return -1;
+        do {
+            json_token token;
+            if (!json_reader_key(&reader, &key, &key_size) || !json_reader_value(&reader, &token))
+                return -1;
+            *sum += token.number;
+        } while (json_reader_next(&reader, ','));
+        if (!json_reader_next(&reader, '}'))
+            return -1;
+        count++;
+    } while (json_reader_next(&reader, ','));
+    return json_reader_next(&reader, ']') && json_reader_next(&reader, '}') ? count : -1;
+}
+
+static int parse_body(const char *data, double *sum) {
+    cJSON *json = cJSON_Parse(data);
+    if (!json)
+        return -1;
+    cJSON *characteristics = cJSON_GetObjectItem(json, "characteristics");
+    int count = cJSON_GetArraySize(characteristics);
+    for (int i = 0; i < count; i++) {
+        cJSON *item = cJSON_GetArrayItem(characteristics, i);
+        for (cJSON *field = item->child; field; field = field->next)
+            *sum += cJSON_IsTrue(field) ? 1 : field->valuedouble;
+    }
+    cJSON_Delete(json);
+    return count;
+}
+
+int main() {
+    double reader_sum = 0, cjson_sum = 0;
+
+    host_heap_reset();
+    double started = host_seconds();
+    for (int i = 0; i < BODIES; i++)
+        CHECK_EQ(read_body(body, sizeof(body) - 1, &reader_sum), 4);
+    double reader_seconds = host_seconds() - started;
+    size_t reader_heap = host_heap_peak();
+
+    host_heap_reset();
+    started = host_seconds();
+    for (int i = 0; i < BODIES; i++)
+        CHECK_EQ(parse_body(body, &cjson_sum), 4);
+    double cjson_seconds = host_seconds() - started;
+    size_t cjson_heap = host_heap_peak();
+
+    CHECK(reader_sum == cjson_sum);
+    printf("%-12s %6.2f us per body  heap peak %5zu B\n", "json_reader", reader_seconds * 1e6 / BODIES, reader_heap);
+    printf("%-12s %6.2f us per body  heap peak %5zu B\n", "cJSON", cjson_seconds * 1e6 / BODIES, cjson_heap);
+    return check_result();
+}
@@ -0,0 +1,55 @@
+// Pair verify M1 to M2 with the accessory key from the pool and generated
+// inline, as the controller sees it: from sending M1 until M2 is in
+
+#include "arduino_homekit_server.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define HANDSHAKES 50
+
+bool ephemeral_key_take(homekit_server_t *server, curve25519_key *key);
+
+static controller_t controller;
+
+// Mean seconds of M1 to M2
+static double run(bool pooled) {
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    double seconds = 0;
+    int failures = 0;
+    for (int i = 0; i < HANDSHAKES; i++) {
+        controller_connect(&controller);
+        for (int j = 0; j < HOMEKIT_EPHEMERAL_KEYS; j++)
+            arduino_homekit_loop();
+        curve25519_key key;
+        while (!pooled && ephemeral_key_take(server, &key))
+            crypto_curve25519_done(&key);
+        const int count = server->ephemeral_keys_count;
+
+        failures += controller_pair_verify_start(&controller) != 0;
+        failures += server->ephemeral_keys_count != (pooled ? count - 1 : 0);
+        failures += controller_pair_verify_finish(&controller) != 0;
+        seconds += controller.m2_seconds;
+        controller_disconnect(&controller);
+    }
+    CHECK_EQ(failures, 0);
+    return seconds / HANDSHAKES;
+}
+
+int main() {
+    host_random_seed(45);
+    host_fs_clear();
+    controller_provision(&controller, DEVICE_ID);
+    arduino_homekit_setup(&accessory_config);
+
+    double pooled = run(true);
+    double inline_key = run(false);
+    printf("%-16s %8.1f us\n", "M1 to M2 pooled", pooled * 1e6);
+    printf("%-16s %8.1f us\n", "M1 to M2 inline", inline_key * 1e6);
+    printf("saving %.1f us, %.0f%%\n", (inline_key - pooled) * 1e6,
+           100 * (inline_key - pooled) / inline_key);
+    return check_result();
+}
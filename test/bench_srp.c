@@ -0,0 +1,99 @@
+// Pair setup SRP cost on the host: M1 salt and B in one go and time-sliced
+// like pre-init does, M3 key and proof check. Built once per SRP flavour,
+// ESP_SRP_MATH by default and ARDUINO_HOMEKIT_SRP_INTEGER_MATH. The host
+// numbers only compare the flavours, ESP8266 is some 100 times slower.
+
+#include <string.h>
+
+#include "crypto.h"
+#include "srp_math.h"
+#include "check.h"
+#include "host.h"
+#include "srp_client.h"
+
+#define ROUNDS 3
+#define USERNAME "Pair-Setup"
+#define PASSWORD "111-22-333"
+
+typedef struct {
+    double seconds;
+    size_t heap;
+} cost_t;
+
+static void cost_start(double *started) {
+    host_heap_reset();
+    *started = host_seconds();
+}
+
+static void cost_add(cost_t *cost, double started) {
+    cost->seconds += host_seconds() - started;
+    if (host_heap_peak() > cost->heap)
+        cost->heap = host_heap_peak();
+}
+
+static void print_cost(const char *name, const cost_t *cost) {
+    printf("%-28s %8.2f ms  heap peak %6zu B\n", name, cost->seconds * 1000 / ROUNDS, cost->heap);
+}
+
+int main() {
+    cost_t m1 = {0}, m1_stepped = {0}, m3 = {0};
+    double longest_step = 0;
+    int steps = 0;
+
+#ifdef ESP_SRP_MATH
+    printf("ESP_SRP_MATH, %d bit limbs\n", SRP_MATH_LIMB_BITS);
+#else
+    printf("ARDUINO_HOMEKIT_SRP_INTEGER_MATH\n");
+#endif
+
+    for (int round = 0; round < ROUNDS; round++) {
+        byte salt[16], server_key[384], client_key[384], proof[64];
+        size_t salt_size = sizeof(salt), server_key_size = sizeof(server_key);
+        size_t client_key_size = sizeof(client_key), proof_size = sizeof(proof);
+        double started;
+
+        Srp *srp = crypto_srp_new();
+        cost_start(&started);
+        CHECK_EQ(crypto_srp_init(srp, USERNAME, PASSWORD), 0);
+        CHECK_EQ(crypto_srp_get_public_key(srp, server_key, &server_key_size), 0);
+        cost_add(&m1, started);
+
+        Srp *stepped = crypto_srp_new();
+        cost_start(&started);
+        crypto_srp_setup_t *setup = crypto_srp_setup_new(stepped, USERNAME, PASSWORD);
+        CHECK(setup != NULL);
+        int r;
+        do {
+            double step_started = host_seconds();
+            r = crypto_srp_setup_step(setup, 64);
+            if (host_seconds() - step_started > longest_step)
+                longest_step = host_seconds() - step_started;
+            steps++;
+        } while (r == 1);
+        CHECK_EQ(r, 0);
+        cost_add(&m1_stepped, started);
+        crypto_srp_setup_free(setup);
+        crypto_srp_free(stepped);
+
+        CHECK_EQ(crypto_srp_get_salt(srp, salt, &salt_size), 0);
+        srp_client_t *client = srp_client_new(USERNAME, PASSWORD, salt, salt_size);
+        CHECK(client != NULL);
+        CHECK_EQ(srp_client_get_public_key(client, client_key, &client_key_size), 0);
+        CHECK_EQ(srp_client_compute_key(client, server_key, server_key_size), 0);
+        CHECK_EQ(srp_client_get_proof(client, proof, &proof_size), 0);
+
+        cost_start(&started);
+        CHECK_EQ(crypto_srp_compute_key(srp, client_key, client_key_size, server_key, server_key_size), 0);
+        CHECK_EQ(crypto_srp_verify(srp, proof, proof_size), 0);
+        cost_add(&m3, started);
+
+        srp_client_free(client);
+        crypto_srp_free(srp);
+    }
+
+    print_cost("M1 salt and B", &m1);
+    print_cost("M1 time-sliced, 64 bits", &m1_stepped);
+    printf("%-28s %8.2f ms  %d steps per setup\n", "  longest step", longest_step * 1000, steps / ROUNDS);
+    print_cost("M3 key and proof", &m3);
+    return check_result();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Host stand-in for the ESP8266 Arduino core, only what EspHap and the
+// tests use. Time and randomness come from support/host.c.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pgmspace.h"
+#include "c_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void yield(void);
+void optimistic_yield(uint32_t interval_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "WString.h"
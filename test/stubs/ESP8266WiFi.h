@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiServer.h"
+
+struct WiFiEventStationModeGotIP {
+    IPAddress ip;
+    IPAddress mask;
+    IPAddress gw;
+};
+
+typedef std::shared_ptr<void> WiFiEventHandler;
+
+// Never connected, so the server skips mDNS
+class ESP8266WiFiClass {
+public:
+    bool isConnected() { return false; }
+    IPAddress localIP() { return IPAddress(); }
+    bool hostname(const char *name) { return true; }
+
+    WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> handler) {
+        return WiFiEventHandler();
+    }
+};
+
+extern ESP8266WiFiClass WiFi;
@@ -0,0 +1,43 @@
+#pragma once
+
+// Files of the LittleFS stand-in are byte vectors in memory, see
+// support/host_fs.cpp
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+namespace fs {
+
+struct host_file;
+
+class File {
+public:
+    File() {}
+    explicit File(std::shared_ptr<host_file> file) : file_(file) {}
+
+    size_t read(uint8_t *buffer, size_t size);
+    size_t write(const uint8_t *buffer, size_t size);
+    bool seek(uint32_t position);
+    size_t size() const;
+    void close() { file_.reset(); }
+
+    operator bool() const { return file_ != nullptr; }
+
+private:
+    std::shared_ptr<host_file> file_;
+    size_t position_ = 0;
+};
+
+class FS {
+public:
+    File open(const char *path, const char *mode);
+    bool exists(const char *path);
+    bool remove(const char *path);
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
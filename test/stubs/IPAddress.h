@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "WString.h"
+
+class IPAddress {
+public:
+    IPAddress() : address_{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address_{a, b, c, d} {}
+
+    bool isSet() const { return address_[0] || address_[1] || address_[2] || address_[3]; }
+
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", address_[0], address_[1], address_[2], address_[3]);
+        return String(text);
+    }
+
+private:
+    uint8_t address_[4];
+};
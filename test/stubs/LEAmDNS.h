@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+#include "IPAddress.h"
+
+// Does nothing, the host has no network to announce on
+class MDNSResponder {
+public:
+    typedef const void *hMDNSService;
+    typedef std::function<void(const hMDNSService)> MDNSDynamicServiceTxtCallbackFunc;
+
+    bool begin(const char *hostname, const IPAddress &ip) { return true; }
+    bool close() { return true; }
+    bool announce() { return true; }
+    bool update() { return true; }
+
+    hMDNSService addService(const char *name, const char *service, const char *protocol, uint16_t port) {
+        return this;
+    }
+    bool addServiceTxt(hMDNSService service, const char *key, const char *value) { return true; }
+    bool addDynamicServiceTxt(hMDNSService service, const char *key, const char *value) { return true; }
+    bool addDynamicServiceTxt(hMDNSService service, const char *key, uint16_t value) { return true; }
+    bool setDynamicServiceTxtCallback(hMDNSService service, MDNSDynamicServiceTxtCallbackFunc callback) {
+        return true;
+    }
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,25 @@
+#pragma once
+
+// The part of the Arduino String EspHap formats numbers and addresses with
+
+#ifdef __cplusplus
+
+#include <string>
+
+class String {
+public:
+    String(const char *value = "") : value_(value ? value : "") {}
+    String(int value) : value_(std::to_string(value)) {}
+    String(unsigned int value) : value_(std::to_string(value)) {}
+    String(long value) : value_(std::to_string(value)) {}
+    String(unsigned long value) : value_(std::to_string(value)) {}
+
+    const char *c_str() const { return value_.c_str(); }
+    unsigned int length() const { return value_.size(); }
+    bool operator==(const String &other) const { return value_ == other.value_; }
+
+private:
+    std::string value_;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+// A tcp connection is two byte queues in memory, support/host_net.h hands
+// the other end to the test
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <memory>
+
+#include "IPAddress.h"
+
+struct host_socket {
+    std::deque<uint8_t> in;  // to the accessory
+    std::deque<uint8_t> out; // from the accessory
+    bool open = true;
+    size_t send_buffer = 1072; // availableForWrite, TCP_SND_BUF of lwip2
+};
+
+class WiFiClient {
+public:
+    WiFiClient() {}
+    explicit WiFiClient(std::shared_ptr<host_socket> socket) : socket_(socket) {}
+
+    uint8_t connected();
+    int available();
+    int read(uint8_t *buffer, size_t size);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t availableForWrite();
+    void stop();
+
+    void keepAlive(uint16_t idle_sec, uint16_t interval_sec, uint8_t count) {}
+    void setNoDelay(bool no_delay) {}
+    void setSync(bool sync) {}
+    void setTimeout(unsigned long timeout) {}
+
+    IPAddress localIP() { return IPAddress(192, 168, 1, 2); }
+    uint16_t localPort() { return 5556; }
+    IPAddress remoteIP() { return IPAddress(192, 168, 1, 3); }
+    uint16_t remotePort() { return 49152; }
+
+    operator bool() { return socket_ != nullptr; }
+
+private:
+    std::shared_ptr<host_socket> socket_;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "WiFiClient.h"
+
+// Accepts the connections of host_connect() in support/host_net.h
+class WiFiServer {
+public:
+    explicit WiFiServer(uint16_t port) {}
+
+    void begin();
+    void setNoDelay(bool no_delay) {}
+    bool hasClient();
+    WiFiClient available();
+    void stop();
+    void close();
+};
@@ -0,0 +1,3 @@
+#pragma once
+
+// Nothing of the SDK header is used on the host
@@ -0,0 +1,13 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Silent unless HOMEKIT_TEST_LOG is set in the environment
+int host_log_printf(const char *format, ...);
+#define CUSTOM_PRINTF host_log_printf
+
+#ifdef __cplusplus
+}
+#endif
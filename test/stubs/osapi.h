@@ -0,0 +1,12 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int os_get_random(unsigned char *data, int size);
+unsigned long os_random(void);
+
+#ifdef __cplusplus
+}
+#endif
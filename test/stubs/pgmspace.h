@@ -0,0 +1,21 @@
+#pragma once
+
+// Flash and RAM are one address space on the host
+
+#include <string.h>
+#include <strings.h>
+
+#define PROGMEM
+#define ICACHE_RODATA_ATTR
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define FPSTR(p) (p)
+
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define strlen_P strlen
@@ -0,0 +1,11 @@
+#pragma once
+
+// Only the constants port.h maps, the host has no flash to call
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+    SPI_FLASH_RESULT_OK,
+    SPI_FLASH_RESULT_ERR,
+    SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "c_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32 system_get_free_heap_size(void);
+void system_restart(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,136 @@
+// Accessories of the server tests, see accessory.h
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "accessory.h"
+
+homekit_characteristic_t accessory_on = HOMEKIT_CHARACTERISTIC_(ON, false, .id = 301);
+homekit_characteristic_t accessory_in_use = HOMEKIT_CHARACTERISTIC_(OUTLET_IN_USE, false, .id = 302);
+homekit_characteristic_t accessory_power = HOMEKIT_CHARACTERISTIC_(
+    CUSTOM,
+    .id = 203,
+    .type = "E863F10D-079E-48FF-8F27-9C2605A29F52",
+    .description = "Active \"Power\"\\Watts",
+    .format = homekit_format_float,
+    .permissions = homekit_permissions_paired_read | homekit_permissions_notify,
+    .min_value = (float[]){0},
+    .max_value = (float[]){4000},
+    .min_step = (float[]){0.1},
+    .value = HOMEKIT_FLOAT_(0));
+homekit_characteristic_t accessory_label = HOMEKIT_CHARACTERISTIC_(
+    CUSTOM,
+    .id = 400,
+    .type = "F0000001-03E9-4157-B099-54F4A4944163",
+    .description = "Label",
+    .format = homekit_format_string,
+    .permissions = homekit_permissions_paired_read | homekit_permissions_notify,
+    .value = HOMEKIT_STRING_("tab\there \"quoted\" back\\slash \x01 bell\x07"));
+
+unsigned accessory_history_reads;
+
+static size_t history_read(const homekit_characteristic_t *ch, size_t offset, uint8_t *buffer,
+                           size_t size) {
+    static const char history[] = "history entries";
+    if (!offset)
+        accessory_history_reads++;
+    size_t left = offset < sizeof(history) - 1 ? sizeof(history) - 1 - offset : 0;
+    size_t copied = size < left ? size : left;
+    memcpy(buffer, history + offset, copied);
+    return copied;
+}
+
+homekit_characteristic_t accessory_history = HOMEKIT_CHARACTERISTIC_(
+    CUSTOM,
+    .id = 500,
+    .type = "E863F117-079E-48FF-8F27-9C2605A29F52",
+    .description = "History Entries",
+    .format = homekit_format_data,
+    .permissions = homekit_permissions_paired_read | homekit_permissions_hidden,
+    .data_reader = history_read);
+
+homekit_accessory_t *accessory_accessories[] = {
+    HOMEKIT_ACCESSORY(.id = 1, .category = homekit_accessory_category_outlet, .services = (homekit_service_t*[]) {
+        HOMEKIT_SERVICE(ACCESSORY_INFORMATION, .id = 1, .characteristics = (homekit_characteristic_t*[]) {
+            HOMEKIT_CHARACTERISTIC(NAME, "Outlet", .id = 100),
+            HOMEKIT_CHARACTERISTIC(MODEL, "Host", .id = 101),
+            HOMEKIT_CHARACTERISTIC(SERIAL_NUMBER, "0001", .id = 102),
+            HOMEKIT_CHARACTERISTIC(FIRMWARE_REVISION, "1.0", .id = 103),
+            HOMEKIT_CHARACTERISTIC(MANUFACTURER, "Test", .id = 104),
+            NULL
+        }),
+        HOMEKIT_SERVICE(OUTLET, .id = 3, .primary = true, .characteristics = (homekit_characteristic_t*[]) {
+            &accessory_on,
+            &accessory_in_use,
+            &accessory_power,
+            &accessory_label,
+            &accessory_history,
+            NULL
+        }),
+        NULL
+    }),
+    NULL
+};
+
+homekit_server_config_t accessory_config = {
+    .accessories = accessory_accessories,
+    .category = homekit_accessory_category_outlet,
+    .password = "111-11-111",
+};
+
+#define WIDE_SERVICE_SIZE 100
+
+static homekit_characteristic_t *wide_characteristic(unsigned id, homekit_format_t format) {
+    homekit_characteristic_t *ch = calloc(1, sizeof(homekit_characteristic_t));
+    ch->id = id;
+    ch->type = "F0000010-03E9-4157-B099-54F4A4944163";
+    ch->format = format;
+    ch->permissions = homekit_permissions_paired_read | homekit_permissions_notify;
+    ch->value.format = format;
+    if (format == homekit_format_string) {
+        ch->value.is_static = true;
+        ch->value.string_value = "";
+    }
+    return ch;
+}
+
+homekit_server_config_t *accessory_config_wide(unsigned count) {
+    unsigned services_count = 1 + (count + 1 + WIDE_SERVICE_SIZE - 1) / WIDE_SERVICE_SIZE;
+    homekit_service_t **services = calloc(services_count + 1, sizeof(homekit_service_t *));
+
+    // the information service is read only, not an event slot
+    services[0] = calloc(1, sizeof(homekit_service_t));
+    services[0]->id = 1;
+    services[0]->type = HOMEKIT_SERVICE_ACCESSORY_INFORMATION;
+    services[0]->characteristics = calloc(2, sizeof(homekit_characteristic_t *));
+    services[0]->characteristics[0] = wide_characteristic(2, homekit_format_string);
+    services[0]->characteristics[0]->type = HOMEKIT_CHARACTERISTIC_NAME;
+    services[0]->characteristics[0]->permissions = homekit_permissions_paired_read;
+    services[0]->characteristics[0]->value.string_value = "Wide";
+
+    for (unsigned s = 1, added = 0; s < services_count; s++) {
+        homekit_service_t *service = calloc(1, sizeof(homekit_service_t));
+        service->id = 1000 + s;
+        service->type = "F0000011-03E9-4157-B099-54F4A4944163";
+        service->characteristics = calloc(WIDE_SERVICE_SIZE + 1, sizeof(homekit_characteristic_t *));
+        for (unsigned i = 0; i < WIDE_SERVICE_SIZE && added <= count; i++, added++) {
+            service->characteristics[i] = wide_characteristic(ACCESSORY_WIDE_FIRST_IID + added,
+                    added ? homekit_format_uint16 : homekit_format_string);
+        }
+        services[s] = service;
+    }
+
+    homekit_accessory_t *accessory = calloc(1, sizeof(homekit_accessory_t));
+    accessory->id = 1;
+    accessory->category = homekit_accessory_category_sensor;
+    accessory->config_number = 1;
+    accessory->services = services;
+
+    homekit_accessory_t **accessories = calloc(2, sizeof(homekit_accessory_t *));
+    accessories[0] = accessory;
+
+    homekit_server_config_t *config = calloc(1, sizeof(homekit_server_config_t));
+    config->accessories = accessories;
+    config->password = "111-11-111";
+    return config;
+}
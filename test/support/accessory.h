@@ -0,0 +1,33 @@
+#pragma once
+
+// An outlet accessory like the one in src/myaccessory.c, for the tests that
+// run the server
+
+#include "homekit/homekit.h"
+#include "homekit/characteristics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern homekit_characteristic_t accessory_on;
+extern homekit_characteristic_t accessory_in_use;
+extern homekit_characteristic_t accessory_power;
+// quotes, a backslash and control characters, as json_string escapes them
+extern homekit_characteristic_t accessory_label;
+// read through a data_reader like the Eve history, counting the reads
+extern homekit_characteristic_t accessory_history;
+extern unsigned accessory_history_reads;
+
+extern homekit_server_config_t accessory_config;
+
+#define ACCESSORY_WIDE_FIRST_IID 10
+
+// One accessory with a notifying string characteristic and count notifying
+// uint16 ones after it, iids from ACCESSORY_WIDE_FIRST_IID in order and 100
+// characteristics to a service. Built on the heap and never freed.
+homekit_server_config_t *accessory_config_wide(unsigned count);
+
+#ifdef __cplusplus
+}
+#endif
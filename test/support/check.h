@@ -0,0 +1,66 @@
+#pragma once
+
+// Minimal assertions for the host tests, a failed check is reported and the
+// test goes on. main returns check_result() so ctest sees the failures.
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int check_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        long long _a = (long long)(a), _b = (long long)(b); \
+        if (_a != _b) { \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed, %lld != %lld\n", \
+                    __FILE__, __LINE__, #a, #b, _a, _b); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_MEM(a, b, size) \
+    do { \
+        if (memcmp((a), (b), (size))) { \
+            fprintf(stderr, "%s:%d: CHECK_MEM(%s, %s) failed\n", __FILE__, __LINE__, #a, #b); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_STR(a, b) \
+    do { \
+        const char *_a = (a), *_b = (b); \
+        if (!_a || !_b || strcmp(_a, _b)) { \
+            fprintf(stderr, "%s:%d: CHECK_STR(%s, %s) failed\n  got:      %s\n  expected: %s\n", \
+                    __FILE__, __LINE__, #a, #b, _a ? _a : "(null)", _b ? _b : "(null)"); \
+            check_failures++; \
+        } \
+    } while (0)
+
+#define RUN(test) \
+    do { \
+        int _before = check_failures; \
+        test(); \
+        printf("%s %s\n", check_failures == _before ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+static inline int check_result(void) {
+    if (check_failures)
+        printf("%d check(s) failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,375 @@
+// Controller side of pair verify and of encrypted HAP sessions, see
+// controller.h
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "arduino_homekit_server.h"
+#include "homekit/tlv.h"
+#include "controller.h"
+#include "host.h"
+#include "host_net.h"
+
+#define CONTROLLER_PUMP_LOOPS 500
+
+static ed25519_key accessory_key;
+
+static void nonce_of(uint64_t count, byte *nonce) {
+    memset(nonce, 0, 12);
+    for (int i = 4; count; i++, count /= 256)
+        nonce[i] = count % 256;
+}
+
+static int hkdf(const byte *secret, size_t secret_size, const char *salt, const char *info,
+                byte *key) {
+    size_t size = 32;
+    return crypto_hkdf(secret, secret_size, (const byte *) salt, strlen(salt),
+                       (const byte *) info, strlen(info), key, &size);
+}
+
+static void controller_init(controller_t *controller, const char *device_id) {
+    snprintf(controller->device_id, sizeof(controller->device_id), "%s", device_id);
+    crypto_ed25519_init(&controller->key);
+    crypto_ed25519_generate(&controller->key);
+    controller->encrypted = false;
+}
+
+void controller_provision(controller_t *controller, const char *device_id) {
+    host_storage_clear();
+    homekit_storage_init();
+    homekit_storage_save_accessory_id(CONTROLLER_ACCESSORY_ID);
+    crypto_ed25519_init(&accessory_key);
+    crypto_ed25519_generate(&accessory_key);
+    homekit_storage_save_accessory_key(&accessory_key);
+
+    controller_init(controller, device_id);
+    homekit_storage_add_pairing(controller->device_id, &controller->key, pairing_permissions_admin);
+}
+
+void controller_add(controller_t *controller, const char *device_id) {
+    controller_init(controller, device_id);
+    homekit_storage_add_pairing(controller->device_id, &controller->key, 0);
+}
+
+void controller_connect(controller_t *controller) {
+    controller->socket = host_connect();
+    controller->received.clear();
+    controller->frames.clear();
+    controller->events.clear();
+    controller->encrypted = false;
+    controller->count_reads = controller->count_writes = 0;
+    arduino_homekit_loop();
+}
+
+void controller_disconnect(controller_t *controller) {
+    if (controller->socket)
+        controller->socket->open = false;
+    arduino_homekit_loop();
+    controller->socket.reset();
+}
+
+static void send_plain(controller_t *controller, const std::string &data) {
+    controller->socket->in.insert(controller->socket->in.end(), data.begin(), data.end());
+}
+
+void controller_send_frame(controller_t *controller, const std::string &plain) {
+    size_t size = std::min(plain.size(), (size_t) 1024);
+    byte frame[2 + 1024 + 16], nonce[12];
+    frame[0] = size % 256;
+    frame[1] = size / 256;
+    nonce_of(controller->count_writes++, nonce);
+    size_t encrypted_size = size + 16;
+    crypto_chacha20poly1305_encrypt(controller->write_key, nonce, frame, 2,
+                                    (const byte *) plain.data(), size, frame + 2, &encrypted_size);
+    controller->socket->in.insert(controller->socket->in.end(), frame, frame + 2 + encrypted_size);
+}
+
+static void send_encrypted(controller_t *controller, const std::string &data) {
+    for (size_t offset = 0; offset < data.size(); offset += 1024)
+        controller_send_frame(controller, data.substr(offset, 1024));
+}
+
+void controller_pump(controller_t *controller) {
+    arduino_homekit_loop();
+    std::deque<uint8_t> &out = controller->socket->out;
+    if (!controller->encrypted) {
+        controller->received.append(out.begin(), out.end());
+        out.clear();
+        return;
+    }
+
+    controller->frames.append(out.begin(), out.end());
+    out.clear();
+    while (controller->frames.size() >= 2) {
+        const byte *frame = (const byte *) controller->frames.data();
+        size_t size = frame[0] + frame[1] * 256;
+        if (controller->frames.size() < 2 + size + 16)
+            break;
+
+        byte nonce[12], plain[1024];
+        size_t plain_size = sizeof(plain);
+        nonce_of(controller->count_reads++, nonce);
+        if (crypto_chacha20poly1305_decrypt(controller->read_key, nonce, frame, 2, frame + 2,
+                                            size + 16, plain, &plain_size)) {
+            fprintf(stderr, "controller: frame %llu does not decrypt\n",
+                    (unsigned long long) controller->count_reads - 1);
+            controller->frames.clear();
+            return;
+        }
+        controller->received.append((const char *) plain, plain_size);
+        controller->frames.erase(0, 2 + size + 16);
+    }
+}
+
+static const char *header_value(const std::string &headers, const char *name) {
+    size_t length = strlen(name);
+    for (size_t line = 0; line < headers.size(); line = headers.find("\r\n", line) + 2) {
+        if (!strncasecmp(headers.c_str() + line, name, length) && headers[line + length] == ':')
+            return headers.c_str() + line + length + 1;
+        if (headers.find("\r\n", line) == std::string::npos)
+            break;
+    }
+    return NULL;
+}
+
+// Body of a chunked message that starts at offset, false while incomplete
+static bool dechunk(const std::string &data, size_t *offset, std::string *body) {
+    size_t position = *offset;
+    std::string joined;
+    for (;;) {
+        size_t line_end = data.find("\r\n", position);
+        if (line_end == std::string::npos)
+            return false;
+        size_t size = strtoul(data.c_str() + position, NULL, 16);
+        position = line_end + 2;
+        if (data.size() < position + size + 2)
+            return false;
+        joined.append(data, position, size);
+        position += size + 2;
+        if (!size)
+            break;
+    }
+    *offset = position;
+    *body = joined;
+    return true;
+}
+
+// One response or EVENT off the received text, false while incomplete
+static bool take_message(controller_t *controller, bool *event,
+                         controller_response_t *response) {
+    std::string &received = controller->received;
+    size_t headers_end = received.find("\r\n\r\n");
+    if (headers_end == std::string::npos)
+        return false;
+
+    std::string headers = received.substr(0, headers_end + 2);
+    size_t offset = headers_end + 4;
+    std::string body;
+    const char *length = header_value(headers, "Content-Length");
+    const char *encoding = header_value(headers, "Transfer-Encoding");
+    if (encoding && strstr(encoding, "chunked")) {
+        if (!dechunk(received, &offset, &body))
+            return false;
+    } else if (length) {
+        size_t size = strtoul(length, NULL, 10);
+        if (received.size() < offset + size)
+            return false;
+        body = received.substr(offset, size);
+        offset += size;
+    }
+    received.erase(0, offset);
+
+    *event = !strncmp(headers.c_str(), "EVENT/", 6);
+    const char *status = strchr(headers.c_str(), ' ');
+    response->status = status ? atoi(status + 1) : 0;
+    response->headers = headers;
+    response->body = body;
+    return true;
+}
+
+int controller_receive(controller_t *controller, controller_response_t *response) {
+    for (int i = 0; i < CONTROLLER_PUMP_LOOPS; i++) {
+        controller_pump(controller);
+        bool event;
+        while (take_message(controller, &event, response)) {
+            if (!event)
+                return 0;
+            controller->events.push_back(response->body);
+        }
+    }
+    return -1;
+}
+
+int controller_request(controller_t *controller, const char *method, const char *path,
+                       const std::string &body, controller_response_t *response,
+                       const char *content_type) {
+    std::string request = std::string(method) + " " + path + " HTTP/1.1\r\nHost: accessory\r\n";
+    if (!body.empty() || strcmp(method, "GET")) {
+        request += "Content-Type: " + std::string(content_type) + "\r\n";
+        request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    request += "\r\n" + body;
+
+    if (controller->encrypted)
+        send_encrypted(controller, request);
+    else
+        send_plain(controller, request);
+    return controller_receive(controller, response);
+}
+
+bool controller_event(controller_t *controller, std::string *body, int loops) {
+    for (int i = 0; controller->events.empty() && i < loops; i++) {
+        controller_pump(controller);
+        bool event;
+        controller_response_t response;
+        while (take_message(controller, &event, &response)) {
+            if (event)
+                controller->events.push_back(response.body);
+        }
+    }
+    if (controller->events.empty())
+        return false;
+    *body = controller->events.front();
+    controller->events.pop_front();
+    return true;
+}
+
+static std::string tlv_string(tlv_values_t *values) {
+    size_t size = 0;
+    tlv_format(values, NULL, &size);
+    std::string data(size, '\0');
+    tlv_format(values, (byte *) &data[0], &size);
+    tlv_free(values);
+    return data;
+}
+
+// The TLV body of a pair verify exchange, NULL without a 200 answer
+static tlv_values_t *pair_verify_request(controller_t *controller, const std::string &body) {
+    controller_response_t response;
+    if (controller_request(controller, "POST", "/pair-verify", body, &response,
+                           "application/pairing+tlv8") || response.status != 200)
+        return NULL;
+    tlv_values_t *values = tlv_new();
+    if (tlv_parse((const byte *) response.body.data(), response.body.size(), values)
+            || tlv_get_integer_value(values, TLVType_Error, 0)) {
+        tlv_free(values);
+        return NULL;
+    }
+    return values;
+}
+
+int controller_pair_verify_start(controller_t *controller) {
+    size_t size = sizeof(controller->curve_public);
+    crypto_curve25519_init(&controller->curve_key);
+    if (crypto_curve25519_generate(&controller->curve_key)
+            || crypto_curve25519_export_public(&controller->curve_key, controller->curve_public,
+                                               &size))
+        return -1;
+
+    tlv_values_t *m1 = tlv_new();
+    tlv_add_integer_value(m1, TLVType_State, 1, 1);
+    tlv_add_value(m1, TLVType_PublicKey, controller->curve_public, sizeof(controller->curve_public));
+    std::string body = tlv_string(m1);
+    double started = host_seconds();
+    tlv_values_t *m2 = pair_verify_request(controller, body);
+    controller->m2_seconds = host_seconds() - started;
+    if (!m2)
+        return -1;
+
+    int r = -1;
+    tlv_t *public_key = tlv_get_value(m2, TLVType_PublicKey);
+    tlv_t *encrypted = tlv_get_value(m2, TLVType_EncryptedData);
+    if (tlv_get_integer_value(m2, TLVType_State, -1) == 2 && public_key && public_key->size == 32
+            && encrypted && encrypted->size > 16) {
+        memcpy(controller->accessory_curve_public, public_key->value, 32);
+
+        curve25519_key accessory_curve;
+        size_t secret_size = sizeof(controller->secret);
+        crypto_curve25519_init(&accessory_curve);
+        r = crypto_curve25519_import_public(&accessory_curve, public_key->value, 32);
+        if (!r)
+            r = crypto_curve25519_shared_secret(&controller->curve_key, &accessory_curve,
+                                                controller->secret, &secret_size);
+        crypto_curve25519_done(&accessory_curve);
+        if (!r)
+            r = hkdf(controller->secret, sizeof(controller->secret), "Pair-Verify-Encrypt-Salt",
+                     "Pair-Verify-Encrypt-Info", controller->verify_key);
+
+        std::string plain(encrypted->size - 16, '\0');
+        size_t plain_size = plain.size();
+        if (!r)
+            r = crypto_chacha20poly1305_decrypt(controller->verify_key,
+                                                (const byte *) "\0\0\0\0PV-Msg02", NULL, 0,
+                                                encrypted->value, encrypted->size,
+                                                (byte *) &plain[0], &plain_size);
+
+        tlv_values_t *sub = tlv_new();
+        if (!r)
+            r = tlv_parse((const byte *) plain.data(), plain_size, sub);
+        tlv_t *id = tlv_get_value(sub, TLVType_Identifier);
+        tlv_t *signature = tlv_get_value(sub, TLVType_Signature);
+        if (!r && (!id || !signature || id->size != strlen(CONTROLLER_ACCESSORY_ID)
+                   || memcmp(id->value, CONTROLLER_ACCESSORY_ID, id->size)))
+            r = -1;
+        if (!r) {
+            std::string info((const char *) controller->accessory_curve_public, 32);
+            info += CONTROLLER_ACCESSORY_ID;
+            info.append((const char *) controller->curve_public, 32);
+            r = crypto_ed25519_verify(&accessory_key, (const byte *) info.data(), info.size(),
+                                      signature->value, signature->size);
+        }
+        tlv_free(sub);
+    }
+    tlv_free(m2);
+    return r ? -1 : 0;
+}
+
+int controller_pair_verify_finish(controller_t *controller) {
+    std::string info((const char *) controller->curve_public, 32);
+    info += controller->device_id;
+    info.append((const char *) controller->accessory_curve_public, 32);
+    byte signature[64];
+    size_t signature_size = sizeof(signature);
+    if (crypto_ed25519_sign(&controller->key, (const byte *) info.data(), info.size(), signature,
+                            &signature_size))
+        return -1;
+
+    tlv_values_t *sub = tlv_new();
+    tlv_add_string_value(sub, TLVType_Identifier, controller->device_id);
+    tlv_add_value(sub, TLVType_Signature, signature, signature_size);
+    std::string plain = tlv_string(sub);
+
+    std::string encrypted(plain.size() + 16, '\0');
+    size_t encrypted_size = encrypted.size();
+    crypto_chacha20poly1305_encrypt(controller->verify_key, (const byte *) "\0\0\0\0PV-Msg03",
+                                    NULL, 0, (const byte *) plain.data(), plain.size(),
+                                    (byte *) &encrypted[0], &encrypted_size);
+
+    tlv_values_t *m3 = tlv_new();
+    tlv_add_integer_value(m3, TLVType_State, 1, 3);
+    tlv_add_value(m3, TLVType_EncryptedData, (const byte *) encrypted.data(), encrypted_size);
+    tlv_values_t *m4 = pair_verify_request(controller, tlv_string(m3));
+    crypto_curve25519_done(&controller->curve_key);
+    if (!m4)
+        return -1;
+    int state = tlv_get_integer_value(m4, TLVType_State, -1);
+    tlv_free(m4);
+    if (state != 4)
+        return -1;
+
+    if (hkdf(controller->secret, sizeof(controller->secret), "Control-Salt",
+             "Control-Read-Encryption-Key", controller->read_key)
+            || hkdf(controller->secret, sizeof(controller->secret), "Control-Salt",
+                    "Control-Write-Encryption-Key", controller->write_key))
+        return -1;
+    controller->encrypted = true;
+    controller->count_reads = controller->count_writes = 0;
+    return 0;
+}
+
+int controller_pair_verify(controller_t *controller) {
+    if (controller_pair_verify_start(controller))
+        return -1;
+    return controller_pair_verify_finish(controller);
+}
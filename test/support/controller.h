@@ -0,0 +1,78 @@
+#pragma once
+
+// A HomeKit controller on an in-memory connection, for the tests that run
+// arduino_homekit_server.cpp. It pair verifies against a pairing it put in
+// storage itself and then speaks HAP over encrypted frames. Every wait pumps
+// arduino_homekit_loop(), the server runs on the test's thread.
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "crypto.h"
+#include "WiFiClient.h"
+
+#define CONTROLLER_ACCESSORY_ID "1A:2B:3C:4D:5E:6F"
+
+typedef struct {
+    int status;
+    std::string headers;
+    std::string body; // chunks joined
+} controller_response_t;
+
+typedef struct {
+    char device_id[37];
+    ed25519_key key;
+
+    std::shared_ptr<host_socket> socket;
+    std::string received; // plain text not parsed yet
+    std::string frames;   // encrypted bytes short of a frame
+    std::deque<std::string> events; // EVENT bodies not taken yet
+
+    // between M1 and M3 of pair verify
+    curve25519_key curve_key;
+    byte curve_public[32];
+    byte accessory_curve_public[32];
+    byte secret[32];
+    byte verify_key[32];
+    double m2_seconds; // from sending M1 until M2 is in
+
+    bool encrypted;
+    byte read_key[32];  // accessory to controller
+    byte write_key[32]; // controller to accessory
+    uint64_t count_reads;
+    uint64_t count_writes;
+} controller_t;
+
+// Storage with an accessory id, key and an admin pairing of this controller,
+// to be done before arduino_homekit_setup
+void controller_provision(controller_t *controller, const char *device_id);
+// Another controller paired by the same admin, provision the first one
+void controller_add(controller_t *controller, const char *device_id);
+
+void controller_connect(controller_t *controller);
+void controller_disconnect(controller_t *controller);
+
+// M1 to M2, checks the accessory signature after m2_seconds is taken
+int controller_pair_verify_start(controller_t *controller);
+// M3 to M4, the session is encrypted after it
+int controller_pair_verify_finish(controller_t *controller);
+int controller_pair_verify(controller_t *controller);
+
+// Sends a request and pumps the server until its response arrived, -1 when
+// it does not within a few hundred loops
+int controller_request(controller_t *controller, const char *method, const char *path,
+                       const std::string &body, controller_response_t *response,
+                       const char *content_type = "application/hap+json");
+// One encrypted frame of at most 1024 bytes, an empty one too
+void controller_send_frame(controller_t *controller, const std::string &plain);
+// Pumps the server until a response came, queueing EVENTs on the way, -1 when
+// it does not within a few hundred loops
+int controller_receive(controller_t *controller, controller_response_t *response);
+
+// Next EVENT body, false when none came within the given loops
+bool controller_event(controller_t *controller, std::string *body, int loops = 1);
+
+// Loops the server once and takes whatever it sent
+void controller_pump(controller_t *controller);
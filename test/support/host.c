@@ -0,0 +1,236 @@
+// Host side of the platform functions EspHap calls on the ESP8266
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "osapi.h"
+#include "user_interface.h"
+#include "host.h"
+#include "check.h"
+
+int check_failures = 0;
+
+static uint32_t random_state = 0x12345678;
+static unsigned long time_offset = 0;
+
+void host_random_seed(uint32_t seed) {
+    random_state = seed ? seed : 0x12345678;
+}
+
+// xorshift32, reproducible across runs
+static uint32_t host_random_next(void) {
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+    return x;
+}
+
+uint32_t homekit_random() {
+    return host_random_next();
+}
+
+void homekit_random_fill(uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        data[i] = (uint8_t)host_random_next();
+}
+
+int os_get_random(unsigned char *data, int size) {
+    homekit_random_fill(data, size);
+    return 0;
+}
+
+unsigned long os_random(void) {
+    return host_random_next();
+}
+
+double host_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double host_start(void) {
+    static double start = 0;
+    if (!start)
+        start = host_seconds();
+    return start;
+}
+
+void host_time_advance(unsigned long ms) {
+    time_offset += ms;
+}
+
+unsigned long millis(void) {
+    return (unsigned long)((host_seconds() - host_start()) * 1000) + time_offset;
+}
+
+unsigned long micros(void) {
+    return (unsigned long)((host_seconds() - host_start()) * 1000000) + time_offset * 1000;
+}
+
+void delay(unsigned long ms) {
+    time_offset += ms;
+}
+
+void yield(void) {
+}
+
+void optimistic_yield(uint32_t interval_us) {
+    (void)interval_us;
+}
+
+uint32 system_get_free_heap_size(void) {
+    return 40 * 1024;
+}
+
+void system_restart(void) {
+    fprintf(stderr, "system_restart called\n");
+    abort();
+}
+
+void homekit_system_restart() {
+    system_restart();
+}
+
+void homekit_overclock_start() {
+}
+
+void homekit_overclock_end() {
+}
+
+void watchdog_disable_all() {
+}
+
+void watchdog_enable_all() {
+}
+
+void watchdog_check_begin() {
+}
+
+void watchdog_check_end(const char *message) {
+    (void)message;
+}
+
+int host_log_printf(const char *format, ...) {
+    static int enabled = -1;
+    if (enabled < 0)
+        enabled = getenv("HOMEKIT_TEST_LOG") != NULL;
+    if (!enabled)
+        return 0;
+
+    va_list args;
+    va_start(args, format);
+    int r = vprintf(format, args);
+    va_end(args);
+    return r;
+}
+
+// Pairing storage, a byte vector like config homeKitPairData in src/homeKit2.cpp
+
+#define HOST_STORAGE_CAPACITY 1024
+
+static uint8_t storage[HOST_STORAGE_CAPACITY];
+static size_t storage_size = 0;
+
+bool read_storage(uint32 address, uint8_t *data, uint32 size) {
+    if (address + size > storage_size)
+        memset(data, 0xff, size);
+    else
+        memcpy(data, storage + address, size);
+    return true;
+}
+
+bool write_storage(uint32 address, uint8_t *data, uint32 size) {
+    if (address + size > HOST_STORAGE_CAPACITY)
+        return false;
+    if (address + size > storage_size)
+        storage_size = address + size;
+    memcpy(storage + address, data, size);
+    return true;
+}
+
+bool reset_storage() {
+    storage_size = 0;
+    return true;
+}
+
+size_t host_storage_size(void) {
+    return storage_size;
+}
+
+// Storage files, a few named buffers
+
+#define HOST_FILES 4
+
+typedef struct {
+    char path[32];
+    uint8_t *data;
+    size_t size;
+} host_file_t;
+
+static host_file_t files[HOST_FILES];
+
+static host_file_t *host_file_find(const char *path) {
+    for (int i = 0; i < HOST_FILES; i++) {
+        if (files[i].data && !strcmp(files[i].path, path))
+            return &files[i];
+    }
+    return NULL;
+}
+
+bool read_storage_file(const char *path, uint8_t *data, uint32 size) {
+    host_file_t *file = host_file_find(path);
+    if (!file || file->size != size)
+        return false;
+    memcpy(data, file->data, size);
+    return true;
+}
+
+bool write_storage_file(const char *path, const uint8_t *data, uint32 size) {
+    host_file_t *file = host_file_find(path);
+    for (int i = 0; !file && i < HOST_FILES; i++) {
+        if (!files[i].data)
+            file = &files[i];
+    }
+    if (!file || strlen(path) >= sizeof(file->path))
+        return false;
+
+    uint8_t *copy = malloc(size ? size : 1);
+    if (!copy)
+        return false;
+    memcpy(copy, data, size);
+    free(file->data);
+    strcpy(file->path, path);
+    file->data = copy;
+    file->size = size;
+    return true;
+}
+
+bool remove_storage_file(const char *path) {
+    host_file_t *file = host_file_find(path);
+    if (file) {
+        free(file->data);
+        memset(file, 0, sizeof(*file));
+    }
+    return true;
+}
+
+int host_storage_file_size(const char *path) {
+    host_file_t *file = host_file_find(path);
+    return file ? (int)file->size : -1;
+}
+
+void host_storage_clear(void) {
+    storage_size = 0;
+    memset(storage, 0xff, sizeof(storage));
+    for (int i = 0; i < HOST_FILES; i++) {
+        free(files[i].data);
+        memset(&files[i], 0, sizeof(files[i]));
+    }
+}
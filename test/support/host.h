@@ -0,0 +1,34 @@
+#pragma once
+
+// Controls of the host platform in host.c
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Same seed, same homekit_random_fill output
+void host_random_seed(uint32_t seed);
+
+// millis() runs with the real clock plus everything advanced here
+void host_time_advance(unsigned long ms);
+
+// Seconds of a monotonic clock, for the benchmarks
+double host_seconds(void);
+
+// Empties the emulated pairing storage and storage files
+void host_storage_clear(void);
+// Bytes held by the pairing storage, grows like the config vector does
+size_t host_storage_size(void);
+// Size of a storage file, -1 when there is none
+int host_storage_file_size(const char *path);
+
+// Heap high-water mark of malloc/calloc/realloc, when built with host_heap.c
+void host_heap_reset(void);
+size_t host_heap_peak(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,98 @@
+// Host side of LittleFS and of the file hooks src/homeKit2.cpp implements
+
+#include <string.h>
+#include <map>
+#include <string>
+
+#include "LittleFS.h"
+#include "arduino_homekit_server.h"
+#include "host_fs.h"
+
+namespace fs {
+
+struct host_file {
+    std::string path;
+    std::vector<uint8_t> data;
+};
+
+} // namespace fs
+
+fs::FS LittleFS;
+
+static std::map<std::string, std::shared_ptr<fs::host_file>> files;
+static std::map<std::string, size_t> written;
+static long write_budget = -1;
+
+size_t fs::File::read(uint8_t *buffer, size_t size) {
+    if (!file_ || position_ >= file_->data.size())
+        return 0;
+    size = std::min(size, file_->data.size() - position_);
+    memcpy(buffer, file_->data.data() + position_, size);
+    position_ += size;
+    return size;
+}
+
+size_t fs::File::write(const uint8_t *buffer, size_t size) {
+    if (!file_)
+        return 0;
+    if (write_budget >= 0) {
+        size = std::min(size, (size_t) write_budget);
+        write_budget -= size;
+    }
+    if (position_ + size > file_->data.size())
+        file_->data.resize(position_ + size);
+    memcpy(file_->data.data() + position_, buffer, size);
+    position_ += size;
+    written[file_->path] += size;
+    return size;
+}
+
+bool fs::File::seek(uint32_t position) {
+    if (!file_ || position > file_->data.size())
+        return false;
+    position_ = position;
+    return true;
+}
+
+size_t fs::File::size() const {
+    return file_ ? file_->data.size() : 0;
+}
+
+// "r" and "w" only, as EspHap opens its files
+fs::File fs::FS::open(const char *path, const char *mode) {
+    if (!strcmp(mode, "w")) {
+        std::shared_ptr<host_file> file = std::make_shared<host_file>();
+        file->path = path;
+        files[path] = file;
+        return File(file);
+    }
+    auto it = files.find(path);
+    return it != files.end() ? File(it->second) : File();
+}
+
+bool fs::FS::exists(const char *path) {
+    return files.count(path) > 0;
+}
+
+bool fs::FS::remove(const char *path) {
+    return files.erase(path) > 0;
+}
+
+File homekit_file_open(const char *path, const char *mode) {
+    return LittleFS.open(path, mode);
+}
+
+void host_fs_clear() {
+    files.clear();
+    written.clear();
+    write_budget = -1;
+}
+
+size_t host_fs_written(const char *path) {
+    auto it = written.find(path);
+    return it != written.end() ? it->second : 0;
+}
+
+void host_fs_fail_writes_after(long bytes) {
+    write_budget = bytes;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Controls of the LittleFS stand-in in host_fs.cpp
+
+#include <stddef.h>
+
+// Removes every file and the write counts
+void host_fs_clear();
+// Bytes written to a path, as the counting files of fsAccounting see them
+size_t host_fs_written(const char *path);
+// Writes fail once this many more bytes went to files, -1 never
+void host_fs_fail_writes_after(long bytes);
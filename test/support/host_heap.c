@@ -0,0 +1,56 @@
+// Heap high-water mark on the host, linked with -Wl,--wrap for malloc and
+// friends into the benchmarks that report heap use
+
+#include <malloc.h>
+#include <stddef.h>
+
+#include "host.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static size_t heap_current, heap_peak, heap_baseline;
+
+static void heap_add(void *ptr, size_t previous) {
+    if (!ptr)
+        return;
+    heap_current += malloc_usable_size(ptr) - previous;
+    if (heap_current > heap_peak)
+        heap_peak = heap_current;
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    heap_add(ptr, 0);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __real_calloc(count, size);
+    heap_add(ptr, 0);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    size_t previous = ptr ? malloc_usable_size(ptr) : 0;
+    void *resized = __real_realloc(ptr, size);
+    if (resized)
+        heap_add(resized, previous);
+    return resized;
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr)
+        heap_current -= malloc_usable_size(ptr);
+    __real_free(ptr);
+}
+
+void host_heap_reset(void) {
+    heap_peak = heap_baseline = heap_current;
+}
+
+size_t host_heap_peak(void) {
+    return heap_peak - heap_baseline;
+}
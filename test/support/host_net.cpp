@@ -0,0 +1,76 @@
+// Host side of WiFiServer and WiFiClient, connections are in memory
+
+#include <algorithm>
+#include <deque>
+
+#include "ESP8266WiFi.h"
+#include "ESP8266mDNS.h"
+#include "host_net.h"
+
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+
+static std::deque<std::shared_ptr<host_socket>> pending;
+
+std::shared_ptr<host_socket> host_connect() {
+    std::shared_ptr<host_socket> socket = std::make_shared<host_socket>();
+    pending.push_back(socket);
+    return socket;
+}
+
+void WiFiServer::begin() {
+}
+
+bool WiFiServer::hasClient() {
+    return !pending.empty();
+}
+
+WiFiClient WiFiServer::available() {
+    if (pending.empty())
+        return WiFiClient();
+    std::shared_ptr<host_socket> socket = pending.front();
+    pending.pop_front();
+    return WiFiClient(socket);
+}
+
+void WiFiServer::stop() {
+    pending.clear();
+}
+
+void WiFiServer::close() {
+    stop();
+}
+
+// Like lwip, received data can still be read after the peer closed
+uint8_t WiFiClient::connected() {
+    return socket_ && (socket_->open || !socket_->in.empty());
+}
+
+int WiFiClient::available() {
+    return socket_ ? socket_->in.size() : 0;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+    if (!socket_)
+        return -1;
+    size = std::min(size, socket_->in.size());
+    std::copy(socket_->in.begin(), socket_->in.begin() + size, buffer);
+    socket_->in.erase(socket_->in.begin(), socket_->in.begin() + size);
+    return size;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+    if (!socket_ || !socket_->open)
+        return 0;
+    socket_->out.insert(socket_->out.end(), buffer, buffer + size);
+    return size;
+}
+
+size_t WiFiClient::availableForWrite() {
+    return socket_ && socket_->open ? socket_->send_buffer : 0;
+}
+
+void WiFiClient::stop() {
+    if (socket_)
+        socket_->open = false;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Controls of the host network in host_net.cpp
+
+#include <memory>
+
+#include "WiFiClient.h"
+
+// A connection the next WiFiServer::available() accepts, the test writes
+// to in and reads from out
+std::shared_ptr<host_socket> host_connect();
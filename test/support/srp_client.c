@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "user_settings.h"
+#include <wolfssl/wolfcrypt/srp.h>
+
+#include "srp_client.h"
+
+extern const byte N[];
+extern const byte g[];
+int wc_SrpSetKeyH(Srp *srp, byte *secret, word32 size);
+
+struct srp_client {
+    Srp srp;
+    byte public_key[384];
+    word32 public_key_size;
+};
+
+srp_client_t *srp_client_new(const char *username, const char *password,
+                             const uint8_t *salt, size_t salt_size) {
+    srp_client_t *client = calloc(1, sizeof(srp_client_t));
+    if (!client)
+        return NULL;
+
+    int r = wc_SrpInit(&client->srp, SRP_TYPE_SHA512, SRP_CLIENT_SIDE);
+    if (r) {
+        free(client);
+        return NULL;
+    }
+    client->srp.keyGenFunc_cb = wc_SrpSetKeyH;
+
+    if (!r) r = wc_SrpSetUsername(&client->srp, (const byte *) username, strlen(username));
+    if (!r) r = wc_SrpSetParams(&client->srp, N, 384, g, 1, salt, salt_size);
+    if (!r) r = wc_SrpSetPassword(&client->srp, (const byte *) password, strlen(password));
+    client->public_key_size = sizeof(client->public_key);
+    if (!r) r = wc_SrpGetPublic(&client->srp, client->public_key, &client->public_key_size);
+    if (r) {
+        srp_client_free(client);
+        return NULL;
+    }
+    return client;
+}
+
+void srp_client_free(srp_client_t *client) {
+    wc_SrpTerm(&client->srp);
+    free(client);
+}
+
+int srp_client_get_public_key(srp_client_t *client, uint8_t *buffer, size_t *size) {
+    if (*size < client->public_key_size)
+        return -1;
+    memcpy(buffer, client->public_key, client->public_key_size);
+    *size = client->public_key_size;
+    return 0;
+}
+
+int srp_client_compute_key(srp_client_t *client, const uint8_t *server_public_key, size_t size) {
+    return wc_SrpComputeKey(&client->srp, client->public_key, client->public_key_size,
+                            (byte *) server_public_key, size);
+}
+
+int srp_client_get_proof(srp_client_t *client, uint8_t *proof, size_t *size) {
+    word32 proof_size = *size;
+    int r = wc_SrpGetProof(&client->srp, proof, &proof_size);
+    *size = proof_size;
+    return r;
+}
+
+int srp_client_verify(srp_client_t *client, const uint8_t *proof, size_t size) {
+    return wc_SrpVerifyPeersProof(&client->srp, (byte *) proof, size);
+}
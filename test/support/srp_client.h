@@ -0,0 +1,30 @@
+#pragma once
+
+// The controller side of pair setup, on wolfcrypt directly. crypto.h and
+// wolfssl/wolfcrypt/srp.h declare Srp differently, so the tests only see
+// this opaque handle.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct srp_client srp_client_t;
+
+srp_client_t *srp_client_new(const char *username, const char *password,
+                             const uint8_t *salt, size_t salt_size);
+void srp_client_free(srp_client_t *client);
+
+// A, SRP_MATH_BYTES long
+int srp_client_get_public_key(srp_client_t *client, uint8_t *buffer, size_t *size);
+// Shared secret from the accessory B, then M1 of the controller
+int srp_client_compute_key(srp_client_t *client, const uint8_t *server_public_key, size_t size);
+int srp_client_get_proof(srp_client_t *client, uint8_t *proof, size_t *size);
+// M2 of the accessory
+int srp_client_verify(srp_client_t *client, const uint8_t *proof, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,235 @@
+// GET /accessories from the cache rendered at init, against the uncached
+// render of the same database, over a pair verified session
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "arduino_homekit_server.h"
+#include "LittleFS.h"
+#include "cJSON.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define CACHE_PATH "/hapacc.cache"
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+
+uint32_t accessories_cache_key(homekit_server_config_t *config);
+bool accessories_cache_prepare(homekit_server_t *server);
+
+static controller_t controller;
+
+static void append(uint8_t *buffer, size_t size, void *context) {
+    ((std::string *) context)->append((const char *) buffer, size);
+}
+
+static std::string get_accessories() {
+    controller_response_t response;
+    CHECK_EQ(controller_request(&controller, "GET", "/accessories", "", &response), 0);
+    CHECK_EQ(response.status, 200);
+    return response.body;
+}
+
+static std::string cache_file() {
+    std::string data;
+    File file = LittleFS.open(CACHE_PATH, "r");
+    uint8_t buffer[256];
+    size_t size;
+    while (file && (size = file.read(buffer, sizeof(buffer))) > 0)
+        data.append((const char *) buffer, size);
+    return data;
+}
+
+// Cached characteristics start with their type, the uncached with aid
+static bool from_cache(const std::string &body) {
+    return body.find("{\"type\":\"23\"") != std::string::npos;
+}
+
+// Members of cached characteristics come in another order
+static bool same_json(const std::string &a, const std::string &b) {
+    cJSON *x = cJSON_Parse(a.c_str()), *y = cJSON_Parse(b.c_str());
+    bool same = x && y && cJSON_Compare(x, y, true);
+    cJSON_Delete(x);
+    cJSON_Delete(y);
+    return same;
+}
+
+static std::string uncached_accessories() {
+    LittleFS.remove(CACHE_PATH);
+    std::string body = get_accessories();
+    CHECK(accessories_cache_prepare(arduino_homekit_get_running_server()));
+    return body;
+}
+
+static void test_json_string_escaping() {
+    std::string out;
+    json_stream *json = json_new(8, append, &out);
+    json_array_start(json);
+    json_string(json, "a \"b\" \\ \x01\x1f\t end of a string longer than the buffer");
+    json_string(json, NULL);
+    json_array_end(json);
+    json_flush(json);
+    json_free(json);
+    CHECK_STR(out.c_str(),
+              "[\"a \\\"b\\\" \\\\ \\u0001\\u001f\\u0009 end of a string longer than the buffer\",\"\"]");
+}
+
+static void test_written_at_init() {
+    std::string file = cache_file();
+    CHECK(file.size() > 8);
+    // the header goes in twice, as a placeholder and once the body is written
+    CHECK_EQ(host_fs_written(CACHE_PATH), file.size() + 8);
+
+    uint32_t header[2];
+    memcpy(header, file.data(), sizeof(header));
+    CHECK_EQ(header[0], 0x31434148);
+    CHECK_EQ(header[1], accessories_cache_key(&accessory_config));
+    // one splice marker per characteristic, none from the escaped strings
+    CHECK_EQ(std::count(file.begin(), file.end(), '\x01'), 10);
+}
+
+static void test_cached_equals_uncached() {
+    std::string cached = get_accessories();
+    CHECK(from_cache(cached));
+    std::string uncached = uncached_accessories();
+    CHECK(!from_cache(uncached));
+    CHECK(same_json(cached, uncached));
+
+    cJSON *root = cJSON_Parse(cached.c_str());
+    CHECK(root != NULL);
+    if (!root)
+        return;
+    cJSON *services = cJSON_GetObjectItem(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "accessories"), 0),
+                                          "services");
+    cJSON *label = cJSON_GetArrayItem(cJSON_GetObjectItem(cJSON_GetArrayItem(services, 1),
+                                                          "characteristics"), 3);
+    CHECK_EQ(cJSON_GetObjectItem(label, "iid")->valueint, 400);
+    CHECK_STR(cJSON_GetObjectItem(label, "value")->valuestring, accessory_label.value.string_value);
+    CHECK_STR(cJSON_GetObjectItem(label, "type")->valuestring, "F0000001-03E9-4157-B099-54F4A4944163");
+    CHECK(cJSON_IsFalse(cJSON_GetObjectItem(label, "ev")));
+    cJSON_Delete(root);
+}
+
+static void test_live_values_and_events() {
+    accessory_on.value = HOMEKIT_BOOL(true);
+    accessory_power.value = HOMEKIT_FLOAT(123.5);
+    controller_response_t response;
+    CHECK_EQ(controller_request(&controller, "PUT", "/characteristics",
+                                "{\"characteristics\":[{\"aid\":1,\"iid\":302,\"ev\":true}]}", &response), 0);
+    CHECK_EQ(response.status, 204);
+
+    std::string cached = get_accessories();
+    CHECK(cached.find("\"iid\":301,\"ev\":false,\"value\":true") != std::string::npos);
+    CHECK(cached.find("\"iid\":203,\"ev\":false,\"value\":123.5") != std::string::npos);
+    CHECK(cached.find("\"iid\":302,\"ev\":true,\"value\":false") != std::string::npos);
+    CHECK(same_json(cached, uncached_accessories()));
+
+    accessory_on.value = HOMEKIT_BOOL(false);
+    accessory_power.value = HOMEKIT_FLOAT(0);
+}
+
+// A data_reader is read for GET /characteristics only, /accessories leaves
+// its value out
+static void test_data_read_on_request() {
+    accessory_history_reads = 0;
+    std::string cached = get_accessories();
+    CHECK(from_cache(cached));
+    std::string uncached = uncached_accessories();
+    CHECK_EQ(accessory_history_reads, 0);
+    for (const std::string &body : {cached, uncached}) {
+        size_t history = body.find("\"iid\":500");
+        CHECK(history != std::string::npos);
+        CHECK(body.find("\"value\"", history) > body.find('}', history));
+    }
+
+    controller_response_t response;
+    CHECK_EQ(controller_request(&controller, "GET", "/characteristics?id=1.500", "", &response), 0);
+    CHECK_EQ(response.status, 200);
+    CHECK_EQ(accessory_history_reads, 1);
+    // "history entries" in base64
+    CHECK(response.body.find("\"value\":\"aGlzdG9yeSBlbnRyaWVz\"") != std::string::npos);
+}
+
+static void test_stale_key_rebuilt() {
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    std::string before = get_accessories();
+    size_t written = host_fs_written(CACHE_PATH);
+
+    accessory_config.config_number++;
+    server->accessories_cache_key = accessories_cache_key(&accessory_config);
+    std::string uncached = get_accessories();
+    CHECK(!from_cache(uncached)); // stale
+    CHECK(same_json(uncached, before));
+    CHECK_EQ(host_fs_written(CACHE_PATH), written);
+
+    CHECK(accessories_cache_prepare(server));
+    CHECK(host_fs_written(CACHE_PATH) > written);
+    uint32_t key;
+    memcpy(&key, cache_file().data() + 4, sizeof(key));
+    CHECK_EQ(key, server->accessories_cache_key);
+    std::string cached = get_accessories();
+    CHECK(from_cache(cached));
+    CHECK(same_json(cached, before));
+
+    // a valid cache is kept
+    written = host_fs_written(CACHE_PATH);
+    CHECK(accessories_cache_prepare(server));
+    CHECK_EQ(host_fs_written(CACHE_PATH), written);
+}
+
+static void test_bad_header_rebuilt() {
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    std::string before = get_accessories();
+
+    File file = LittleFS.open(CACHE_PATH, "r");
+    const uint8_t zero[4] = { 0 };
+    file.write(zero, sizeof(zero)); // magic
+    file.close();
+    std::string uncached = get_accessories();
+    CHECK(!from_cache(uncached));
+    CHECK(same_json(uncached, before));
+
+    CHECK(accessories_cache_prepare(server));
+    CHECK_EQ(cache_file()[0], 'H');
+}
+
+static void test_write_failure_removes() {
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    std::string before = get_accessories();
+
+    LittleFS.remove(CACHE_PATH);
+    host_fs_fail_writes_after(100);
+    CHECK(!accessories_cache_prepare(server));
+    host_fs_fail_writes_after(-1);
+    CHECK(!LittleFS.exists(CACHE_PATH));
+    std::string uncached = get_accessories();
+    CHECK(!from_cache(uncached));
+    CHECK(same_json(uncached, before));
+
+    CHECK(accessories_cache_prepare(server));
+    CHECK(from_cache(get_accessories()));
+}
+
+int main() {
+    host_random_seed(36);
+    host_fs_clear();
+    controller_provision(&controller, DEVICE_ID);
+    arduino_homekit_setup(&accessory_config);
+    controller_connect(&controller);
+    CHECK_EQ(controller_pair_verify(&controller), 0);
+
+    RUN(test_json_string_escaping);
+    RUN(test_written_at_init);
+    RUN(test_cached_equals_uncached);
+    RUN(test_live_values_and_events);
+    RUN(test_data_read_on_request);
+    RUN(test_stale_key_rebuilt);
+    RUN(test_bad_header_rebuilt);
+    RUN(test_write_failure_removes);
+
+    controller_disconnect(&controller);
+    return check_result();
+}
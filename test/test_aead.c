@@ -0,0 +1,186 @@
+// The single pass ChaCha20-Poly1305 of crypto.c against RFC 8439 and the
+// wolfcrypt two pass code it replaces
+
+#include <string.h>
+
+#include "user_settings.h"
+#include <wolfssl/wolfcrypt/chacha20_poly1305.h>
+
+#include "port.h"
+#include "check.h"
+#include "host.h"
+
+int crypto_chacha20poly1305_encrypt(
+    const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
+    const byte *message, size_t message_size,
+    byte *encrypted, size_t *encrypted_size);
+int crypto_chacha20poly1305_decrypt(
+    const byte *key, const byte *nonce, const byte *aad, size_t aad_size,
+    const byte *message, size_t message_size,
+    byte *decrypted, size_t *decrypted_size);
+int crypto_chacha20poly1305_empty_tag(const byte *key, const byte *nonce, byte *tag);
+
+static void from_hex(const char *hex, byte *out) {
+    for (; hex[0] && hex[1]; hex += 2) {
+        unsigned value;
+        sscanf(hex, "%2x", &value);
+        *out++ = value;
+    }
+}
+
+// RFC 8439 2.8.2
+static const char plaintext[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for "
+    "the future, sunscreen would be it.";
+static const char key_hex[] = "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f";
+static const char nonce_hex[] = "070000004041424344454647";
+static const char aad_hex[] = "50515253c0c1c2c3c4c5c6c7";
+static const char ciphertext_hex[] =
+    "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+    "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+    "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+    "3ff4def08e4b7a9de576d26586cec64b6116";
+static const char tag_hex[] = "1ae10b594f09e26a7e902ecbd0600691";
+
+#define PLAINTEXT_SIZE (sizeof(plaintext) - 1)
+
+static byte key[32], nonce[12], aad[12];
+
+static void test_rfc8439_encrypt() {
+    byte expected[PLAINTEXT_SIZE + 16], encrypted[PLAINTEXT_SIZE + 16];
+    size_t encrypted_size = sizeof(encrypted);
+
+    from_hex(ciphertext_hex, expected);
+    from_hex(tag_hex, expected + PLAINTEXT_SIZE);
+    CHECK_EQ(crypto_chacha20poly1305_encrypt(key, nonce, aad, sizeof(aad),
+                                             (const byte *) plaintext, PLAINTEXT_SIZE,
+                                             encrypted, &encrypted_size), 0);
+    CHECK_EQ(encrypted_size, sizeof(expected));
+    CHECK_MEM(encrypted, expected, sizeof(expected));
+}
+
+static void test_rfc8439_decrypt() {
+    byte encrypted[PLAINTEXT_SIZE + 16], decrypted[PLAINTEXT_SIZE];
+    size_t decrypted_size = sizeof(decrypted);
+
+    from_hex(ciphertext_hex, encrypted);
+    from_hex(tag_hex, encrypted + PLAINTEXT_SIZE);
+    CHECK_EQ(crypto_chacha20poly1305_decrypt(key, nonce, aad, sizeof(aad), encrypted, sizeof(encrypted),
+                                             decrypted, &decrypted_size), 0);
+    CHECK_EQ(decrypted_size, PLAINTEXT_SIZE);
+    CHECK_MEM(decrypted, plaintext, PLAINTEXT_SIZE);
+}
+
+// a forged frame fails and leaves nothing of the plaintext behind
+static void test_forgery_wiped() {
+    byte encrypted[PLAINTEXT_SIZE + 16], decrypted[PLAINTEXT_SIZE], zeros[PLAINTEXT_SIZE] = {0};
+    const size_t flips[] = {0, 5, PLAINTEXT_SIZE - 1, PLAINTEXT_SIZE, PLAINTEXT_SIZE + 15};
+
+    for (size_t i = 0; i < sizeof(flips) / sizeof(*flips); i++) {
+        size_t decrypted_size = sizeof(decrypted);
+        from_hex(ciphertext_hex, encrypted);
+        from_hex(tag_hex, encrypted + PLAINTEXT_SIZE);
+        encrypted[flips[i]] ^= 0x80;
+        memset(decrypted, 0xaa, sizeof(decrypted));
+        CHECK(crypto_chacha20poly1305_decrypt(key, nonce, aad, sizeof(aad), encrypted, sizeof(encrypted),
+                                              decrypted, &decrypted_size) != 0);
+        CHECK_MEM(decrypted, zeros, sizeof(zeros));
+    }
+
+    // so does another aad
+    size_t decrypted_size = sizeof(decrypted);
+    byte other_aad[sizeof(aad)];
+    memcpy(other_aad, aad, sizeof(aad));
+    other_aad[0] ^= 1;
+    from_hex(ciphertext_hex, encrypted);
+    from_hex(tag_hex, encrypted + PLAINTEXT_SIZE);
+    CHECK(crypto_chacha20poly1305_decrypt(key, nonce, other_aad, sizeof(other_aad), encrypted, sizeof(encrypted),
+                                          decrypted, &decrypted_size) != 0);
+    CHECK_MEM(decrypted, zeros, sizeof(zeros));
+}
+
+static void test_buffer_sizes() {
+    byte buffer[PLAINTEXT_SIZE + 16];
+    size_t size = PLAINTEXT_SIZE + 15;
+
+    CHECK(crypto_chacha20poly1305_encrypt(key, nonce, NULL, 0, (const byte *) plaintext, PLAINTEXT_SIZE,
+                                          buffer, &size) != 0);
+    CHECK_EQ(size, PLAINTEXT_SIZE + 16);
+
+    size = 0;
+    CHECK(crypto_chacha20poly1305_decrypt(key, nonce, NULL, 0, buffer, sizeof(buffer), buffer, &size) != 0);
+    CHECK_EQ(size, PLAINTEXT_SIZE);
+
+    // a tag alone is an empty message, and still authenticated
+    size = sizeof(buffer);
+    CHECK_EQ(crypto_chacha20poly1305_encrypt(key, nonce, aad, sizeof(aad), NULL, 0, buffer, &size), 0);
+    CHECK_EQ(size, 16);
+    size = sizeof(buffer);
+    CHECK_EQ(crypto_chacha20poly1305_decrypt(key, nonce, aad, sizeof(aad), buffer, 16, buffer, &size), 0);
+    CHECK_EQ(size, 0);
+    buffer[0] ^= 1;
+    CHECK(crypto_chacha20poly1305_decrypt(key, nonce, aad, sizeof(aad), buffer, 16, buffer, &size) != 0);
+    CHECK(crypto_chacha20poly1305_decrypt(key, nonce, NULL, 0, buffer, 15, buffer, &size) != 0);
+}
+
+// Expected tags from a plain RFC 8439 2.8 implementation
+static void test_reference_tags() {
+    byte tag[16], expected[16];
+
+    CHECK_EQ(crypto_chacha20poly1305_empty_tag(key, nonce, tag), 0);
+    from_hex("a0784d7a4716f3feb4f64e7f4b39bf04", expected);
+    CHECK_MEM(tag, expected, sizeof(tag));
+
+    // a full HAP frame: 2 byte length as aad, 64-bit counter nonce
+    byte frame_nonce[12] = {0, 0, 0, 0, 5};
+    byte length[2] = {0x00, 0x04};
+    byte message[1024], encrypted[1024 + 16];
+    size_t encrypted_size = sizeof(encrypted);
+    for (size_t i = 0; i < sizeof(message); i++)
+        message[i] = i;
+    CHECK_EQ(crypto_chacha20poly1305_encrypt(key, frame_nonce, length, sizeof(length), message, sizeof(message),
+                                             encrypted, &encrypted_size), 0);
+    from_hex("cbda61d8b31c4fda37b1616829186058", expected);
+    CHECK_MEM(encrypted + sizeof(message), expected, sizeof(expected));
+}
+
+// every chunking of the 64-byte blocks, aad around the 16 byte padding
+static void test_matches_wolfcrypt() {
+    byte message[1100], other_aad[40], expected[1100 + 16], actual[1100 + 16], decrypted[1100];
+
+    host_random_seed(3);
+    for (size_t size = 1; size < sizeof(message); size += size < 200 ? 1 : 37) {
+        size_t aad_size = homekit_random() % sizeof(other_aad);
+        size_t actual_size = sizeof(actual), decrypted_size = sizeof(decrypted);
+        homekit_random_fill(message, size);
+        homekit_random_fill(other_aad, aad_size);
+
+        CHECK_EQ(wc_ChaCha20Poly1305_Encrypt(key, nonce, aad_size ? other_aad : NULL, aad_size,
+                                             message, size, expected, expected + size), 0);
+        CHECK_EQ(crypto_chacha20poly1305_encrypt(key, nonce, aad_size ? other_aad : NULL, aad_size,
+                                                 message, size, actual, &actual_size), 0);
+        CHECK_EQ(actual_size, size + 16);
+        if (memcmp(actual, expected, size + 16))
+            fprintf(stderr, "  message %zu bytes, aad %zu bytes\n", size, aad_size);
+        CHECK_MEM(actual, expected, size + 16);
+
+        CHECK_EQ(crypto_chacha20poly1305_decrypt(key, nonce, aad_size ? other_aad : NULL, aad_size,
+                                                 actual, actual_size, decrypted, &decrypted_size), 0);
+        CHECK_EQ(decrypted_size, size);
+        CHECK_MEM(decrypted, message, size);
+    }
+}
+
+int main() {
+    from_hex(key_hex, key);
+    from_hex(nonce_hex, nonce);
+    from_hex(aad_hex, aad);
+
+    RUN(test_rfc8439_encrypt);
+    RUN(test_rfc8439_decrypt);
+    RUN(test_forgery_wiped);
+    RUN(test_buffer_sizes);
+    RUN(test_reference_tags);
+    RUN(test_matches_wolfcrypt);
+    return check_result();
+}
@@ -0,0 +1,207 @@
+// The config field table of src/configTable.h: defaults, every field saved
+// to json and loaded back at both of its bounds, values past them refused
+
+#include <ctype.h>
+#include <math.h>
+#include <string>
+
+#include "configTable.h"
+#include "check.h"
+
+#define DOCUMENT_SIZE 4096
+
+// A value at a bound of the field, a string or data that long
+template <class T>
+static void atBound(T &value, const T &bound, int) {
+    value = bound;
+}
+
+// doubles are saved with nine significant digits, kept just inside the bound
+static void atBound(double &value, double bound, int inward) {
+    value = bound * (1 + inward * 1e-6);
+}
+
+static void atBound(String &value, size_t length, int) {
+    static const char characters[] = "q\"b\\/\t";
+    std::string s;
+    for (size_t i = 0; i < length; i++)
+        s += characters[i % (sizeof(characters) - 1)];
+    value = s.c_str();
+}
+
+static void atBound(std::vector<uint8_t> &value, size_t size, int) {
+    value.resize(size);
+    for (size_t i = 0; i < size; i++)
+        value[i] = uint8_t(i * 37 + 11);
+}
+
+// A json value just past a bound of the field, false when there is none
+template <class T>
+static bool pastBound(JsonVariant variant, const T &, const T &bound, int outward) {
+    variant.set(static_cast<long long>(bound) + outward);
+    return true;
+}
+
+static bool pastBound(JsonVariant variant, const double &, double bound, int outward) {
+    variant.set(bound * (1 + outward * 1e-3));
+    return true;
+}
+
+static bool pastBound(JsonVariant variant, const String &, size_t length, int outward) {
+    if (outward < 0 && length == 0)
+        return false;
+    variant.set(std::string(length + outward, 'a'));
+    return true;
+}
+
+static bool pastBound(JsonVariant variant, const std::vector<uint8_t> &, size_t size, int outward) {
+    if (outward < 0 && size == 0)
+        return false;
+    configFieldOps::toJson(variant, std::vector<uint8_t>(size + outward, 0x5a));
+    return true;
+}
+
+template <class T>
+static bool same(const T &a, const T &b) {
+    return a == b;
+}
+
+static bool same(double a, double b) {
+    return fabs(a - b) <= fabs(b) * 1e-8;
+}
+
+static void test_defaults() {
+    configData data;
+    CHECK_STR(data.hostName.c_str(), "");
+    CHECK_STR(data.webUserName.c_str(), "admin");
+    CHECK_STR(data.webPassword.c_str(), "admin");
+    CHECK(data.homeKitPairData.empty());
+    CHECK_EQ(data.reportSendInterval, 60 * 1000);
+    CHECK_EQ(data.maxPower, 0);
+    CHECK_EQ(data.maxPowerHold, 10000);
+    CHECK_EQ(data.wattageThreshold, 25);
+    CHECK_EQ(data.wattagePercentThreshold, 5);
+    CHECK(data.voltageCalibrationRatio == 1.0);
+    CHECK(data.currentCalibrationRatio == 1.0);
+    CHECK(data.powerCalibrationRatio == 1.0);
+
+    data.webUserName = "someone";
+    data.homeKitPairData.assign(16, 1);
+    data.maxPowerHold = 1;
+    data.powerCalibrationRatio = 2;
+    data.setDefaults();
+    std::string changed;
+    const configData defaults;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        if (!same(field.get(data), field.get(defaults)))
+            changed += std::string(field.id) + " ";
+    });
+    CHECK_STR(changed.c_str(), "");
+}
+
+static void test_ids() {
+    CHECK_EQ(ConfigFieldCount, 12);
+    for (size_t i = 0; i < ConfigFieldCount; i++) {
+        for (const char *c = ConfigFieldIds[i]; *c; c++)
+            CHECK(!isupper((unsigned char) *c));
+        // loading matches keys ignoring case
+        for (size_t j = i + 1; j < ConfigFieldCount; j++)
+            CHECK(strcasecmp(ConfigFieldIds[i], ConfigFieldIds[j]));
+    }
+
+    std::string internal;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t index) {
+        CHECK(field.id == ConfigFieldIds[index]);
+        if (field.persistence == ConfigPersistence::Internal)
+            internal += field.id;
+    });
+    CHECK_STR(internal.c_str(), "homekitpairdata");
+}
+
+// Every field at one of its bounds, saved as config::save() does and loaded
+// into defaults
+static void round_trip(bool atMax) {
+    configData saved;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        atBound(field.get(saved), atMax ? field.maxValue : field.minValue, atMax ? -1 : 1);
+    });
+
+    DynamicJsonDocument document(DOCUMENT_SIZE);
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        configFieldOps::toJson(document.getOrAddMember(field.id), field.get(saved));
+    });
+    CHECK(!document.overflowed());
+    std::string json;
+    serializeJson(document, json);
+
+    DynamicJsonDocument parsed(DOCUMENT_SIZE);
+    CHECK(!deserializeJson(parsed, json));
+    const JsonObjectConst object = parsed.as<JsonObjectConst>();
+
+    // saved in table order, what loading tries first
+    size_t index = 0;
+    for (const JsonPairConst pair : object) {
+        CHECK(index < ConfigFieldCount && !strcmp(pair.key().c_str(), ConfigFieldIds[index]));
+        index++;
+    }
+    CHECK_EQ(index, ConfigFieldCount);
+
+    configData loaded;
+    std::string mismatched;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        if (!configFieldOps::fromJson(object[field.id], field.get(loaded), field.minValue, field.maxValue)
+                || !same(field.get(loaded), field.get(saved)))
+            mismatched += std::string(field.id) + " ";
+    });
+    CHECK_STR(mismatched.c_str(), "");
+}
+
+static void test_round_trip_at_min() {
+    round_trip(false);
+}
+
+static void test_round_trip_at_max() {
+    round_trip(true);
+}
+
+static void test_past_bounds_refused() {
+    std::string accepted;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        for (int outward : {-1, 1}) {
+            DynamicJsonDocument document(DOCUMENT_SIZE);
+            configData data;
+            if (!pastBound(document.to<JsonVariant>(), field.get(data),
+                           outward < 0 ? field.minValue : field.maxValue, outward))
+                continue;
+            const auto before = field.get(data);
+            if (configFieldOps::fromJson(document.as<JsonVariantConst>(), field.get(data),
+                                         field.minValue, field.maxValue)
+                    || !same(field.get(data), before))
+                accepted += std::string(field.id) + (outward < 0 ? "-1 " : "+1 ");
+        }
+    });
+    CHECK_STR(accepted.c_str(), "");
+}
+
+static void test_wrong_type_refused() {
+    std::string accepted;
+    forEachConfigField(ConfigFields, [&](const auto &field, size_t) {
+        DynamicJsonDocument document(DOCUMENT_SIZE);
+        document.to<JsonVariant>().set(true);
+        configData data;
+        if (configFieldOps::fromJson(document.as<JsonVariantConst>(), field.get(data),
+                                     field.minValue, field.maxValue))
+            accepted += std::string(field.id) + " ";
+    });
+    CHECK_STR(accepted.c_str(), "");
+}
+
+int main() {
+    RUN(test_defaults);
+    RUN(test_ids);
+    RUN(test_round_trip_at_min);
+    RUN(test_round_trip_at_max);
+    RUN(test_past_bounds_refused);
+    RUN(test_wrong_type_refused);
+    return check_result();
+}
@@ -0,0 +1,123 @@
+// Curve25519 keys pregenerated for pair verify M1, refilled by the loop
+
+#include <string.h>
+
+#include "arduino_homekit_server.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+
+bool ephemeral_key_take(homekit_server_t *server, curve25519_key *key);
+
+static controller_t controller;
+
+static homekit_server_t *server() {
+    return arduino_homekit_get_running_server();
+}
+
+static void pooled_public(int index, byte *key) {
+    size_t size = 32;
+    CHECK_EQ(crypto_curve25519_export_public(&server()->ephemeral_keys[index], key, &size), 0);
+}
+
+static void fill_pool() {
+    for (int i = 0; i < HOMEKIT_EPHEMERAL_KEYS + 2; i++)
+        arduino_homekit_loop();
+}
+
+static void empty_pool() {
+    curve25519_key key;
+    while (ephemeral_key_take(server(), &key))
+        crypto_curve25519_done(&key);
+}
+
+static void test_refilled_one_per_loop() {
+    empty_pool();
+    for (int i = 1; i <= HOMEKIT_EPHEMERAL_KEYS; i++) {
+        arduino_homekit_loop();
+        CHECK_EQ(server()->ephemeral_keys_count, i);
+    }
+    arduino_homekit_loop();
+    CHECK_EQ(server()->ephemeral_keys_count, HOMEKIT_EPHEMERAL_KEYS);
+}
+
+static void test_pooled_key_used_once() {
+    fill_pool();
+    byte last[32];
+    pooled_public(HOMEKIT_EPHEMERAL_KEYS - 1, last);
+
+    controller_connect(&controller);
+    CHECK_EQ(controller_pair_verify_start(&controller), 0);
+    CHECK_MEM(controller.accessory_curve_public, last, 32);
+    CHECK_EQ(server()->ephemeral_keys_count, HOMEKIT_EPHEMERAL_KEYS - 1);
+    // the taken slot is cleared
+    static const curve25519_key zero = {};
+    CHECK_MEM(&server()->ephemeral_keys[HOMEKIT_EPHEMERAL_KEYS - 1], &zero, sizeof(zero));
+
+    CHECK_EQ(controller_pair_verify_finish(&controller), 0);
+    controller_disconnect(&controller);
+
+    // the next handshake gets the other key, the one refilled in between is new
+    controller_connect(&controller);
+    CHECK_EQ(controller_pair_verify_start(&controller), 0);
+    CHECK(memcmp(controller.accessory_curve_public, last, 32));
+    CHECK_EQ(controller_pair_verify_finish(&controller), 0);
+    controller_disconnect(&controller);
+
+    fill_pool();
+    for (int i = 0; i < HOMEKIT_EPHEMERAL_KEYS; i++) {
+        byte key[32];
+        pooled_public(i, key);
+        CHECK(memcmp(key, last, 32));
+    }
+}
+
+static void test_empty_pool_generates_inline() {
+    // connected and idle, the pool is drained after the loop refilled it
+    controller_connect(&controller);
+    empty_pool();
+    CHECK_EQ(controller_pair_verify_start(&controller), 0);
+    CHECK_EQ(server()->ephemeral_keys_count, 0);
+
+    // no refill while a client is between M1 and M3
+    for (int i = 0; i < 3; i++)
+        controller_pump(&controller);
+    CHECK_EQ(server()->ephemeral_keys_count, 0);
+
+    // refilled in the loop that verified the session
+    CHECK_EQ(controller_pair_verify_finish(&controller), 0);
+    CHECK_EQ(server()->ephemeral_keys_count, 1);
+    controller_response_t response;
+    CHECK_EQ(controller_request(&controller, "GET", "/characteristics?id=1.301", "", &response), 0);
+    CHECK_EQ(response.status, 200);
+    controller_disconnect(&controller);
+}
+
+static void test_many_handshakes() {
+    // pooled and inline keys mixed, every session must still verify
+    for (int i = 0; i < 6; i++) {
+        controller_connect(&controller);
+        if (i % 3 == 2)
+            empty_pool();
+        CHECK_EQ(controller_pair_verify(&controller), 0);
+        controller_disconnect(&controller);
+    }
+}
+
+int main() {
+    host_random_seed(45);
+    host_fs_clear();
+    controller_provision(&controller, DEVICE_ID);
+    arduino_homekit_setup(&accessory_config);
+    CHECK_EQ(server()->ephemeral_keys_count, 0);
+
+    RUN(test_refilled_one_per_loop);
+    RUN(test_pooled_key_used_once);
+    RUN(test_empty_pool_generates_inline);
+    RUN(test_many_handshakes);
+    return check_result();
+}
@@ -0,0 +1,211 @@
+// Per client event slots: numbering past the 255 slots there are, coalescing
+// into one EVENT in order of first change, rate limit and send buffer backoff
+
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arduino_homekit_server.h"
+#include "cJSON.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define DEVICE_A "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define DEVICE_B "0A1B2C3D-4E5F-4061-8273-8495A6B7C8D9"
+#define NOTIFYING 300 // uint16 characteristics, past the slots there are
+#define EVENT_BURST_MS 4000 // time to a full token bucket, HOMEKIT_EVENT_BURST EVENTs
+
+typedef std::vector<std::pair<int, int>> values_t; // iid and value
+
+static homekit_server_config_t *config;
+static controller_t a, b;
+
+static homekit_characteristic_t *characteristic(unsigned iid) {
+    return homekit_characteristic_by_aid_and_iid(config->accessories, 1, iid);
+}
+
+static void notify(unsigned iid, uint16_t value) {
+    homekit_characteristic_t *ch = characteristic(iid);
+    ch->value = HOMEKIT_UINT16(value);
+    homekit_characteristic_notify(ch, ch->value);
+}
+
+// HAP status of a subscription, 0 when it took
+static int subscribe(controller_t *controller, unsigned iid, bool events = true) {
+    controller_response_t response;
+    std::string body = "{\"characteristics\":[{\"aid\":1,\"iid\":" + std::to_string(iid)
+            + ",\"ev\":" + (events ? "true" : "false") + "}]}";
+    CHECK_EQ(controller_request(controller, "PUT", "/characteristics", body, &response), 0);
+    if (response.status == 204)
+        return 0;
+    cJSON *root = cJSON_Parse(response.body.c_str());
+    cJSON *status = cJSON_GetObjectItem(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "characteristics"), 0),
+                                        "status");
+    int r = status ? status->valueint : -1;
+    cJSON_Delete(root);
+    return r;
+}
+
+static values_t event_values(const std::string &body) {
+    values_t values;
+    cJSON *root = cJSON_Parse(body.c_str());
+    cJSON *item;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "characteristics")) {
+        CHECK_EQ(cJSON_GetObjectItem(item, "aid")->valueint, 1);
+        values.push_back(std::make_pair(cJSON_GetObjectItem(item, "iid")->valueint,
+                                        cJSON_GetObjectItem(item, "value")->valueint));
+    }
+    cJSON_Delete(root);
+    return values;
+}
+
+static values_t next_event(controller_t *controller) {
+    std::string body;
+    if (!controller_event(controller, &body, 3))
+        return values_t();
+    return event_values(body);
+}
+
+static void test_slots_numbered() {
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    CHECK_EQ(server->event_slots_count, 255);
+    CHECK_EQ(characteristic(2)->event_slot, HOMEKIT_EVENT_SLOT_NONE); // read only
+    for (unsigned i = 0; i <= NOTIFYING; i++) {
+        homekit_characteristic_t *ch = characteristic(ACCESSORY_WIDE_FIRST_IID + i);
+        CHECK_EQ(ch->event_slot, i < 255 ? i : HOMEKIT_EVENT_SLOT_NONE);
+        if (i < 255)
+            CHECK(server->event_characteristics[i] == ch);
+    }
+}
+
+static void test_subscribe_without_slot() {
+    CHECK_EQ(subscribe(&a, ACCESSORY_WIDE_FIRST_IID + 254), 0);
+    CHECK_EQ(subscribe(&a, ACCESSORY_WIDE_FIRST_IID + 255), HAPStatus_NotificationsUnsupported);
+    CHECK_EQ(subscribe(&a, ACCESSORY_WIDE_FIRST_IID + NOTIFYING), HAPStatus_NotificationsUnsupported);
+    CHECK_EQ(subscribe(&a, 2), HAPStatus_NotificationsUnsupported);
+    // turning events off is always fine
+    CHECK_EQ(subscribe(&a, ACCESSORY_WIDE_FIRST_IID + 255, false), 0);
+
+    host_time_advance(EVENT_BURST_MS);
+    notify(ACCESSORY_WIDE_FIRST_IID + 255, 1);
+    CHECK(next_event(&a).empty());
+    notify(ACCESSORY_WIDE_FIRST_IID + 254, 2);
+    CHECK(next_event(&a) == values_t({ { ACCESSORY_WIDE_FIRST_IID + 254, 2 } }));
+    CHECK_EQ(subscribe(&a, ACCESSORY_WIDE_FIRST_IID + 254, false), 0);
+}
+
+static void test_coalesced_in_first_change_order() {
+    CHECK_EQ(subscribe(&a, 15), 0);
+    CHECK_EQ(subscribe(&a, 11), 0);
+    CHECK_EQ(subscribe(&a, 200), 0);
+
+    host_time_advance(EVENT_BURST_MS);
+    notify(15, 1);
+    notify(11, 1);
+    notify(15, 2);
+    notify(200, 7);
+    notify(15, 3);
+    CHECK(next_event(&a) == values_t({ { 15, 3 }, { 11, 1 }, { 200, 7 } }));
+    CHECK(next_event(&a).empty());
+
+    // slots are free again, the order starts over
+    notify(200, 8);
+    notify(11, 2);
+    CHECK(next_event(&a) == values_t({ { 200, 8 }, { 11, 2 } }));
+}
+
+static void test_rate_limited() {
+    host_time_advance(EVENT_BURST_MS);
+    for (int i = 0; i < EVENT_BURST_MS / 1000; i++) {
+        notify(11, 100 + i);
+        CHECK(next_event(&a) == values_t({ { 11, 100 + i } }));
+    }
+
+    // out of tokens, changes wait and merge
+    notify(11, 200);
+    notify(15, 200);
+    notify(11, 201);
+    CHECK(next_event(&a).empty());
+    host_time_advance(500);
+    CHECK(next_event(&a) == values_t({ { 11, 201 }, { 15, 200 } }));
+}
+
+static void test_send_buffer_backoff() {
+    host_time_advance(EVENT_BURST_MS);
+    a.socket->send_buffer = 100;
+    notify(11, 300);
+    CHECK(next_event(&a).empty());
+
+    // held for the backoff even once the buffer drained
+    a.socket->send_buffer = 1072;
+    notify(11, 301);
+    CHECK(next_event(&a).empty());
+    host_time_advance(300);
+    CHECK(next_event(&a) == values_t({ { 11, 301 } }));
+}
+
+static void test_clients_apart() {
+    controller_add(&b, DEVICE_B);
+    controller_connect(&b);
+    CHECK_EQ(controller_pair_verify(&b), 0);
+    CHECK_EQ(subscribe(&b, 12), 0);
+    CHECK_EQ(subscribe(&b, 11), 0);
+
+    host_time_advance(EVENT_BURST_MS);
+    notify(12, 1);
+    notify(11, 400);
+    notify(15, 400);
+    CHECK(next_event(&a) == values_t({ { 11, 400 }, { 15, 400 } }));
+    CHECK(next_event(&b) == values_t({ { 12, 1 }, { 11, 400 } }));
+
+    // a client does not hear back the value it wrote itself, the other does
+    homekit_characteristic_t *ch = characteristic(12);
+    ch->permissions = (homekit_permissions_t)(ch->permissions | homekit_permissions_paired_write);
+    controller_response_t response;
+    CHECK_EQ(subscribe(&a, 12), 0);
+    CHECK_EQ(controller_request(&b, "PUT", "/characteristics",
+                                "{\"characteristics\":[{\"aid\":1,\"iid\":12,\"value\":9}]}", &response), 0);
+    CHECK_EQ(response.status, 204);
+    CHECK(next_event(&a) == values_t({ { 12, 9 } }));
+    CHECK(next_event(&b).empty());
+}
+
+static void test_disconnect_with_pending() {
+    // a string value is copied into the slot, freeing the client frees it
+    CHECK_EQ(subscribe(&b, ACCESSORY_WIDE_FIRST_IID), 0);
+    b.socket->send_buffer = 0;
+    homekit_characteristic_t *ch = characteristic(ACCESSORY_WIDE_FIRST_IID);
+    char pending[] = "pending";
+    homekit_characteristic_notify(ch, HOMEKIT_STRING(pending));
+    notify(11, 500);
+    controller_disconnect(&b);
+    CHECK_EQ(arduino_homekit_connected_clients_count(), 1);
+
+    host_time_advance(EVENT_BURST_MS);
+    CHECK(next_event(&a) == values_t({ { 11, 500 } }));
+}
+
+int main() {
+    host_random_seed(35);
+    host_fs_clear();
+    config = accessory_config_wide(NOTIFYING);
+    controller_provision(&a, DEVICE_A);
+    arduino_homekit_setup(config);
+    controller_connect(&a);
+    CHECK_EQ(controller_pair_verify(&a), 0);
+
+    RUN(test_slots_numbered);
+    RUN(test_subscribe_without_slot);
+    RUN(test_coalesced_in_first_change_order);
+    RUN(test_rate_limited);
+    RUN(test_send_buffer_backoff);
+    RUN(test_clients_apart);
+    RUN(test_disconnect_with_pending);
+
+    controller_disconnect(&a);
+    return check_result();
+}
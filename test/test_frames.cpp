@@ -0,0 +1,132 @@
+// Encrypted HAP frames decrypted in place: empty frames, frames split across
+// reads, several in one read, and a frame that does not authenticate. The
+// transmit buffer shared by the clients.
+
+#include <deque>
+#include <string>
+
+#include "arduino_homekit_server.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define DEVICE_ID "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define OTHER_DEVICE_ID "0A1B2C3D-4E5F-4061-8273-8495A6B7C8D9"
+#define READ_ON "GET /characteristics?id=1.301 HTTP/1.1\r\nHost: accessory\r\n\r\n"
+
+bool client_tx_append(client_context_t *context, const byte *data, size_t size);
+bool client_tx_flush(client_context_t *context);
+
+static controller_t controller, other;
+
+static void connect() {
+    controller_connect(&controller);
+    CHECK_EQ(controller_pair_verify(&controller), 0);
+}
+
+static void check_read_on() {
+    controller_response_t response;
+    CHECK_EQ(controller_receive(&controller, &response), 0);
+    CHECK_EQ(response.status, 200);
+}
+
+static void test_empty_frames_skipped() {
+    connect();
+    controller_send_frame(&controller, "");
+    controller_send_frame(&controller, READ_ON);
+    check_read_on();
+
+    // alone in a read, then followed by a request in the next
+    controller_send_frame(&controller, "");
+    controller_pump(&controller);
+    controller_send_frame(&controller, READ_ON);
+    check_read_on();
+    controller_disconnect(&controller);
+}
+
+static void test_split_frames() {
+    connect();
+    // the url is taken in one piece, the request is cut after it
+    std::string request = READ_ON;
+    size_t line = request.find("\r\n") + 2;
+    controller_send_frame(&controller, request.substr(0, line));
+    controller_send_frame(&controller, request.substr(line));
+
+    // a byte at a time, every frame is unfinished in some read
+    std::deque<uint8_t> sent;
+    sent.swap(controller.socket->in);
+    while (!sent.empty()) {
+        controller.socket->in.push_back(sent.front());
+        sent.pop_front();
+        controller_pump(&controller);
+    }
+    check_read_on();
+    controller_disconnect(&controller);
+}
+
+static void test_frames_in_one_read() {
+    connect();
+    for (int i = 0; i < 3; i++)
+        controller_send_frame(&controller, READ_ON);
+    for (int i = 0; i < 3; i++)
+        check_read_on();
+    controller_disconnect(&controller);
+}
+
+static void test_bad_frame_disconnects() {
+    connect();
+    CHECK_EQ(arduino_homekit_connected_clients_count(), 1);
+    controller_send_frame(&controller, READ_ON);
+    controller.socket->in.back() ^= 1; // the tag
+    for (int i = 0; i < 3; i++)
+        controller_pump(&controller);
+    CHECK_EQ(arduino_homekit_connected_clients_count(), 0);
+    controller_disconnect(&controller);
+}
+
+// Frames one client left in the buffer reach it when another takes the buffer
+static void test_buffer_handed_over() {
+    connect();
+    homekit_server_t *server = arduino_homekit_get_running_server();
+    client_context_t *first = server->clients;
+    controller_connect(&other);
+    CHECK_EQ(controller_pair_verify(&other), 0);
+    client_context_t *second = server->clients;
+    CHECK(first != second);
+
+    static const char response[] = "HTTP/1.1 204 No Content\r\n\r\n";
+    CHECK(client_tx_append(first, (const byte *) response, 10));
+    CHECK(client_tx_flush(second));
+    CHECK(client_tx_append(first, (const byte *) response + 10, sizeof(response) - 1 - 10));
+    CHECK(client_tx_flush(first));
+
+    controller_response_t received;
+    CHECK_EQ(controller_receive(&controller, &received), 0);
+    CHECK_EQ(received.status, 204);
+    CHECK_EQ(arduino_homekit_connected_clients_count(), 2);
+
+    // both sessions still decrypt
+    controller_send_frame(&controller, READ_ON);
+    check_read_on();
+    CHECK_EQ(controller_request(&other, "GET", "/characteristics?id=1.301", "", &received), 0);
+    CHECK_EQ(received.status, 200);
+    controller_disconnect(&other);
+    controller_disconnect(&controller);
+}
+
+int main() {
+    host_random_seed(39);
+    host_fs_clear();
+    controller_provision(&controller, DEVICE_ID);
+    controller_add(&other, OTHER_DEVICE_ID);
+    arduino_homekit_setup(&accessory_config);
+
+    RUN(test_empty_frames_skipped);
+    RUN(test_split_frames);
+    RUN(test_frames_in_one_read);
+    RUN(test_bad_frame_disconnects);
+    RUN(test_buffer_handed_over);
+    return check_result();
+}
@@ -0,0 +1,258 @@
+// Edge cases of the pull tokenizer that reads PUT /characteristics bodies
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_reader.h"
+#include "check.h"
+
+// The reader gets exactly size bytes, a copy without terminator makes
+// reads past the end visible to sanitizers
+static json_reader reader;
+static char *text;
+
+static json_reader *read_text(const char *json) {
+    free(text);
+    size_t size = strlen(json);
+    text = malloc(size ? size : 1);
+    memcpy(text, json, size);
+    json_reader_init(&reader, text, size);
+    return &reader;
+}
+
+static bool read_value(const char *json, json_token *token) {
+    return json_reader_value(read_text(json), token);
+}
+
+static void test_punctuation() {
+    json_reader *r = read_text(" \t\r\n{ } ");
+    CHECK(!json_reader_next(r, '}'));
+    CHECK(json_reader_next(r, '{'));
+    CHECK(!json_reader_at_end(r));
+    CHECK(json_reader_next(r, '}'));
+    CHECK(json_reader_at_end(r));
+    CHECK(!json_reader_next(r, '}'));
+
+    CHECK(json_reader_at_end(read_text("")));
+
+    // a terminated body ends at its NUL
+    json_reader_init(&reader, "{}\0garbage", 10);
+    CHECK(json_reader_next(&reader, '{') && json_reader_next(&reader, '}'));
+    CHECK(json_reader_at_end(&reader));
+}
+
+static void test_strings() {
+    json_token token;
+
+    CHECK(read_value("\"on\"", &token));
+    CHECK_EQ(token.type, json_token_string);
+    CHECK_EQ(token.string_size, 2);
+    CHECK(!strncmp(token.string, "on", 2));
+    CHECK(!token.string_escaped);
+
+    CHECK(read_value("\"\"", &token));
+    CHECK_EQ(token.string_size, 0);
+
+    CHECK(read_value("\"a\\\"b\"", &token));
+    CHECK_EQ(token.string_size, 4);
+    CHECK(token.string_escaped);
+
+    CHECK(read_value("\"\\\\\"", &token));
+    CHECK_EQ(token.string_size, 2);
+
+    CHECK(!read_value("\"open", &token));
+    CHECK(!read_value("\"open\\", &token));
+    CHECK(!read_value("\"open\\\"", &token));
+    CHECK(!read_value("\"tab\there\"", &token));
+    CHECK(!read_value("\"line\nbreak\"", &token));
+
+    const char *key;
+    size_t key_size;
+    json_reader *r = read_text("\"aid\" : 1");
+    CHECK(json_reader_key(r, &key, &key_size));
+    CHECK(json_token_key_equals(key, key_size, "aid"));
+    CHECK(!json_token_key_equals(key, key_size, "ai"));
+    CHECK(!json_token_key_equals(key, key_size, "aids"));
+    CHECK(!json_reader_key(read_text("\"aid\" 1"), &key, &key_size));
+}
+
+static void check_strdup(const char *json, const char *expected) {
+    json_token token;
+    CHECK(read_value(json, &token));
+    char *actual = json_token_strdup(&token);
+    if (expected) {
+        CHECK_STR(actual, expected);
+    } else {
+        CHECK(actual == NULL);
+    }
+    free(actual);
+}
+
+static void test_unescape() {
+    check_strdup("\"plain\"", "plain");
+    check_strdup("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\/\b\f\n\r\t");
+    check_strdup("\"caf\\u00e9\"", "caf\xc3\xa9");
+    check_strdup("\"\\u20AC5\"", "\xe2\x82\xac" "5");
+    check_strdup("\"\\u007f\"", "\x7f");
+    check_strdup("\"\\ud83d\\ude00\"", "\xf0\x9f\x98\x80");
+
+    check_strdup("\"\\u12\"", NULL);
+    check_strdup("\"\\u12g4\"", NULL);
+    check_strdup("\"\\ud83d\"", NULL);
+    check_strdup("\"\\ud83dx\\ude00\"", NULL);
+    check_strdup("\"\\ud83d\\u0041\"", NULL);
+
+    json_token token;
+    CHECK(read_value("12", &token));
+    CHECK(json_token_strdup(&token) == NULL);
+}
+
+static void check_number(const char *json, double expected) {
+    json_token token;
+    CHECK(read_value(json, &token));
+    CHECK_EQ(token.type, json_token_number);
+    CHECK(token.number == expected);
+}
+
+static void test_numbers() {
+    check_number("0", 0);
+    check_number("42", 42);
+    check_number("-7", -7);
+    check_number("21.5", 21.5);
+    check_number("1e3", 1000);
+    check_number("-2.5E-1", -0.25);
+    check_number("65535", 65535);
+    check_number("4294967295", 4294967295.0);
+    check_number("100}", 100); // stops at the delimiter
+    check_number("0.1234567890123456789012345678", 0.1234567890123456789012345678);
+
+    json_token token;
+    CHECK(!read_value("-", &token));
+    CHECK(!read_value("1.2.3", &token));
+    CHECK(!read_value("1e", &token));
+    CHECK(!read_value("+", &token));
+    CHECK(!read_value("x", &token));
+    CHECK(!read_value("0.12345678901234567890123456789012", &token)); // 32 characters
+
+    // 0x10 is 0 and leaves x behind for the caller to fail on
+    json_reader *r = read_text("0x10");
+    CHECK(json_reader_value(r, &token));
+    CHECK(token.number == 0);
+    CHECK(!json_reader_at_end(r));
+}
+
+static void test_literals() {
+    json_token token;
+
+    CHECK(read_value("true", &token));
+    CHECK_EQ(token.type, json_token_true);
+    CHECK(token.number == 1);
+    CHECK(read_value("false", &token));
+    CHECK_EQ(token.type, json_token_false);
+    CHECK(token.number == 0);
+    CHECK(read_value("null", &token));
+    CHECK_EQ(token.type, json_token_null);
+
+    CHECK(!read_value("tru", &token));
+    CHECK(!read_value("fals", &token));
+    CHECK(!read_value("nul", &token));
+    CHECK(!read_value("True", &token));
+    CHECK(!read_value("", &token));
+    CHECK(!read_value("   ", &token));
+}
+
+static void test_containers() {
+    json_token token;
+    json_reader *r;
+
+    r = read_text("{\"a\":[1,{\"b\":\"}]\"},[]],\"c\":null} ,");
+    CHECK(json_reader_value(r, &token));
+    CHECK_EQ(token.type, json_token_container);
+    CHECK(json_reader_next(r, ','));
+
+    CHECK(read_value("[]", &token));
+    CHECK(read_value("{}", &token));
+    CHECK(!read_value("[", &token));
+    CHECK(!read_value("[}", &token));
+    CHECK(!read_value("{]", &token));
+    CHECK(!read_value("[[]", &token));
+    CHECK(!read_value("[\"]", &token));
+    CHECK(!read_value("[\"\\\"]", &token));
+
+    // JSON_READER_MAX_DEPTH levels
+    char deep[2 * 33 + 1];
+    memset(deep, '[', 32);
+    memset(deep + 32, ']', 32);
+    deep[64] = 0;
+    CHECK(read_value(deep, &token));
+    memset(deep, '[', 33);
+    memset(deep + 33, ']', 33);
+    deep[66] = 0;
+    CHECK(!read_value(deep, &token));
+
+    // mixed nesting keeps its kinds apart at every depth
+    CHECK(read_value("[{\"x\":[{\"y\":[]}]}]", &token));
+    CHECK(!read_value("[{\"x\":[{\"y\":[}]}]}]", &token));
+}
+
+// The walk of characteristic_updates_process without the server around it
+static int count_updates(const char *json) {
+    json_reader *r = read_text(json);
+    int count = 0;
+    if (!json_reader_next(r, '{'))
+        return -1;
+    const char *key;
+    size_t key_size;
+    if (!json_reader_key(r, &key, &key_size) || !json_token_key_equals(key, key_size, "characteristics")
+            || !json_reader_next(r, '['))
+        return -1;
+    if (!json_reader_next(r, ']')) {
+        do {
+            if (!json_reader_next(r, '{'))
+                return -1;
+            double aid = 0, iid = 0;
+            do {
+                json_token token;
+                if (!json_reader_key(r, &key, &key_size) || !json_reader_value(r, &token))
+                    return -1;
+                if (json_token_key_equals(key, key_size, "aid"))
+                    aid = token.number;
+                else if (json_token_key_equals(key, key_size, "iid"))
+                    iid = token.number;
+            } while (json_reader_next(r, ','));
+            if (!json_reader_next(r, '}') || aid < 1 || iid < 1)
+                return -1;
+            count++;
+        } while (json_reader_next(r, ','));
+        if (!json_reader_next(r, ']'))
+            return -1;
+    }
+    if (!json_reader_next(r, '}') || !json_reader_at_end(r))
+        return -1;
+    return count;
+}
+
+static void test_update_bodies() {
+    CHECK_EQ(count_updates("{\"characteristics\":[]}"), 0);
+    CHECK_EQ(count_updates("{\"characteristics\":[{\"aid\":1,\"iid\":9,\"value\":true}]}"), 1);
+    CHECK_EQ(count_updates(
+        "{\"characteristics\":[{\"aid\":1,\"iid\":9,\"ev\":true},"
+        "{\"aid\":2,\"iid\":10,\"value\":\"x\\\"y\"},"
+        "{\"aid\":3,\"iid\":11,\"value\":[1,2]}]}\r\n"), 3);
+    CHECK_EQ(count_updates("{\"characteristics\":[{\"aid\":1,\"iid\":9}]}}"), -1);
+    CHECK_EQ(count_updates("{\"characteristics\":[{\"aid\":1,\"iid\":9},]}"), -1);
+    CHECK_EQ(count_updates("{\"characteristics\":[{\"aid\":1,\"iid\":9 \"value\":1}]}"), -1);
+    CHECK_EQ(count_updates("{\"characteristics\":[{\"aid\":1,\"iid\":9,\"value\":tru}]}"), -1);
+}
+
+int main() {
+    RUN(test_punctuation);
+    RUN(test_strings);
+    RUN(test_unescape);
+    RUN(test_numbers);
+    RUN(test_literals);
+    RUN(test_containers);
+    RUN(test_update_bodies);
+    free(text);
+    return check_result();
+}
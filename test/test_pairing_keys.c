@@ -0,0 +1,177 @@
+// Decoded controller keys kept by storage.c for pair verify M3
+
+#include <string.h>
+
+#include "crypto.h"
+#include "storage.h"
+#include "check.h"
+#include "host.h"
+
+#define DEVICE_A "4F6C1C0A-3E1B-4D3A-9C7E-1A2B3C4D5E6F"
+#define DEVICE_B "0A1B2C3D-4E5F-4061-8273-8495A6B7C8D9"
+
+// where the device key of the first pairing record is, see pairing_data_t
+#define PAIRING_KEY_ADDR (128 + 4 + 1 + 36)
+
+static const byte message[] = "controller curve key, id and accessory curve key";
+
+static void sign(const ed25519_key *key, byte *signature) {
+    size_t size = 64;
+    CHECK_EQ(crypto_ed25519_sign(key, message, sizeof(message), signature, &size), 0);
+    CHECK_EQ(size, 64);
+}
+
+static int verify(const pairing_t *pairing, const byte *signature) {
+    CHECK(pairing->device_point != NULL);
+    return crypto_ed25519_verify_decoded(&pairing->device_key, pairing->device_point,
+                                         message, sizeof(message), signature, 64);
+}
+
+static void setup(ed25519_key *a, ed25519_key *b) {
+    host_storage_clear();
+    CHECK_EQ(homekit_storage_init(), 1);
+    crypto_ed25519_init(a);
+    crypto_ed25519_init(b);
+    CHECK_EQ(crypto_ed25519_generate(a), 0);
+    CHECK_EQ(crypto_ed25519_generate(b), 0);
+}
+
+static void test_cached_point() {
+    ed25519_key a, b;
+    byte signature[64];
+    pairing_t pairing, again;
+    setup(&a, &b);
+    sign(&a, signature);
+
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature), 0);
+
+    ge_p3 point;
+    CHECK_EQ(crypto_ed25519_decode_public_key(&a, &point), 0);
+    CHECK_MEM(pairing.device_point, &point, sizeof(point));
+
+    // the same entry every time, nothing is decoded again
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &again), 0);
+    CHECK(again.device_point == pairing.device_point);
+
+    pairing_iterator_t it;
+    homekit_storage_pairing_iterator_init(&it);
+    CHECK_EQ(homekit_storage_next_pairing(&it, &again), 0);
+    CHECK(again.device_point == pairing.device_point);
+    CHECK(homekit_storage_next_pairing(&it, &again) != 0);
+    homekit_storage_pairing_iterator_done(&it);
+
+    // and it verifies like the undecoded key
+    signature[10] ^= 1;
+    CHECK(verify(&pairing, signature) != 0);
+    CHECK(crypto_ed25519_verify(&pairing.device_key, message, sizeof(message), signature, 64) != 0);
+}
+
+static void test_replaced_pairing() {
+    ed25519_key a, b;
+    byte signature_a[64], signature_b[64];
+    pairing_t pairing;
+    setup(&a, &b);
+    sign(&a, signature_a);
+    sign(&b, signature_b);
+
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature_a), 0);
+
+    // same id, another key
+    CHECK_EQ(homekit_storage_remove_pairing(DEVICE_A), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), -1);
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &b, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature_b), 0);
+    CHECK(verify(&pairing, signature_a) != 0);
+}
+
+static void test_key_changed_in_storage() {
+    ed25519_key a, b;
+    byte signature_a[64], signature_b[64], public_b[32];
+    size_t public_b_size = sizeof(public_b);
+    pairing_t pairing;
+    setup(&a, &b);
+    sign(&a, signature_a);
+    sign(&b, signature_b);
+
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature_a), 0);
+
+    // written behind the cache, the entry is checked against the stored key
+    CHECK_EQ(crypto_ed25519_export_public_key(&b, public_b, &public_b_size), 0);
+    CHECK(write_storage(PAIRING_KEY_ADDR, public_b, sizeof(public_b)));
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature_b), 0);
+    CHECK(verify(&pairing, signature_a) != 0);
+}
+
+static void test_updated_pairing() {
+    ed25519_key a, b;
+    byte signature_a[64], signature_b[64];
+    pairing_t pairing;
+    setup(&a, &b);
+    sign(&a, signature_a);
+    sign(&b, signature_b);
+
+    char accessory_id[ACCESSORY_ID_SIZE + 1];
+    homekit_storage_save_accessory_id("12:34:56:78:9A:BC");
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_B, &b, 0), 0);
+    CHECK(!homekit_storage_can_add_pairing());
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_B, &pairing), 0);
+    CHECK_EQ(pairing.id, 1);
+    CHECK_EQ(verify(&pairing, signature_b), 0);
+
+    // a permission change moves the record, compacting the storage on the
+    // way: B goes to slot 0 where A was, then to slot 1
+    CHECK_EQ(homekit_storage_remove_pairing(DEVICE_A), 0);
+    CHECK_EQ(homekit_storage_update_pairing(DEVICE_B, pairing_permissions_admin), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_B, &pairing), 0);
+    CHECK_EQ(pairing.permissions, pairing_permissions_admin);
+    CHECK_EQ(verify(&pairing, signature_b), 0);
+    CHECK(verify(&pairing, signature_a) != 0);
+
+    // and A to slot 0 again, where the cache last held B
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, 0), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature_a), 0);
+    CHECK(verify(&pairing, signature_b) != 0);
+
+    // compaction keeps the accessory
+    CHECK_EQ(homekit_storage_load_accessory_id(accessory_id), 0);
+    CHECK_STR(accessory_id, "12:34:56:78:9A:BC");
+}
+
+static void test_reinit() {
+    ed25519_key a, b;
+    byte signature[64];
+    pairing_t pairing;
+    setup(&a, &b);
+    sign(&a, signature);
+
+    CHECK_EQ(homekit_storage_add_pairing(DEVICE_A, &a, pairing_permissions_admin), 0);
+    // a reboot decodes the stored keys at init
+    CHECK_EQ(homekit_storage_init(), 0);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), 0);
+    CHECK_EQ(verify(&pairing, signature), 0);
+
+    // none are left after a reset
+    CHECK_EQ(homekit_storage_reset(), 1);
+    CHECK_EQ(homekit_storage_find_pairing(DEVICE_A, &pairing), -1);
+    CHECK(homekit_storage_can_add_pairing());
+}
+
+int main() {
+    host_random_seed(43);
+    RUN(test_cached_point);
+    RUN(test_replaced_pairing);
+    RUN(test_key_changed_in_storage);
+    RUN(test_updated_pairing);
+    RUN(test_reinit);
+    return check_result();
+}
@@ -0,0 +1,67 @@
+// SRP pre-init of an unpaired accessory: only started by setup, advanced a
+// slice per loop, finished at once by a pair setup M1 that comes early
+
+#include <string>
+
+#include "arduino_homekit_server.h"
+#include "accessory.h"
+#include "controller.h"
+#include "check.h"
+#include "host.h"
+#include "host_fs.h"
+
+#define LOOPS 20
+
+static controller_t controller;
+
+static void test_started_by_setup() {
+    CHECK_EQ(arduino_homekit_preinit_progress(), 0);
+}
+
+static void test_slice_per_loop() {
+    for (int i = 0; i < LOOPS; i++)
+        arduino_homekit_loop();
+    const int progress = arduino_homekit_preinit_progress();
+    CHECK(progress > 0);
+    CHECK(progress < 100);
+}
+
+static void test_early_m1_finishes() {
+    controller_connect(&controller);
+    tlv_values_t *m1 = tlv_new();
+    tlv_add_integer_value(m1, TLVType_State, 1, 1);
+    tlv_add_integer_value(m1, TLVType_Method, 1, 0);
+    size_t size = 0;
+    tlv_format(m1, NULL, &size);
+    std::string body(size, '\0');
+    tlv_format(m1, (byte *) &body[0], &size);
+    tlv_free(m1);
+
+    controller_response_t response;
+    CHECK_EQ(controller_request(&controller, "POST", "/pair-setup", body, &response,
+                                "application/pairing+tlv8"), 0);
+    CHECK_EQ(response.status, 200);
+    CHECK_EQ(arduino_homekit_preinit_progress(), 100);
+
+    tlv_values_t *m2 = tlv_new();
+    CHECK_EQ(tlv_parse((const byte *) response.body.data(), response.body.size(), m2), 0);
+    CHECK_EQ(tlv_get_integer_value(m2, TLVType_State, -1), 2);
+    CHECK(tlv_get_value(m2, TLVType_Error) == NULL);
+    tlv_t *key = tlv_get_value(m2, TLVType_PublicKey);
+    CHECK(key && key->size == 384);
+    tlv_t *salt = tlv_get_value(m2, TLVType_Salt);
+    CHECK(salt && salt->size == 16);
+    tlv_free(m2);
+    controller_disconnect(&controller);
+}
+
+int main() {
+    host_random_seed(46);
+    host_fs_clear();
+    arduino_homekit_setup(&accessory_config);
+
+    RUN(test_started_by_setup);
+    RUN(test_slice_per_loop);
+    RUN(test_early_m1_finishes);
+    return check_result();
+}
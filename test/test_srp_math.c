@@ -0,0 +1,147 @@
+// srp_math.c against the wolfcrypt integer math it replaces, built once per
+// limb width
+
+#include <string.h>
+
+#include "user_settings.h"
+#include <wolfssl/wolfcrypt/integer.h>
+
+#include "srp_math.h"
+#include "port.h"
+#include "check.h"
+#include "host.h"
+
+extern const unsigned char N[];
+
+static void reference_exptmod(const uint8_t *base, size_t base_size,
+                              const uint8_t *exponent, size_t exponent_size,
+                              uint8_t *out) {
+    mp_int b, e, n, r;
+    CHECK_EQ(mp_init_multi(&b, &e, &n, &r, NULL, NULL), MP_OKAY);
+    mp_read_unsigned_bin(&b, base, base_size);
+    mp_read_unsigned_bin(&e, exponent, exponent_size);
+    mp_read_unsigned_bin(&n, N, SRP_MATH_BYTES);
+    CHECK_EQ(mp_exptmod(&b, &e, &n, &r), MP_OKAY);
+
+    memset(out, 0, SRP_MATH_BYTES);
+    mp_to_unsigned_bin(&r, out + SRP_MATH_BYTES - mp_unsigned_bin_size(&r));
+    mp_clear(&b);
+    mp_clear(&e);
+    mp_clear(&n);
+    mp_clear(&r);
+}
+
+static void check_exptmod(const uint8_t *base, size_t base_size,
+                          const uint8_t *exponent, size_t exponent_size) {
+    uint8_t expected[SRP_MATH_BYTES], actual[SRP_MATH_BYTES];
+    reference_exptmod(base, base_size, exponent, exponent_size, expected);
+    CHECK_EQ(srp_exptmod(base, base_size, exponent, exponent_size, N, SRP_MATH_BYTES, actual), 0);
+    if (memcmp(expected, actual, SRP_MATH_BYTES))
+        fprintf(stderr, "  base %zu bytes, exponent %zu bytes\n", base_size, exponent_size);
+    CHECK_MEM(expected, actual, SRP_MATH_BYTES);
+}
+
+static void test_num_bytes_round_trip() {
+    uint8_t in[SRP_MATH_BYTES], out[SRP_MATH_BYTES];
+    srp_num_t a;
+
+    host_random_seed(1);
+    homekit_random_fill(in, sizeof(in));
+    in[0] |= 1;
+    CHECK_EQ(srp_num_from_bytes(&a, in, sizeof(in)), 0);
+    CHECK_EQ(srp_num_size(&a), SRP_MATH_BYTES);
+    srp_num_to_bytes(&a, out);
+    CHECK_MEM(in, out, sizeof(in));
+
+    // short input comes back left padded
+    CHECK_EQ(srp_num_from_bytes(&a, in, 3), 0);
+    CHECK_EQ(srp_num_size(&a), in[0] ? 3 : 2);
+    srp_num_to_bytes(&a, out);
+    CHECK_MEM(out + SRP_MATH_BYTES - 3, in, 3);
+    for (size_t i = 0; i < SRP_MATH_BYTES - 3; i++)
+        CHECK_EQ(out[i], 0);
+
+    CHECK_EQ(srp_num_from_bytes(&a, in, 0), 0);
+    CHECK_EQ(srp_num_size(&a), 0);
+}
+
+static void test_rejects_bad_arguments() {
+    uint8_t too_long[SRP_MATH_BYTES + 1] = {0};
+    uint8_t even[SRP_MATH_BYTES], out[SRP_MATH_BYTES];
+    uint8_t one = 1;
+    srp_num_t a;
+    srp_mont_t mont;
+
+    CHECK(srp_num_from_bytes(&a, too_long, sizeof(too_long)) < 0);
+
+    memcpy(even, N, SRP_MATH_BYTES);
+    even[SRP_MATH_BYTES - 1] &= ~1;
+    CHECK(srp_mont_init(&mont, even, SRP_MATH_BYTES) < 0);
+    CHECK(srp_exptmod(&one, 1, &one, 1, even, SRP_MATH_BYTES, out) < 0);
+
+    // the modulus has to fill all SRP_MATH_BITS
+    CHECK(srp_mont_init(&mont, N + 1, SRP_MATH_BYTES - 1) < 0);
+    CHECK(srp_exptmod(&one, 1, too_long, sizeof(too_long), N, SRP_MATH_BYTES, out) == 0);
+}
+
+static void test_small_exponents() {
+    const uint8_t g = 5;
+    uint8_t exponent[64] = {0};
+
+    check_exptmod(&g, 1, exponent, 0);
+    check_exptmod(&g, 1, exponent, sizeof(exponent)); // zero with leading zero bytes
+    exponent[sizeof(exponent) - 1] = 1;
+    check_exptmod(&g, 1, exponent, sizeof(exponent));
+    exponent[sizeof(exponent) - 1] = 2;
+    check_exptmod(&g, 1, exponent, sizeof(exponent));
+    for (int value = 3; value < 256; value += 4) {
+        exponent[sizeof(exponent) - 1] = value;
+        check_exptmod(&g, 1, exponent + sizeof(exponent) - 1, 1);
+    }
+}
+
+// the shapes pair setup uses: g^b, v^u, A*v^u with 32 and 64 byte exponents
+static void test_random_inputs() {
+    uint8_t base[SRP_MATH_BYTES], exponent[SRP_MATH_BYTES];
+
+    host_random_seed(2);
+    for (int i = 0; i < 24; i++) {
+        size_t base_size = i % 3 == 0 ? 1 : 1 + homekit_random() % SRP_MATH_BYTES;
+        size_t exponent_size = i % 4 == 0 ? 32 : i % 4 == 1 ? 64 : 1 + homekit_random() % SRP_MATH_BYTES;
+
+        homekit_random_fill(base, base_size);
+        homekit_random_fill(exponent, exponent_size);
+        if (i % 3 == 0)
+            base[0] = 5;
+        if (base_size == SRP_MATH_BYTES)
+            base[0] &= 0x7f; // below N like every value pair setup raises
+        check_exptmod(base, base_size, exponent, exponent_size);
+    }
+}
+
+// base N - 1 is -1 mod N, odd and even exponents give N - 1 and 1
+static void test_minus_one() {
+    uint8_t base[SRP_MATH_BYTES], out[SRP_MATH_BYTES];
+    uint8_t exponent = 3;
+
+    memcpy(base, N, SRP_MATH_BYTES);
+    base[SRP_MATH_BYTES - 1] -= 1;
+    CHECK_EQ(srp_exptmod(base, SRP_MATH_BYTES, &exponent, 1, N, SRP_MATH_BYTES, out), 0);
+    CHECK_MEM(out, base, SRP_MATH_BYTES);
+
+    exponent = 4;
+    CHECK_EQ(srp_exptmod(base, SRP_MATH_BYTES, &exponent, 1, N, SRP_MATH_BYTES, out), 0);
+    for (size_t i = 0; i < SRP_MATH_BYTES - 1; i++)
+        CHECK_EQ(out[i], 0);
+    CHECK_EQ(out[SRP_MATH_BYTES - 1], 1);
+}
+
+int main() {
+    printf("SRP_MATH_LIMB_BITS %d\n", SRP_MATH_LIMB_BITS);
+    RUN(test_num_bytes_round_trip);
+    RUN(test_rejects_bad_arguments);
+    RUN(test_small_exponents);
+    RUN(test_random_inputs);
+    RUN(test_minus_one);
+    return check_result();
+}
@@ -0,0 +1,273 @@
+// The time-sliced pair setup of pre-init against crypto_srp_init, and its
+// salt and verifier kept across a reboot
+
+#include <string.h>
+
+#include "crypto.h"
+#include "storage.h"
+#include "port.h"
+#include "check.h"
+#include "host.h"
+#include "srp_client.h"
+
+#define USERNAME "Pair-Setup"
+#define PASSWORD "111-22-333"
+
+static int run_setup(crypto_srp_setup_t *setup, unsigned max_bits) {
+    int r, steps = 0, progress = crypto_srp_setup_progress(setup);
+    while ((r = crypto_srp_setup_step(setup, max_bits)) == 1) {
+        int next = crypto_srp_setup_progress(setup);
+        CHECK(next >= progress && next <= 100);
+        progress = next;
+        steps++;
+    }
+    CHECK_EQ(r, 0);
+    CHECK_EQ(crypto_srp_setup_progress(setup), 100);
+    return steps;
+}
+
+// M1 to M4 against a wolfcrypt controller
+static void check_handshake(Srp *srp, const byte *server_key, size_t server_key_size) {
+    byte salt[16], client_key[384], proof[64], server_proof[64];
+    size_t salt_size = sizeof(salt), client_key_size = sizeof(client_key);
+    size_t proof_size = sizeof(proof), server_proof_size = sizeof(server_proof);
+
+    CHECK_EQ(crypto_srp_get_salt(srp, salt, &salt_size), 0);
+    srp_client_t *client = srp_client_new(USERNAME, PASSWORD, salt, salt_size);
+    CHECK(client != NULL);
+    if (!client)
+        return;
+
+    CHECK_EQ(srp_client_get_public_key(client, client_key, &client_key_size), 0);
+    CHECK_EQ(srp_client_compute_key(client, server_key, server_key_size), 0);
+    CHECK_EQ(srp_client_get_proof(client, proof, &proof_size), 0);
+
+    CHECK_EQ(crypto_srp_compute_key(srp, client_key, client_key_size, server_key, server_key_size), 0);
+    CHECK_EQ(crypto_srp_verify(srp, proof, proof_size), 0);
+    CHECK_EQ(crypto_srp_get_proof(srp, server_proof, &server_proof_size), 0);
+    CHECK_EQ(srp_client_verify(client, server_proof, server_proof_size), 0);
+
+    // a wrong proof is refused
+    proof[0] ^= 1;
+    CHECK(crypto_srp_verify(srp, proof, proof_size) != 0);
+    srp_client_free(client);
+}
+
+static void test_matches_one_shot() {
+    byte expected[384], actual[384];
+    size_t expected_size = sizeof(expected), actual_size = sizeof(actual);
+
+    host_random_seed(7);
+    Srp *srp = crypto_srp_new();
+    CHECK_EQ(crypto_srp_init(srp, USERNAME, PASSWORD), 0);
+    CHECK_EQ(crypto_srp_get_public_key(srp, expected, &expected_size), 0);
+    crypto_srp_free(srp);
+
+    host_random_seed(7);
+    srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+    CHECK(setup != NULL);
+    run_setup(setup, 64);
+    CHECK_EQ(crypto_srp_setup_get_public_key(setup, actual, &actual_size), 0);
+    CHECK_EQ(actual_size, expected_size);
+    CHECK_MEM(actual, expected, expected_size);
+
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(srp);
+}
+
+// the result does not depend on how the work is sliced
+static void test_step_sizes() {
+    byte expected[384], actual[384];
+    size_t expected_size = sizeof(expected);
+    const unsigned sizes[] = {1, 7, 64, 100000};
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        size_t actual_size = sizeof(actual);
+        host_random_seed(11);
+        Srp *srp = crypto_srp_new();
+        crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+        CHECK(setup != NULL);
+        int steps = run_setup(setup, sizes[i]);
+        if (sizes[i] == 100000)
+            CHECK(steps <= 2);
+        CHECK_EQ(crypto_srp_setup_get_public_key(setup, actual, &actual_size), 0);
+        if (i == 0)
+            memcpy(expected, actual, expected_size = actual_size);
+        CHECK_EQ(actual_size, expected_size);
+        CHECK_MEM(actual, expected, expected_size);
+        crypto_srp_setup_free(setup);
+        crypto_srp_free(srp);
+    }
+}
+
+static void test_handshake() {
+    byte server_key[384];
+    size_t server_key_size = sizeof(server_key);
+
+    host_random_seed(13);
+    Srp *srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+    CHECK(setup != NULL);
+    run_setup(setup, 64);
+    CHECK_EQ(crypto_srp_setup_get_public_key(setup, server_key, &server_key_size), 0);
+    crypto_srp_setup_free(setup);
+
+    check_handshake(srp, server_key, server_key_size);
+    crypto_srp_free(srp);
+}
+
+static void test_public_key_before_done() {
+    byte key[384];
+    size_t key_size = sizeof(key);
+
+    Srp *srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+    CHECK(setup != NULL);
+    CHECK_EQ(crypto_srp_setup_step(setup, 8), 1);
+    CHECK(crypto_srp_setup_progress(setup) < 100);
+    CHECK(crypto_srp_setup_get_public_key(setup, key, &key_size) != 0);
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(srp);
+}
+
+static crypto_srp_setup_t *finished_setup(Srp *srp, byte *server_key, size_t *server_key_size) {
+    crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+    CHECK(setup != NULL);
+    run_setup(setup, 64);
+    CHECK_EQ(crypto_srp_setup_get_public_key(setup, server_key, server_key_size), 0);
+    return setup;
+}
+
+static void test_restore() {
+    byte state[CRYPTO_SRP_STATE_SIZE], first_key[384], server_key[384];
+    size_t first_key_size = sizeof(first_key), server_key_size = sizeof(server_key);
+
+    host_random_seed(17);
+    Srp *first = crypto_srp_new();
+    crypto_srp_setup_t *setup = finished_setup(first, first_key, &first_key_size);
+    CHECK_EQ(crypto_srp_setup_export(setup, PASSWORD, state), 0);
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(first);
+
+    // only the 256 bit private key is left to raise
+    Srp *srp = crypto_srp_new();
+    setup = NULL;
+    CHECK_EQ(crypto_srp_setup_restore(srp, USERNAME, PASSWORD, state, &setup), 0);
+    CHECK(setup != NULL);
+    if (!setup)
+        return;
+    CHECK(crypto_srp_setup_progress(setup) < 100);
+    CHECK_EQ(run_setup(setup, 64), 256 / 64);
+    CHECK_EQ(crypto_srp_setup_get_public_key(setup, server_key, &server_key_size), 0);
+    crypto_srp_setup_free(setup);
+
+    // a new key pair every time, never the B of the saved setup
+    CHECK_EQ(server_key_size, first_key_size);
+    CHECK(memcmp(server_key, first_key, server_key_size) != 0);
+
+    check_handshake(srp, server_key, server_key_size);
+    crypto_srp_free(srp);
+}
+
+static void test_restore_other_code() {
+    byte state[CRYPTO_SRP_STATE_SIZE], server_key[384], salt[16];
+    size_t server_key_size = sizeof(server_key), salt_size = sizeof(salt);
+
+    Srp *srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = finished_setup(srp, server_key, &server_key_size);
+    CHECK_EQ(crypto_srp_setup_export(setup, PASSWORD, state), 0);
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(srp);
+
+    srp = crypto_srp_new();
+    setup = NULL;
+    CHECK_EQ(crypto_srp_setup_restore(srp, USERNAME, "111-22-334", state, &setup), -1);
+    CHECK(setup == NULL);
+    CHECK_EQ(crypto_srp_get_salt(srp, salt, &salt_size), 0);
+    CHECK_EQ(salt_size, 0);
+
+    // a changed salt fails the same check
+    state[32] ^= 1;
+    CHECK_EQ(crypto_srp_setup_restore(srp, USERNAME, PASSWORD, state, &setup), -1);
+    CHECK(setup == NULL);
+    crypto_srp_free(srp);
+}
+
+// the check does not cover the verifier, a damaged one fails at M3
+static void test_restore_damaged_verifier() {
+    byte state[CRYPTO_SRP_STATE_SIZE], server_key[384], client_key[384], salt[16], proof[64];
+    size_t server_key_size = sizeof(server_key), client_key_size = sizeof(client_key);
+    size_t salt_size = sizeof(salt), proof_size = sizeof(proof);
+
+    Srp *srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = finished_setup(srp, server_key, &server_key_size);
+    CHECK_EQ(crypto_srp_setup_export(setup, PASSWORD, state), 0);
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(srp);
+
+    state[CRYPTO_SRP_STATE_SIZE - 1] ^= 1;
+    srp = crypto_srp_new();
+    setup = NULL;
+    CHECK_EQ(crypto_srp_setup_restore(srp, USERNAME, PASSWORD, state, &setup), 0);
+    if (!setup)
+        return;
+    run_setup(setup, 64);
+    CHECK_EQ(crypto_srp_setup_get_public_key(setup, server_key, &server_key_size), 0);
+    crypto_srp_setup_free(setup);
+
+    CHECK_EQ(crypto_srp_get_salt(srp, salt, &salt_size), 0);
+    srp_client_t *client = srp_client_new(USERNAME, PASSWORD, salt, salt_size);
+    CHECK_EQ(srp_client_get_public_key(client, client_key, &client_key_size), 0);
+    CHECK_EQ(srp_client_compute_key(client, server_key, server_key_size), 0);
+    CHECK_EQ(srp_client_get_proof(client, proof, &proof_size), 0);
+    CHECK_EQ(crypto_srp_compute_key(srp, client_key, client_key_size, server_key, server_key_size), 0);
+    CHECK(crypto_srp_verify(srp, proof, proof_size) != 0);
+    srp_client_free(client);
+    crypto_srp_free(srp);
+}
+
+static void test_export_unfinished() {
+    byte state[CRYPTO_SRP_STATE_SIZE];
+
+    Srp *srp = crypto_srp_new();
+    crypto_srp_setup_t *setup = crypto_srp_setup_new(srp, USERNAME, PASSWORD);
+    CHECK_EQ(crypto_srp_setup_step(setup, 8), 1);
+    CHECK(crypto_srp_setup_export(setup, PASSWORD, state) != 0);
+    crypto_srp_setup_free(setup);
+    crypto_srp_free(srp);
+}
+
+static void test_storage_file() {
+    byte state[CRYPTO_SRP_STATE_SIZE], loaded[CRYPTO_SRP_STATE_SIZE];
+
+    host_storage_clear();
+    host_random_seed(19);
+    homekit_random_fill(state, sizeof(state));
+    CHECK(homekit_storage_load_srp_state(loaded) != 0);
+
+    CHECK_EQ(homekit_storage_save_srp_state(state), 0);
+    CHECK_EQ(host_storage_file_size("/hapsrp.state"), 4 + CRYPTO_SRP_STATE_SIZE);
+    CHECK_EQ(homekit_storage_load_srp_state(loaded), 0);
+    CHECK_MEM(loaded, state, sizeof(state));
+
+    // the state lives apart from the pairing storage
+    CHECK_EQ(host_storage_size(), 0);
+
+    homekit_storage_forget_srp_state();
+    CHECK_EQ(host_storage_file_size("/hapsrp.state"), -1);
+    CHECK(homekit_storage_load_srp_state(loaded) != 0);
+}
+
+int main() {
+    RUN(test_matches_one_shot);
+    RUN(test_step_sizes);
+    RUN(test_handshake);
+    RUN(test_public_key_before_done);
+    RUN(test_restore);
+    RUN(test_restore_other_code);
+    RUN(test_restore_damaged_verifier);
+    RUN(test_export_unfinished);
+    RUN(test_storage_file);
+    return check_result();
+}